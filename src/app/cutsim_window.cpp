@@ -17,14 +17,20 @@
  *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <boost/foreach.hpp>
+
 #include "cutsim_window.hpp"
 
-CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), settings("github.aewallin.cutsim","cutsim") {
+/// length of the simulated cutters, long enough to reach through the stock
+static const double tool_length = 50.0;
+
+CutsimWindow::CutsimWindow(QStringList ags) : myTools(tool_length), defaultTool(2, tool_length), args(ags), myLastFolder(tr("")), settings("github.aewallin.cutsim","cutsim") {
         myGLWidget = new cutsim::GLWidget(); 
         unsigned int max_depth=8;
         double octree_cube_side=10.0;
         cutsim::GLData* gld = myGLWidget->addGLData();
         myCutsim  =  new cutsim::Cutsim(octree_cube_side , max_depth, gld);
+        myCutsim->set_chunk_depth(4); // a cut re-meshes only the 8x8x8 blocks of the smallest nodes around it
         this->setCentralWidget(myGLWidget);
         
         // hard-coded stock
@@ -35,30 +41,8 @@ CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), s
         myCutsim->sum_volume(stock);
         
         currentTool = 0;
-        // hard-coded tool
-        cutsim::SphereVolume* s1 = new cutsim::SphereVolume();
-        s1->setRadius(2);
-        s1->setCenter( cutsim::GLVertex(0,0,0) );
-        s1->setColor(1,1,0);
-        myTools.push_back(s1);
-        
-        cutsim::SphereVolume* s2 = new cutsim::SphereVolume();
-        s2->setRadius(3);
-        s2->setCenter( cutsim::GLVertex(0,0,0) );
-        s2->setColor(1,0,0);
-        myTools.push_back(s2);
-        
-        cutsim::SphereVolume* s3 = new cutsim::SphereVolume();
-        s3->setRadius(4);
-        s3->setCenter( cutsim::GLVertex(0,0,0) );
-        s3->setColor(0,1,0);
-        myTools.push_back(s3);
-        
-        cutsim::SphereVolume* s4 = new cutsim::SphereVolume();
-        s4->setRadius(2);
-        s4->setCenter( cutsim::GLVertex(0,0,0) );
-        s4->setColor(0,0,1);
-        myTools.push_back(s4);
+        waitingForQueue = false;
+        defaultTool.setColor(1,1,0);
         
         createDock();
         createActions();
@@ -86,10 +70,11 @@ CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), s
         connect(     this, SIGNAL( pause() ), myPlayer, SLOT( pause() ) );
         connect(     this, SIGNAL( stop() ), myPlayer, SLOT( stop() ) );
         connect(    myG2m, SIGNAL( signalCanonLine(canonLine*) ), myPlayer, SLOT( appendCanonLine(canonLine*) ) );
-        connect( myPlayer, SIGNAL( signalToolPosition(double,double,double) ), this, SLOT( slotSetToolPosition(double,double,double) ) );
+        connect( myPlayer, SIGNAL( signalToolMove(canonLine*) ), this, SLOT( slotToolMove(canonLine*) ) );
         connect( myPlayer, SIGNAL( signalToolChange( int ) ), this, SLOT( slotToolChange(int) ) );     
         
-        connect( this, SIGNAL( signalMoveDone() ), myPlayer, SLOT( slotRequestMove() ) );
+        // queued, so that requesting moves from a full queue does not recurse through gplayer
+        connect( this, SIGNAL( signalMoveDone() ), myPlayer, SLOT( slotRequestMove() ), Qt::QueuedConnection );
         
         connect( myCutsim, SIGNAL( signalDiffDone() ), this, SLOT( slotDiffDone() ) ); 
         connect( myCutsim, SIGNAL( signalGLDone() ), this, SLOT( slotGLDone() ) ); 
@@ -104,28 +89,59 @@ CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), s
         myCutsim->updateGL();
 }
 
-// called by gplayer
-void CutsimWindow::slotSetToolPosition(double x, double y, double z) {
-    myTools[currentTool]->setCenter( cutsim::GLVertex(x,y,z) );
-    myCutsim->slot_diff_volume_mt( myTools[currentTool] ); 
+// called by gplayer, cut the volume swept by the tool along one move
+void CutsimWindow::slotToolMove(canonLine* cl) {
+    const cutsim::CutterVolume* tool = myTools.tool(currentTool);
+    if ( !tool )
+        tool = &defaultTool;
+    g2m::Point s = cl->getStart().loc;
+    g2m::Point e = cl->getEnd().loc;
+    cutsim::GLVertex start(s.x, s.y, s.z);
+    cutsim::GLVertex end(e.x, e.y, e.z);
+    if ( cl->getMotionType() == g2m::HELICAL ) {
+        g2m::Point c = cl->getCenter();
+        g2m::Point a = cl->getAxis();
+        cutsim::GLVertex axis(a.x, a.y, a.z);
+        cutsim::HelicalMoveVolume move( *tool, start, cutsim::GLVertex(c.x, c.y, c.z), axis, 
+                                        cl->getAngle(), (end-start).dot(axis) );
+        myCutsim->queue_diff_volume( &move ); // the move is copied
+    } else {
+        cutsim::LinearMoveVolume move( *tool, start, end );
+        myCutsim->queue_diff_volume( &move );
+    }
+    if ( myCutsim->queue_full() )
+        waitingForQueue = true; // request the next move when the cutting stage has made room
+    else
+        emit signalMoveDone();
 }
 
-void CutsimWindow::slotDiffDone() { // called when the cut-thread is done and we can update GL
+void CutsimWindow::slotDiffDone() { // called when the cut-thread is done with a move, so the queue has room
     qDebug() << " slotDiffDone() ";
-    myCutsim->update_gl_mt(); //updateGL();
+    if ( waitingForQueue && !myCutsim->queue_full() ) {
+        waitingForQueue = false;
+        emit signalMoveDone();
+    }
 }
 
-void CutsimWindow::slotGLDone() { // called when GL-update done. we can now request a new move from gplayer
-    // request more g-code from player here.
-    emit signalMoveDone();
+void CutsimWindow::slotGLDone() { // called when the meshing-thread has updated and swapped the GLData
     qDebug() << " slotGLDone() ";
 }
 
 void CutsimWindow::slotToolChange(int t) {
     debugMessage( tr("ui: Tool-change to  %1 ").arg(t) );
-    currentTool = t-1;
+    currentTool = t;
+    if ( !myTools.tool(t) )
+        debugMessage( tr("ui: tool %1 is not in the tool table, cutting with the default tool").arg(t) );
 }    
 
+/// read the cutters from an EMC2 tool table, see cutsim::ToolTable
+void CutsimWindow::loadToolTable(QString path) {
+    myTools.read( path.toStdString() );
+    BOOST_FOREACH( const std::string& msg, myTools.messages() ) {
+        debugMessage( tr("ui: ") + QString::fromStdString(msg) );
+    }
+}
+
 ///find the interpreter. uses QSettings, so user is only asked once unless the file is deleted
 void CutsimWindow::findInterp() {
     QString interp;
@@ -159,6 +175,7 @@ void CutsimWindow::chooseToolTable() {
         debugMessage("tool table does not exist!");
     }
     settings.setValue("rs274/tool-table",path);
+    loadToolTable(path);
     emit setToolTable(path);
 }
 
@@ -1,11 +1,13 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
+
 #include <QMainWindow>
 //#include <QPluginLoader>
 //#include <QMutex>
 
 #include <cutsim/cutsim.hpp>
 #include <cutsim/glwidget.hpp>
+#include <cutsim/tool_table.hpp>
 
 #include <g2m/g2m.hpp>
 #include <g2m/gplayer.hpp>
@@ -17,6 +19,9 @@ class QAction;
 class QLabel;
 class QMenu;
 
+// signals and slots are matched by their signature text, and GPlayer signals a canonLine*
+using g2m::canonLine;
+
 /// the main application window for the cutting-simulation
 /// this includes menus, toolbars, text-areas for g-code and canon-lines and debug
 /// the 3D view of tool/stock.
@@ -42,13 +47,13 @@ public slots:
     void appendGcodeLine(QString s) { gcodeText->appendLine(s); }
     /// add a Qstring line to the canon-line window
     void appendCanonLine(QString s) { canonText->appendLine(s); }
-    /// position tool
-    void slotSetToolPosition(double x, double y, double z);
+    /// cut the volume swept by the tool along a move
+    void slotToolMove(canonLine* cl);
     /// change the tool
     void slotToolChange(int t);
-    /// slot called by worker tasks when a diff-operation is done
+    /// slot called by the cutting stage when a diff-operation is done
     void slotDiffDone();
-    /// slot called by GL-thread when GL is updated
+    /// slot called by the meshing stage when GL is updated
     void slotGLDone();
 signals:
     /// signal other objects (g2m) with the path to the g-code file
@@ -101,6 +106,7 @@ private:
     void createToolBar();
     void createActions();
     void createMenus();
+    void loadToolTable(QString path);
 
     QMenu *fileMenu;
     QMenu *helpMenu;
@@ -119,8 +125,10 @@ private:
     
     cutsim::GLWidget* myGLWidget;
     
-    std::vector<cutsim::SphereVolume*> myTools;
-    unsigned int currentTool;
+    cutsim::ToolTable myTools; // tools from the tool table
+    cutsim::BallCutterVolume defaultTool; // used for tools which are not in the tool table
+    int currentTool;
+    bool waitingForQueue; // a move was cut but not followed by a request, because the Cutsim queue was full
     g2m::g2m* myG2m;
     g2m::GPlayer* myPlayer;
     TextArea* debugText;
@@ -0,0 +1,291 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include <g2m/canonReader.hpp>
+#include <g2m/canonStream.hpp>
+#include <g2m/nanotimer.hpp>
+
+#include "octree.hpp"
+#include "volume.hpp"
+#include "gldata.hpp"
+#include "marching_cubes.hpp"
+#include "tool_table.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Runs a g-code program through the cutting simulation without a GUI:
+ * reads a .canon file, or interprets a .ngc file with rs274, cuts the
+ * stock with the tools of the tool table along every move, meshes the
+ * result, writes it as a binary STL file, and prints timing statistics.
+ *
+ * usage: cutsim-batch [options] program.ngc|program.canon
+ *  -t file       EMC2 tool table
+ *  -i file       rs274 interpreter (default /usr/bin/rs274)
+ *  -s stock      sphere:cx,cy,cz,r or box:x0,y0,z0,x1,y1,z1 (default sphere:0,0,0,7)
+ *  -w size       side length of the octree cube (default 10)
+ *  -d depth      maximum depth of the octree (default 8)
+ *  -j threads    threads for the octree operations, 0 for one per core (default 0)
+ *  -e tolerance  stop subdividing where the surface is flat within this distance (default 0, always subdivide)
+ *  -l pending    defer up to this many operations on a coarse leaf, until meshing (default 0, never defer)
+ *  -b            subdivide leaves that a move may pass through between the corners
+ *  -u            update the mesh after every move, as the GUI does
+ *  -S lines      stream: cut while the program is read, with at most this many canon-lines 
+ *                parsed ahead of the simulation. the lines are deleted once they are cut.
+ *  -o file       write the final mesh to this STL file
+ *  -p file       write the per-stage timers and counters to this JSON file
+ *  -T file       write a Chrome trace of the timed stages to this file
+ * 
+ * -p and -T need a core library built with -DENABLE_INSTRUMENTATION=ON.
+ * */
+
+/// length of the simulated cutters, long enough to reach through the stock
+static const double tool_length = 50.0;
+
+static void usage() {
+    std::cerr << "usage: cutsim-batch [-t tooltable] [-i rs274] [-s stock] [-w size] [-d depth] [-j threads] [-e tolerance] [-l pending] [-b] [-u] [-S lines] [-o mesh.stl] [-p profile.json] [-T trace.json] program.ngc|program.canon\n";
+    std::cerr << " stock is sphere:cx,cy,cz,r or box:x0,y0,z0,x1,y1,z1\n";
+}
+
+/// create the stock Volume from "sphere:cx,cy,cz,r" or "box:x0,y0,z0,x1,y1,z1", or NULL
+static cutsim::Volume* makeStock(const std::string& spec) {
+    double v[6];
+    if ( sscanf( spec.c_str(), "sphere:%lf,%lf,%lf,%lf", &v[0], &v[1], &v[2], &v[3] ) == 4 ) {
+        cutsim::SphereVolume* stock = new cutsim::SphereVolume();
+        stock->setCenter( cutsim::GLVertex(v[0], v[1], v[2]) );
+        stock->setRadius( v[3] );
+        return stock;
+    }
+    if ( sscanf( spec.c_str(), "box:%lf,%lf,%lf,%lf,%lf,%lf", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5] ) == 6 ) {
+        cutsim::RectVolume* stock = new cutsim::RectVolume();
+        stock->corner = cutsim::GLVertex( v[0], v[1], v[2] );
+        stock->v1 = cutsim::GLVertex( v[3]-v[0], 0, 0 );
+        stock->v2 = cutsim::GLVertex( 0, v[4]-v[1], 0 );
+        stock->v3 = cutsim::GLVertex( 0, 0, v[5]-v[2] );
+        stock->calcBB();
+        return stock;
+    }
+    return NULL;
+}
+
+/// cut the volume swept by tool along the move cl, as CutsimWindow::slotToolMove() does
+static void cutMove(cutsim::Octree& tree, const cutsim::CutterVolume& tool, g2m::canonLine* cl) {
+    g2m::Point s = cl->getStart().loc;
+    g2m::Point e = cl->getEnd().loc;
+    cutsim::GLVertex start(s.x, s.y, s.z);
+    cutsim::GLVertex end(e.x, e.y, e.z);
+    if ( cl->getMotionType() == g2m::HELICAL ) {
+        g2m::Point c = cl->getCenter();
+        g2m::Point a = cl->getAxis();
+        cutsim::GLVertex axis(a.x, a.y, a.z);
+        cutsim::HelicalMoveVolume move( tool, start, cutsim::GLVertex(c.x, c.y, c.z), axis, 
+                                        cl->getAngle(), (end-start).dot(axis) );
+        tree.diff( &move );
+    } else {
+        cutsim::LinearMoveVolume move( tool, start, end );
+        tree.diff( &move );
+    }
+}
+
+/// write the triangles in the render-buffer of g to a binary STL file
+static bool writeSTL(const cutsim::GLData& g, const std::string& path) {
+    FILE* out = fopen( path.c_str(), "wb" );
+    if ( !out )
+        return false;
+    char header[80] = "cutsim-batch";
+    fwrite( header, 1, sizeof(header), out );
+    const cutsim::GLVertex* vertices = g.getVertexArray();
+    const GLuint* indices = g.getIndexArray();
+    unsigned int count = g.indexCount()/3;
+    fwrite( &count, 4, 1, out );
+    for ( unsigned int n=0; n<count; ++n ) {
+        cutsim::GLVertex p1 = vertices[ indices[3*n] ];
+        cutsim::GLVertex p2 = vertices[ indices[3*n+1] ];
+        cutsim::GLVertex p3 = vertices[ indices[3*n+2] ];
+        cutsim::GLVertex normal = (p2-p1).cross( p3-p1 );
+        if ( normal.norm() > 0 )
+            normal.normalize();
+        float facet[12] = { normal.x, normal.y, normal.z, p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z };
+        unsigned short attributes = 0;
+        fwrite( facet, 4, 12, out );
+        fwrite( &attributes, 2, 1, out );
+    }
+    return fclose( out ) == 0;
+}
+
+int main( int argc, char **argv ) {
+    std::string tooltable;
+    std::string interp = "/usr/bin/rs274";
+    std::string stock_spec = "sphere:0,0,0,7";
+    std::string mesh_file;
+    std::string profile_file;
+    std::string trace_file;
+    double octree_cube_side = 10.0;
+    unsigned int max_depth = 8;
+    unsigned int threads = 0;
+    double tolerance = 0.0;
+    unsigned int pending = 0;
+    bool interval = false;
+    bool update_every_move = false;
+    unsigned int stream_lines = 0;
+    int opt;
+    while ( (opt = getopt( argc, argv, "t:i:s:w:d:j:e:l:buS:o:p:T:" )) != -1 ) {
+        switch (opt) {
+            case 't': tooltable = optarg; break;
+            case 'i': interp = optarg; break;
+            case 's': stock_spec = optarg; break;
+            case 'w': octree_cube_side = atof(optarg); break;
+            case 'd': max_depth = atoi(optarg); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'e': tolerance = atof(optarg); break;
+            case 'l': pending = atoi(optarg); break;
+            case 'b': interval = true; break;
+            case 'u': update_every_move = true; break;
+            case 'S': stream_lines = atoi(optarg); break;
+            case 'o': mesh_file = optarg; break;
+            case 'p': profile_file = optarg; break;
+            case 'T': trace_file = optarg; break;
+            default: usage(); return 1;
+        }
+    }
+    if ( optind != argc-1 ) {
+        usage();
+        return 1;
+    }
+    std::string program = argv[optind];
+    cutsim::Volume* stock = makeStock( stock_spec );
+    if ( !stock ) {
+        std::cerr << "cutsim-batch: bad stock " << stock_spec << "\n";
+        usage();
+        return 1;
+    }
+    cutsim::ToolTable tools( tool_length );
+    if ( !tooltable.empty() ) {
+        tools.read( tooltable );
+        for ( unsigned int n=0; n<tools.messages().size(); ++n )
+            std::cout << "tooltable: " << tools.messages()[n] << "\n";
+    }
+    if ( ( !profile_file.empty() || !trace_file.empty() ) && !cutsim::Instrumentation::enabled() )
+        std::cerr << "cutsim-batch: the core library is built without instrumentation, -p and -T record nothing\n";
+    // used for tools which are not in the tool table
+    cutsim::BallCutterVolume default_tool( 2, tool_length );
+    
+    g2m::nanotimer timer;
+    timer.start();
+    g2m::canonReader reader; // the whole program, read before cutting
+    g2m::canonStream stream( stream_lines ); // or the lines parsed while cutting
+    if ( stream_lines ? !stream.open( program, interp, tooltable ) : !reader.readFile( program, interp, tooltable ) ) {
+        std::cerr << "cutsim-batch: " << ( stream_lines ? stream.getError() : reader.getError() ) << "\n";
+        return 1;
+    }
+    double t_read = timer.getElapsedS();
+    const std::vector<g2m::canonLine*>& lines = reader.getCanonLines();
+    g2m::nanotimer total;
+    total.start();
+    
+    if ( !trace_file.empty() )
+        cutsim::Instrumentation::start_trace();
+    timer.start();
+    cutsim::GLData g;
+    cutsim::GLVertex octree_center(0,0,0);
+    cutsim::Octree tree( octree_cube_side, max_depth, octree_center, &g );
+    tree.init(2u);
+    tree.set_threads( threads );
+    tree.set_tolerance( tolerance );
+    tree.set_lazy( pending );
+    tree.set_interval( interval );
+    cutsim::MarchingCubes mc( &g, &tree );
+    tree.sum( stock );
+    double t_stock = timer.getElapsedS();
+    
+    double t_cut = 0, t_mesh = 0, t_first = 0;
+    unsigned int moves = 0;
+    int current_tool = 0;
+    for ( unsigned int n=0; ; ++n ) {
+        g2m::canonLine* cl = stream_lines ? stream.next() : ( n<lines.size() ? lines[n] : NULL );
+        if ( !cl )
+            break;
+        if ( n == 0 )
+            current_tool = cl->getStatus()->getTool();
+        if ( !cl->isMotion() ) {
+            current_tool = cl->getStatus()->getTool();
+        } else {
+            if ( moves == 0 )
+                t_first = total.getElapsedS();
+            const cutsim::CutterVolume* tool = tools.tool( current_tool );
+            timer.start();
+            cutMove( tree, tool ? *tool : default_tool, cl );
+            t_cut += timer.getElapsedS();
+            moves++;
+            if ( update_every_move ) {
+                timer.start();
+                mc.updateGL();
+                g.swap();
+                t_mesh += timer.getElapsedS();
+            }
+        }
+        if ( stream_lines )
+            delete cl; // the stream hands over the lines, free them once they are cut
+    }
+    if ( stream_lines && !stream.getError().empty() ) {
+        std::cerr << "cutsim-batch: " << stream.getError() << "\n";
+        return 1;
+    }
+    timer.start();
+    mc.updateGL();
+    g.swap();
+    t_mesh += timer.getElapsedS();
+    double t_total = total.getElapsedS();
+    cutsim::Instrumentation::stop_trace();
+    
+    if ( !mesh_file.empty() && !writeSTL( g, mesh_file ) ) {
+        std::cerr << "cutsim-batch: cannot write " << mesh_file << "\n";
+        return 1;
+    }
+    printf("program:     %s\n", program.c_str() );
+    printf("gcode lines: %d\n", stream_lines ? stream.gcodeLines() : reader.gcodeLines() );
+    printf("canon lines: %u\n", stream_lines ? stream.linesParsed() : (unsigned int)lines.size() );
+    printf("moves:       %u\n", moves );
+    printf("read:        %10.3f ms%s\n", 1e3*t_read, stream_lines ? " (start of the stream)" : "" );
+    printf("stock:       %10.3f ms\n", 1e3*t_stock );
+    printf("first move:  %10.3f ms after reading\n", 1e3*t_first );
+    printf("cut:         %10.3f ms (%.1f moves/s)\n", 1e3*t_cut, (t_cut > 0) ? moves/t_cut : 0.0 );
+    printf("mesh:        %10.3f ms\n", 1e3*t_mesh );
+    printf("total:       %10.3f ms after reading\n", 1e3*t_total );
+    printf("triangles:   %d\n", g.polygonCount() );
+    printf("vertices:    %d\n", g.vertexCount() );
+    if ( cutsim::Instrumentation::enabled() )
+        std::cout << cutsim::Instrumentation::str();
+    if ( !profile_file.empty() && !cutsim::Instrumentation::write_json( profile_file ) ) {
+        std::cerr << "cutsim-batch: cannot write " << profile_file << "\n";
+        return 1;
+    }
+    if ( !trace_file.empty() && !cutsim::Instrumentation::write_trace( trace_file ) ) {
+        std::cerr << "cutsim-batch: cannot write " << trace_file << "\n";
+        return 1;
+    }
+    delete stock;
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <new>
+
+#include "alloc_counter.hpp"
+
+// these replace the global allocation functions, kept in their own
+// translation unit so the compiler does not inline them into callers.
+
+// C++11 removed dynamic exception specifications
+#if __cplusplus >= 201103L
+#define THROW_BAD_ALLOC
+#else
+#define THROW_BAD_ALLOC throw(std::bad_alloc)
+#endif
+
+static unsigned long n_alloc = 0;
+
+unsigned long allocation_count() {
+    return n_alloc;
+}
+
+void* operator new(std::size_t size) THROW_BAD_ALLOC {
+    ++n_alloc;
+    void* p = std::malloc( size ? size : 1 );
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    std::free(p);
+}
+
+void* operator new[](std::size_t size) THROW_BAD_ALLOC {
+    return operator new(size);
+}
+
+void operator delete[](void* p) throw() {
+    operator delete(p);
+}
+
+// end of file alloc_counter.cpp
@@ -0,0 +1,140 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <g2m/nanotimer.hpp>
+
+#include "gldata.hpp"
+
+#include "alloc_counter.hpp"
+
+/*
+ * GLData micro-benchmark. Measures the add and remove throughput of the 
+ * vertex/polygon bookkeeping, without an Octree:
+ *  - separate: each triangle has its own three vertices, and triangles are
+ *    removed with removeVertex(), as by CubeWireFrame.
+ *  - shared: a grid of triangles on shared vertices, as by MarchingCubes, 
+ *    removed with removePolygon(). Before the removal, a few vertices are
+ *    changed and the buffers swapped, many times, as by small cuts.
+ * Vertices and polygons are removed in random order. Reports the rate and
+ * the number of heap allocations of each step.
+ *
+ * usage: cutsim_gldata_bench [grid_size] [repeats]
+ * */
+
+/// rate and allocation-count for one step of the benchmark
+class Step {
+public:
+    Step(const char* n) : name(n) {
+        allocs = allocation_count();
+        timer.start();
+    }
+    void done(unsigned long count) {
+        double t = timer.getElapsedS();
+        printf(" %-16s %10lu in %8.3f ms, %8.2f M/s %10lu allocs\n", name, count, 1e3*t, 1e-6*count/t, allocation_count() - allocs);
+    }
+private:
+    const char* name;
+    unsigned long allocs;
+    g2m::nanotimer timer;
+};
+
+/// triangles with their own vertices
+void separate(unsigned int n) {
+    cutsim::GLData* g = new cutsim::GLData();
+    g->setTriangles();
+    unsigned int triangles = 2*n*n;
+    std::vector<GLuint> triangle(3);
+    Step s_add("separate add");
+    for (unsigned int t=0; t<triangles; ++t) {
+        for (int m=0;m<3;++m)
+            triangle[m] = g->addVertex( t, m, 0, 1, 1, 1 );
+        g->addPolygon( triangle );
+    }
+    s_add.done( triangles );
+    Step s_remove("separate remove");
+    unsigned int removed = 0;
+    while ( g->vertexCount() > 0 ) {
+        g->removeVertex( rand() % g->vertexCount() );
+        ++removed;
+    }
+    s_remove.done( removed );
+    delete g;
+}
+
+/// an n x n grid of squares, each split into two triangles on shared vertices
+void shared(unsigned int n) {
+    cutsim::GLData* g = new cutsim::GLData();
+    g->setTriangles();
+    std::vector<GLuint> triangle(3);
+    Step s_add("shared add");
+    for (unsigned int i=0; i<n; ++i) {
+        for (unsigned int j=0; j<n; ++j) {
+            GLuint v[4];
+            for (unsigned int c=0; c<4; ++c) {
+                unsigned int x = i + (c&1);
+                unsigned int y = j + (c>>1);
+                v[c] = g->addSharedVertex( 1 + x + (boost::uint64_t)(n+1)*y, cutsim::GLVertex(x, y, 0, 1, 1, 1) );
+            }
+            triangle[0] = v[0]; triangle[1] = v[1]; triangle[2] = v[3];
+            g->addPolygon( triangle );
+            triangle[0] = v[0]; triangle[1] = v[3]; triangle[2] = v[2];
+            g->addPolygon( triangle );
+        }
+    }
+    s_add.done( 2*n*n );
+    Step s_normals("shared normals");
+    unsigned int vertices = g->vertexCount();
+    g->updateNormals();
+    s_normals.done( vertices );
+    g->swap();
+    Step s_swap("shared swap");
+    const unsigned int swaps = 1000;
+    for (unsigned int s=0; s<swaps; ++s) {
+        for (int m=0; m<16; ++m)
+            g->setNormal( rand() % vertices, 0, 0, 1 );
+        g->swap();
+    }
+    s_swap.done( swaps );
+    Step s_remove("shared remove");
+    unsigned int removed = 0;
+    while ( g->polygonCount() > 0 ) {
+        g->removePolygon( rand() % g->polygonCount() );
+        ++removed;
+    }
+    s_remove.done( removed );
+    delete g;
+}
+
+int main( int argc, char **argv ) {
+    unsigned int n = (argc>1) ? atoi(argv[1]) : 300;
+    int repeats = (argc>2) ? atoi(argv[2]) : 3;
+    std::cout << "cutsim_gldata_bench grid_size=" << n << " (" << 2*n*n << " triangles) repeats=" << repeats << "\n";
+    srand(1);
+    for (int r=0; r<repeats; ++r) {
+        std::cout << "run " << r << "\n";
+        separate(n);
+        shared(n);
+    }
+    return 0;
+}
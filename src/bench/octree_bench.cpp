@@ -0,0 +1,262 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <g2m/nanotimer.hpp>
+
+#include "octree.hpp"
+#include "linear_octree.hpp"
+#include "octnode.hpp"
+#include "volume.hpp"
+#include "gldata.hpp"
+#include "marching_cubes.hpp"
+
+#include "alloc_counter.hpp"
+
+/*
+ * Octree benchmark. Runs the same operations as examples/cutsim4
+ * (sum a sphere, diff a sphere, marching-cubes) without opening a window,
+ * and reports wall-time and the number of heap allocations for each step.
+ * A second, smaller diff is then meshed incrementally.
+ * The workload is run first on an Octree, then on an Octree meshed into
+ * GLData chunks, then on a LinearOctree.
+ * Finally a series of cuts is meshed after every cut, and the mesh is checked
+ * vertex by vertex against one updateGL() of the same cuts, with and without
+ * chunks. The exit status is 1 if they differ.
+ *
+ * usage: cutsim_bench [max_depth] [repeats] [chunk_depth]
+ * */
+
+/// time and allocation-count for one step of the benchmark
+class Step {
+public:
+    Step(const char* n) : name(n) {
+        allocs = allocation_count();
+        timer.start();
+    }
+    void done() {
+        double t = timer.getElapsedS();
+        printf(" %-12s %10.3f ms %10lu allocs\n", name, 1e3*t, allocation_count() - allocs);
+    }
+private:
+    const char* name;
+    unsigned long allocs;
+    g2m::nanotimer timer;
+};
+
+/// the cutsim4 workload, on an Octree or a LinearOctree
+template <class Tree>
+void run(Tree* tree, cutsim::GLData* g, bool verbose, unsigned int chunk_depth = 0) {
+    cutsim::MarchingCubes* iso = new cutsim::MarchingCubes(g, tree);
+    iso->set_chunk_depth( chunk_depth );
+
+    Step s_init("init");
+    tree->init(2u);
+    s_init.done();
+
+    cutsim::SphereVolume stock;
+    stock.setRadius(7);
+    stock.setCenter( cutsim::GLVertex(0,0,0) );
+    Step s_sum("sum");
+    tree->sum(&stock);
+    s_sum.done();
+
+    stock.setCenter( cutsim::GLVertex(0,0,7) );
+    stock.setRadius( 5 );
+    Step s_diff("diff");
+    tree->diff(&stock);
+    s_diff.done();
+
+    Step s_mc("updateGL");
+    iso->updateGL();
+    g->swap();
+    s_mc.done();
+    unsigned long full_leaves = iso->remeshed_leaves();
+
+    stock.setCenter( cutsim::GLVertex(6,0,0) );
+    stock.setRadius( 2 );
+    Step s_diff2("diff2");
+    tree->diff(&stock);
+    s_diff2.done();
+
+    Step s_mc2("updateGL2");
+    iso->updateGL();
+    g->swap();
+    s_mc2.done();
+    printf(" leaves meshed: %lu by updateGL, %u by updateGL2\n", full_leaves, iso->remeshed_leaves() );
+    if ( chunk_depth )
+        printf(" chunks rebuilt: %u by updateGL2\n", iso->rebuilt_chunks() );
+    printf(" mesh: %d triangles, %d vertices\n", g->polygonCount(), g->vertexCount() );
+    if (verbose)
+        std::cout << tree->str();
+
+    Step s_del("delete");
+    delete iso;
+    delete tree;
+    delete g;
+    s_del.done();
+}
+
+/// one triangle of a mesh, the position, color and normal of each vertex, 
+/// starting at the vertex with the smallest position
+struct Triangle {
+    Triangle(const cutsim::GLVertex& p1, const cutsim::GLVertex& p2, const cutsim::GLVertex& p3) {
+        const cutsim::GLVertex* p[3] = { &p1, &p2, &p3 };
+        int first = 0;
+        for (int n=1;n<3;++n) {
+            if ( before( *p[n], *p[first] ) )
+                first = n;
+        }
+        for (int n=0;n<3;++n) {
+            const cutsim::GLVertex& q = *p[ (first+n)%3 ];
+            float values[9] = { q.x, q.y, q.z, q.r, q.g, q.b, q.nx, q.ny, q.nz };
+            std::copy( values, values+9, v+9*n );
+        }
+    }
+    /// the position of a is before that of b, in x then y then z
+    static bool before(const cutsim::GLVertex& a, const cutsim::GLVertex& b) {
+        if ( a.x != b.x ) return a.x < b.x;
+        if ( a.y != b.y ) return a.y < b.y;
+        return a.z < b.z;
+    }
+    /// compares the positions and colors only
+    bool operator<(const Triangle& t) const {
+        for (int n=0;n<27;++n) {
+            if ( n%9 < 6 && v[n] != t.v[n] )
+                return v[n] < t.v[n];
+        }
+        return false;
+    }
+    /// the same positions and colors, and normals within tolerance
+    bool same(const Triangle& t, float tolerance) const {
+        for (int n=0;n<27;++n) {
+            if ( ( n%9 < 6 ) ? ( v[n] != t.v[n] ) : ( fabs(v[n]-t.v[n]) > tolerance ) )
+                return false;
+        }
+        return true;
+    }
+    float v[27];
+};
+
+/// the triangles in the render-buffer of g, also those of the chunks, sorted
+std::vector<Triangle> triangles(const cutsim::GLData* g) {
+    std::vector<Triangle> t;
+    const cutsim::GLVertex* vertices = g->getVertexArray();
+    const GLuint* indices = g->getIndexArray();
+    for (int n=0; n+2<g->indexCount(); n+=3)
+        t.push_back( Triangle( vertices[indices[n]], vertices[indices[n+1]], vertices[indices[n+2]] ) );
+    for (unsigned int c=0; c<g->chunkCount(); ++c) {
+        vertices = g->getChunkVertexArray(c);
+        indices = g->getChunkIndexArray(c);
+        for (int n=0; n+2<g->chunkIndexCount(c); n+=3)
+            t.push_back( Triangle( vertices[indices[n]], vertices[indices[n+1]], vertices[indices[n+2]] ) );
+    }
+    std::sort( t.begin(), t.end() );
+    return t;
+}
+
+/// a row of small diffs, meshed after every diff if incremental, else once at the end
+std::vector<Triangle> cut_mesh(unsigned int max_depth, unsigned int chunk_depth, bool incremental) {
+    cutsim::GLData* g = new cutsim::GLData();
+    cutsim::GLVertex center(0,0,0);
+    cutsim::Octree* tree = new cutsim::Octree(10.0, max_depth, center, g);
+    cutsim::MarchingCubes* iso = new cutsim::MarchingCubes(g, tree);
+    iso->set_chunk_depth( chunk_depth );
+    tree->init(2u);
+    cutsim::SphereVolume stock;
+    stock.setRadius(7);
+    stock.setCenter( cutsim::GLVertex(0,0,0) );
+    tree->sum(&stock);
+    iso->updateGL();
+    g->swap();
+    stock.setRadius( 1.3 );
+    for (int n=0; n<20; ++n) {
+        stock.setCenter( cutsim::GLVertex( -5.0+0.5*n, 0.37*n-3.0, 6.2 ) );
+        tree->diff(&stock);
+        if ( incremental ) {
+            iso->updateGL();
+            g->swap();
+        }
+    }
+    iso->updateGL();
+    g->swap();
+    std::vector<Triangle> t = triangles(g);
+    delete iso;
+    delete tree;
+    delete g;
+    return t;
+}
+
+/// compare the incremental mesh of cut_mesh() to the full one, return true if they are the same
+bool check_incremental(unsigned int max_depth, unsigned int chunk_depth) {
+    std::vector<Triangle> full = cut_mesh( max_depth, chunk_depth, false );
+    std::vector<Triangle> incremental = cut_mesh( max_depth, chunk_depth, true );
+    unsigned int differ = 0;
+    std::size_t n = 0, m = 0;
+    while ( n < full.size() || m < incremental.size() ) {
+        if ( m == incremental.size() || ( n < full.size() && full[n] < incremental[m] ) ) {
+            ++differ; ++n;
+        } else if ( n == full.size() || incremental[m] < full[n] ) {
+            ++differ; ++m;
+        } else {
+            if ( !full[n].same( incremental[m], 1e-4f ) )
+                ++differ;
+            ++n; ++m;
+        }
+    }
+    printf(" incremental mesh, chunk_depth=%u: %lu triangles, %u differ from one updateGL\n", 
+           chunk_depth, (unsigned long)full.size(), differ );
+    return differ == 0;
+}
+
+int main( int argc, char **argv ) {
+    unsigned int max_depth = (argc>1) ? atoi(argv[1]) : 8;
+    int repeats = (argc>2) ? atoi(argv[2]) : 3;
+    unsigned int chunk_depth = (argc>3) ? atoi(argv[3]) : 4;
+    double octree_cube_side=10.0;
+    cutsim::GLVertex octree_center(0,0,0);
+    std::cout << "cutsim_bench max_depth=" << max_depth << " repeats=" << repeats << " chunk_depth=" << chunk_depth << "\n";
+
+    for (int r=0; r<repeats; ++r) {
+        std::cout << "run " << r << " Octree\n";
+        cutsim::GLData* g = new cutsim::GLData();
+        run( new cutsim::Octree(octree_cube_side, max_depth, octree_center, g), g, r==0 );
+    }
+    for (int r=0; r<repeats && chunk_depth>0 && chunk_depth<max_depth; ++r) {
+        std::cout << "run " << r << " Octree, chunks at depth " << chunk_depth << "\n";
+        cutsim::GLData* g = new cutsim::GLData();
+        run( new cutsim::Octree(octree_cube_side, max_depth, octree_center, g), g, false, chunk_depth );
+    }
+    for (int r=0; r<repeats; ++r) {
+        std::cout << "run " << r << " LinearOctree\n";
+        cutsim::GLData* g = new cutsim::GLData();
+        run( new cutsim::LinearOctree(octree_cube_side, max_depth, octree_center), g, r==0 );
+    }
+    std::cout << "check Octree\n";
+    bool same = check_incremental( max_depth, 0 );
+    if ( chunk_depth>0 && chunk_depth<max_depth )
+        same = check_incremental( max_depth, chunk_depth ) && same;
+    return same ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <g2m/nanotimer.hpp>
+
+#include "octree.hpp"
+#include "octnode.hpp"
+#include "volume.hpp"
+#include "gldata.hpp"
+#include "marching_cubes.hpp"
+#include "task_scheduler.hpp"
+
+/*
+ * Scaling benchmark for the parallel Octree operations.
+ * For 1, 2, ... max_threads threads: sum a sphere into a fresh tree,
+ * run marching-cubes, and then diff a row of small spheres and one large sphere.
+ * Reports the wall-time of the sum and of the diffs, and the speedup
+ * compared to one thread. The leaf count should be the same for all runs.
+ *
+ * usage: cutsim_parallel_bench [max_depth] [max_threads]
+ * */
+
+/// wall-times of one run
+struct Times {
+    double sum;
+    double diff;
+};
+
+/// run the workload with the given number of threads
+Times run(unsigned int max_depth, unsigned int threads) {
+    cutsim::GLVertex octree_center(0,0,0);
+    cutsim::GLData* g = new cutsim::GLData();
+    cutsim::Octree* tree = new cutsim::Octree(10.0, max_depth, octree_center, g);
+    cutsim::IsoSurfaceAlgorithm* iso = new cutsim::MarchingCubes(g, tree);
+    tree->init(2u);
+    tree->set_threads(threads);
+    Times t;
+    g2m::nanotimer timer;
+
+    cutsim::SphereVolume stock;
+    stock.setRadius(7);
+    stock.setCenter( cutsim::GLVertex(0,0,0) );
+    timer.start();
+    tree->sum(&stock);
+    t.sum = timer.getElapsedS();
+
+    iso->updateGL(); // so that the diffs also remove vertices
+    g->swap();
+
+    cutsim::SphereVolume cutter;
+    cutter.setRadius(2);
+    timer.start();
+    for (int n=0; n<40; ++n) {
+        cutter.setCenter( cutsim::GLVertex(-5+0.25*n, 0.1*n, 5.5) );
+        tree->diff(&cutter);
+    }
+    cutter.setRadius(5);
+    cutter.setCenter( cutsim::GLVertex(0,0,7) );
+    tree->diff(&cutter);
+    t.diff = timer.getElapsedS();
+
+    std::vector<cutsim::Octnode*> leaves;
+    tree->get_leaf_nodes(leaves);
+    printf(" %3u threads: sum %9.3f ms  diff %9.3f ms  %lu leaves\n", threads, 1e3*t.sum, 1e3*t.diff, (unsigned long)leaves.size());
+    delete iso;
+    delete tree;
+    delete g;
+    return t;
+}
+
+int main( int argc, char **argv ) {
+    unsigned int max_depth = (argc>1) ? atoi(argv[1]) : 9;
+    unsigned int max_threads = (argc>2) ? atoi(argv[2]) : cutsim::TaskScheduler(0).threads();
+    std::cout << "cutsim_parallel_bench max_depth=" << max_depth << " max_threads=" << max_threads << "\n";
+
+    std::vector<Times> times;
+    for (unsigned int threads=1; threads<=max_threads; ++threads)
+        times.push_back( run(max_depth, threads) );
+
+    std::cout << "speedup:\n";
+    for (unsigned int n=0; n<times.size(); ++n)
+        printf(" %3u threads: sum %6.2f  diff %6.2f\n", n+1, times[0].sum/times[n].sum, times[0].diff/times[n].diff);
+    return 0;
+}
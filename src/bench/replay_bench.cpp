@@ -0,0 +1,203 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include <g2m/nanotimer.hpp>
+#include <g2m/canonReader.hpp>
+
+#include "octree.hpp"
+#include "volume.hpp"
+#include "gldata.hpp"
+#include "marching_cubes.hpp"
+
+#ifndef CUTSIM_NGC_DIR
+#define CUTSIM_NGC_DIR "ngc"
+#endif
+
+/*
+ * End-to-end replay of ngc/cds.ngc, from the canon-lines rs274 produces
+ * for it (ngc/cds.canon, so that no interpreter is needed).
+ * The moves are played as GPlayer and CutsimWindow do: a tool change
+ * selects the cutter, and each motion is cut as one swept volume. As in
+ * the Cutsim pipeline, a cut is followed by flushing the removed vertices,
+ * updating the GLData in the Bbox of the move, and swapping the buffers.
+ * Meshing is into GLData chunks at depth 4, as in the application.
+ * Everything runs on the calling thread, so the result is deterministic.
+ *
+ * The program is in inches, for 4"x4"x2" stock with the top at Z=2, and
+ * is cut with a 1/4" flat end mill.
+ * Reports the time to read the canon-lines, moves/s, the total diff and
+ * mesh times, and the peak resident memory of the process.
+ *
+ * usage: cutsim_replay_bench [canon_file] [max_depth] [repeats] [threads] [json_file]
+ * */
+
+/// the result of one replay
+struct Replay {
+    /// number of moves cut
+    unsigned int moves;
+    /// time to read the canon-lines, in seconds
+    double read;
+    /// total time of the diffs
+    double diff;
+    /// total time of the GLData updates and swaps
+    double mesh;
+    /// triangles in the final mesh
+    int triangles;
+};
+
+/// cut the volume swept by cutter along the move cl
+static void cut(cutsim::Octree& tree, const cutsim::CutterVolume& cutter, g2m::canonLine* cl, cutsim::Bbox& region) {
+    g2m::Point s = cl->getStart().loc;
+    g2m::Point e = cl->getEnd().loc;
+    cutsim::GLVertex start(s.x, s.y, s.z);
+    cutsim::GLVertex end(e.x, e.y, e.z);
+    if ( cl->getMotionType() == g2m::HELICAL ) {
+        g2m::Point c = cl->getCenter();
+        g2m::Point a = cl->getAxis();
+        cutsim::GLVertex axis(a.x, a.y, a.z);
+        cutsim::HelicalMoveVolume move( cutter, start, cutsim::GLVertex(c.x, c.y, c.z), axis, 
+                                        cl->getAngle(), (end-start).dot(axis) );
+        tree.diff( &move );
+        region = move.bb;
+    } else {
+        cutsim::LinearMoveVolume move( cutter, start, end );
+        tree.diff( &move );
+        region = move.bb;
+    }
+}
+
+static Replay replay(const std::string& file, unsigned int max_depth, unsigned int threads) {
+    Replay r;
+    g2m::nanotimer timer;
+    timer.start();
+    g2m::canonReader reader;
+    if ( !reader.readCanonFile( file ) ) {
+        std::cerr << "cutsim_replay_bench: " << reader.getError() << "\n";
+        exit(1);
+    }
+    r.read = timer.getElapsedS();
+    const std::vector<g2m::canonLine*>& lines = reader.getCanonLines();
+
+    cutsim::GLData* g = new cutsim::GLData();
+    cutsim::GLVertex center(2,2,1);
+    cutsim::Octree* tree = new cutsim::Octree(3.0, max_depth, center, g);
+    tree->init(2u);
+    tree->set_threads(threads);
+    cutsim::MarchingCubes* mc = new cutsim::MarchingCubes(g, tree);
+    mc->set_chunk_depth(4);
+    g->beginDeferredRemoval();
+
+    cutsim::RectVolume stock;
+    stock.corner = cutsim::GLVertex(0,0,0);
+    stock.v1 = cutsim::GLVertex(4,0,0);
+    stock.v2 = cutsim::GLVertex(0,4,0);
+    stock.v3 = cutsim::GLVertex(0,0,2);
+    stock.calcBB();
+    tree->sum(&stock);
+    mc->updateGL();
+    g->swap();
+
+    // cds.ngc uses only tool 1
+    cutsim::CylCutterVolume cutter(0.125, 3.0);
+    r.moves = 0;
+    r.diff = 0;
+    r.mesh = 0;
+    for ( unsigned int n=0; n<lines.size(); ++n ) {
+        g2m::canonLine* cl = lines[n];
+        if ( !cl->isMotion() )
+            continue;
+        cutsim::Bbox region;
+        timer.start();
+        cut( *tree, cutter, cl, region );
+        r.diff += timer.getElapsedS();
+        timer.start();
+        g->flushDeferredRemoval();
+        mc->updateGL( region );
+        g->swap();
+        r.mesh += timer.getElapsedS();
+        r.moves++;
+    }
+    r.triangles = g->polygonCount();
+    delete mc;
+    delete tree;
+    delete g;
+    return r;
+}
+
+/// peak resident set size of the process, in kB
+static long peak_memory() {
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    return usage.ru_maxrss;
+}
+
+int main( int argc, char **argv ) {
+    std::string file = (argc>1) ? argv[1] : CUTSIM_NGC_DIR "/cds.canon";
+    unsigned int max_depth = (argc>2) ? atoi(argv[2]) : 8;
+    int repeats = (argc>3) ? atoi(argv[3]) : 3;
+    unsigned int threads = (argc>4) ? atoi(argv[4]) : 1;
+    std::string json_file = (argc>5) ? argv[5] : "";
+    std::cout << "cutsim_replay_bench " << file << " max_depth=" << max_depth << " repeats=" << repeats << " threads=" << threads << "\n";
+
+    Replay best = Replay(); // zero, in case repeats is 0
+    for (int n=0; n<repeats; ++n) {
+        Replay r = replay( file, max_depth, threads );
+        double total = r.diff + r.mesh;
+        printf(" run %d: %u moves in %8.3f ms, %8.1f moves/s, diff %8.3f ms, mesh %8.3f ms, read %6.3f ms, %d triangles\n", 
+               n, r.moves, 1e3*total, r.moves/total, 1e3*r.diff, 1e3*r.mesh, 1e3*r.read, r.triangles );
+        if ( n==0 || total < best.diff + best.mesh )
+            best = r;
+    }
+    long peak = peak_memory();
+    double total = best.diff + best.mesh;
+    printf(" best: %8.1f moves/s, diff %8.3f ms, mesh %8.3f ms, peak memory %ld kB\n", 
+           best.moves/total, 1e3*best.diff, 1e3*best.mesh, peak );
+    if ( !json_file.empty() ) {
+        FILE* out = fopen( json_file.c_str(), "w" );
+        if ( !out ) {
+            std::cerr << "cutsim_replay_bench: cannot write " << json_file << "\n";
+            return 1;
+        }
+        fprintf(out, "{\n");
+        fprintf(out, "  \"benchmark\": \"cutsim_replay_bench\",\n");
+        fprintf(out, "  \"program\": \"%s\",\n", file.c_str() );
+        fprintf(out, "  \"max_depth\": %u,\n", max_depth );
+        fprintf(out, "  \"repeats\": %d,\n", repeats );
+        fprintf(out, "  \"threads\": %u,\n", threads );
+        fprintf(out, "  \"moves\": %u,\n", best.moves );
+        fprintf(out, "  \"moves_per_s\": %.1f,\n", best.moves/total );
+        fprintf(out, "  \"read_ms\": %.4f,\n", 1e3*best.read );
+        fprintf(out, "  \"diff_ms\": %.4f,\n", 1e3*best.diff );
+        fprintf(out, "  \"mesh_ms\": %.4f,\n", 1e3*best.mesh );
+        fprintf(out, "  \"triangles\": %d,\n", best.triangles );
+        fprintf(out, "  \"peak_memory_kb\": %ld\n", peak );
+        fprintf(out, "}\n");
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,421 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <g2m/nanotimer.hpp>
+#include <g2m/canonReader.hpp>
+
+#include "octree.hpp"
+#include "volume.hpp"
+#include "gldata.hpp"
+#include "marching_cubes.hpp"
+
+#include "alloc_counter.hpp"
+
+/*
+ * Benchmark suite with machine-readable output, for tracking regressions.
+ * For each octree depth:
+ *  - octree.init, Octree::init(2)
+ *  - sum/diff/intersect with sphere and box volumes, on the cutsim4 stock
+ *  - mc.full, a full MarchingCubes::updateGL() of the stock
+ *  - mc.incremental, updateGL() of the region of a small diff
+ *  - octree.facing, a planar facing cut across the top of box stock, and 
+ *    octree.facing.adaptive the same with Octree::set_tolerance(). The items
+ *    are the number of nodes in the tree after the cut.
+ *  - octree.passes, a pocket cleared with overlapping sphere moves in several
+ *    step-downs, and octree.passes.lazy the same with Octree::set_lazy(), 
+ *    including the final Octree::flush(). The items are the number of nodes.
+ * and once:
+ *  - gldata.add, gldata.churn, gldata.remove: GLData bookkeeping of a grid of
+ *    triangles on shared vertices, where the churn removes and re-adds
+ *    random triangles, and swaps the buffers, as small cuts do
+ *  - canon.parse, canonLine::canonLineFactory() through canonReader, on
+ *    generated canon-lines
+ * Each case runs repeats times. The JSON output lists, for each case, the 
+ * minimum, median and mean time in ms, the heap allocations of the first run,
+ * and the number of items (triangles, lines) with the rate for the median time.
+ * Progress is printed to stderr.
+ *
+ * usage: cutsim_suite_bench [min_depth] [max_depth] [repeats] [threads] [json_file]
+ * */
+
+/// the timings of one case of the suite
+struct Result {
+    /// name of the case
+    std::string name;
+    /// octree depth, or 0
+    unsigned int depth;
+    /// the time of each run, in seconds
+    std::vector<double> times;
+    /// heap allocations of the first run
+    unsigned long allocs;
+    /// items processed by one run
+    unsigned long items;
+};
+
+/// the results of all cases
+class Suite {
+public:
+    /// record one run of case name
+    void add(const std::string& name, unsigned int depth, double t, unsigned long allocs, unsigned long items) {
+        for ( unsigned int n=0; n<results.size(); ++n ) {
+            if ( results[n].name == name && results[n].depth == depth ) {
+                results[n].times.push_back(t);
+                return;
+            }
+        }
+        Result r;
+        r.name = name;
+        r.depth = depth;
+        r.times.push_back(t);
+        r.allocs = allocs;
+        r.items = items;
+        results.push_back(r);
+    }
+    /// write the results as JSON
+    void write(std::ostream& o, unsigned int repeats, unsigned int threads) const {
+        o << "{\n";
+        o << "  \"benchmark\": \"cutsim_suite_bench\",\n";
+        o << "  \"repeats\": " << repeats << ",\n";
+        o << "  \"threads\": " << threads << ",\n";
+        o << "  \"results\": [\n";
+        for ( unsigned int n=0; n<results.size(); ++n ) {
+            const Result& r = results[n];
+            std::vector<double> t = r.times;
+            std::sort( t.begin(), t.end() );
+            double mean = 0;
+            for ( unsigned int m=0; m<t.size(); ++m )
+                mean += t[m];
+            mean /= t.size();
+            double median = t[ t.size()/2 ];
+            char line[512];
+            snprintf( line, sizeof(line), 
+                "    {\"name\": \"%s\", \"depth\": %u, \"runs\": %u, \"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, \"allocs\": %lu, \"items\": %lu, \"items_per_s\": %.1f}",
+                r.name.c_str(), r.depth, (unsigned int)t.size(), 1e3*t[0], 1e3*median, 1e3*mean, 
+                r.allocs, r.items, (median > 0) ? r.items/median : 0.0 );
+            o << line << ( (n+1 < results.size()) ? ",\n" : "\n" );
+        }
+        o << "  ]\n";
+        o << "}\n";
+    }
+private:
+    std::vector<Result> results;
+};
+
+/// time and allocation-count for one case
+class Step {
+public:
+    Step(Suite& s, const char* n, unsigned int d = 0) : suite(s), name(n), depth(d) {
+        allocs = allocation_count();
+        timer.start();
+    }
+    /// stop the timer and record the run, which processed count items
+    void done(unsigned long count = 0) {
+        double t = timer.getElapsedS();
+        unsigned long a = allocation_count() - allocs;
+        suite.add( name, depth, t, a, count );
+        fprintf( stderr, " %-24s depth %2u %10.3f ms\n", name, depth, 1e3*t );
+    }
+private:
+    Suite& suite;
+    const char* name;
+    unsigned int depth;
+    unsigned long allocs;
+    g2m::nanotimer timer;
+};
+
+/// an axis-aligned box volume from corner, with sides sx, sy, sz
+static cutsim::RectVolume box(const cutsim::GLVertex& corner, double sx, double sy, double sz) {
+    cutsim::RectVolume b;
+    b.corner = corner;
+    b.v1 = cutsim::GLVertex(sx,0,0);
+    b.v2 = cutsim::GLVertex(0,sy,0);
+    b.v3 = cutsim::GLVertex(0,0,sz);
+    b.calcBB();
+    return b;
+}
+
+/// the octree cases at the given depth
+static void octree_cases(Suite& suite, unsigned int depth, unsigned int threads) {
+    cutsim::GLData* g = new cutsim::GLData();
+    cutsim::GLVertex center(0,0,0);
+    cutsim::Octree* tree = new cutsim::Octree(10.0, depth, center, g);
+    cutsim::MarchingCubes* mc = new cutsim::MarchingCubes(g, tree);
+    tree->set_threads(threads);
+
+    Step s_init(suite, "octree.init", depth);
+    tree->init(2u);
+    s_init.done();
+
+    cutsim::SphereVolume sphere;
+    sphere.setCenter( cutsim::GLVertex(0,0,0) );
+    sphere.setRadius(7);
+    Step s_sum(suite, "octree.sum.sphere", depth);
+    tree->sum(&sphere);
+    s_sum.done();
+
+    cutsim::RectVolume b = box( cutsim::GLVertex(4,-2,-2), 4, 4, 4 );
+    Step s_sum_box(suite, "octree.sum.box", depth);
+    tree->sum(&b);
+    s_sum_box.done();
+
+    sphere.setCenter( cutsim::GLVertex(0,0,7) );
+    sphere.setRadius(5);
+    Step s_diff(suite, "octree.diff.sphere", depth);
+    tree->diff(&sphere);
+    s_diff.done();
+
+    b = box( cutsim::GLVertex(-3,-3,-8), 6, 6, 3 );
+    Step s_diff_box(suite, "octree.diff.box", depth);
+    tree->diff(&b);
+    s_diff_box.done();
+
+    sphere.setCenter( cutsim::GLVertex(0,0,0) );
+    sphere.setRadius(6.8);
+    Step s_int(suite, "octree.intersect.sphere", depth);
+    tree->intersect(&sphere);
+    s_int.done();
+
+    b = box( cutsim::GLVertex(-6.5,-6.5,-6.5), 13, 13, 12 );
+    Step s_int_box(suite, "octree.intersect.box", depth);
+    tree->intersect(&b);
+    s_int_box.done();
+
+    Step s_mc(suite, "mc.full", depth);
+    mc->updateGL();
+    g->swap();
+    s_mc.done( g->polygonCount() );
+
+    sphere.setCenter( cutsim::GLVertex(5,0,0) );
+    sphere.setRadius(1.5);
+    tree->diff(&sphere);
+    Step s_mc2(suite, "mc.incremental", depth);
+    cutsim::Bbox region = sphere.bb;
+    mc->updateGL(region);
+    g->swap();
+    s_mc2.done( g->polygonCount() );
+
+    delete mc;
+    delete tree;
+    delete g;
+}
+
+/// a facing cut of box stock, with the given refinement tolerance
+static void facing_case(Suite& suite, const char* name, unsigned int depth, unsigned int threads, double tolerance) {
+    cutsim::GLData* g = new cutsim::GLData();
+    cutsim::GLVertex center(0,0,0);
+    cutsim::Octree* tree = new cutsim::Octree(10.0, depth, center, g);
+    tree->set_threads(threads);
+    tree->set_tolerance(tolerance);
+    tree->init(2u);
+    cutsim::RectVolume stock = box( cutsim::GLVertex(-6,-6,-6), 12, 12, 10 );
+    tree->sum(&stock);
+
+    cutsim::RectVolume facing = box( cutsim::GLVertex(-7,-7,3.3), 14, 14, 2 );
+    Step s_facing(suite, name, depth);
+    tree->diff(&facing);
+    std::vector<cutsim::Octnode*> nodes;
+    tree->get_all_nodes( tree->root, nodes );
+    s_facing.done( nodes.size() );
+
+    delete tree;
+    delete g;
+}
+
+/// a pocket in box stock, cleared by rows of overlapping spheres at several depths
+static void passes_case(Suite& suite, const char* name, unsigned int depth, unsigned int threads, unsigned int lazy) {
+    cutsim::GLData* g = new cutsim::GLData();
+    cutsim::GLVertex center(0,0,0);
+    cutsim::Octree* tree = new cutsim::Octree(10.0, depth, center, g);
+    tree->set_threads(threads);
+    tree->set_lazy(lazy);
+    tree->init(2u);
+    cutsim::RectVolume stock = box( cutsim::GLVertex(-6,-6,-6), 12, 12, 10 );
+    tree->sum(&stock);
+
+    cutsim::SphereVolume sphere;
+    sphere.setRadius(1.0);
+    Step s_passes(suite, name, depth);
+    for (int z=0; z<5; ++z) {
+        for (int y=0; y<6; ++y) {
+            for (int x=0; x<20; ++x) {
+                sphere.setCenter( cutsim::GLVertex( -4.0+0.4*x, -2.5+y, 4.0-0.5*z ) );
+                tree->diff(&sphere);
+            }
+        }
+    }
+    tree->flush();
+    std::vector<cutsim::Octnode*> nodes;
+    tree->get_all_nodes( tree->root, nodes );
+    s_passes.done( nodes.size() );
+
+    delete tree;
+    delete g;
+}
+
+/// a grid of small holes drilled into box stock. the holes pass between the corners of the
+/// coarse nodes inside the stock, and are only found below the surface with interval set.
+static void drilling_case(Suite& suite, const char* name, unsigned int depth, unsigned int threads, bool interval) {
+    cutsim::GLData* g = new cutsim::GLData();
+    cutsim::GLVertex center(0,0,0);
+    cutsim::Octree* tree = new cutsim::Octree(10.0, depth, center, g);
+    tree->set_threads(threads);
+    tree->set_interval(interval);
+    tree->init(2u);
+    cutsim::RectVolume stock = box( cutsim::GLVertex(-6,-6,-6), 12, 12, 10 );
+    tree->sum(&stock);
+
+    cutsim::CylCutterVolume drill(0.2, 20.0);
+    Step s_drilling(suite, name, depth);
+    for (int y=0; y<5; ++y) {
+        for (int x=0; x<5; ++x) {
+            double px = -4.1+2.03*x;
+            double py = -4.3+2.11*y;
+            cutsim::LinearMoveVolume plunge( drill, cutsim::GLVertex(px, py, 5.0), cutsim::GLVertex(px, py, -3.0) );
+            tree->diff(&plunge);
+        }
+    }
+    std::vector<cutsim::Octnode*> nodes;
+    tree->get_all_nodes( tree->root, nodes );
+    s_drilling.done( nodes.size() );
+
+    delete tree;
+    delete g;
+}
+
+/// GLData add, churn and remove on an n x n grid of squares, each split into two triangles on shared vertices
+static void gldata_cases(Suite& suite, unsigned int n) {
+    cutsim::GLData* g = new cutsim::GLData();
+    g->setTriangles();
+    std::vector<GLuint> triangle(3);
+    Step s_add(suite, "gldata.add");
+    for (unsigned int i=0; i<n; ++i) {
+        for (unsigned int j=0; j<n; ++j) {
+            GLuint v[4];
+            for (unsigned int c=0; c<4; ++c) {
+                unsigned int x = i + (c&1);
+                unsigned int y = j + (c>>1);
+                v[c] = g->addSharedVertex( 1 + x + (boost::uint64_t)(n+1)*y, cutsim::GLVertex(x, y, 0, 1, 1, 1) );
+            }
+            triangle[0] = v[0]; triangle[1] = v[1]; triangle[2] = v[3];
+            g->addPolygon( triangle );
+            triangle[0] = v[0]; triangle[1] = v[3]; triangle[2] = v[2];
+            g->addPolygon( triangle );
+        }
+    }
+    g->swap();
+    s_add.done( 2*n*n );
+
+    const unsigned int cycles = 100, per_cycle = 1000;
+    Step s_churn(suite, "gldata.churn");
+    for (unsigned int c=0; c<cycles; ++c) {
+        for (unsigned int m=0; m<per_cycle; ++m)
+            g->removePolygon( rand() % g->polygonCount() );
+        for (unsigned int m=0; m<per_cycle; ++m) {
+            unsigned int x = rand() % n;
+            unsigned int y = rand() % n;
+            for (unsigned int k=0; k<3; ++k) {
+                unsigned int vx = x + (k&1);
+                unsigned int vy = y + (k>>1);
+                triangle[k] = g->addSharedVertex( 1 + vx + (boost::uint64_t)(n+1)*vy, cutsim::GLVertex(vx, vy, 0, 1, 1, 1) );
+            }
+            g->addPolygon( triangle );
+        }
+        g->swap();
+    }
+    s_churn.done( 2*cycles*per_cycle );
+
+    Step s_remove(suite, "gldata.remove");
+    unsigned int removed = 0;
+    while ( g->polygonCount() > 0 ) {
+        g->removePolygon( rand() % g->polygonCount() );
+        ++removed;
+    }
+    s_remove.done( removed );
+    delete g;
+}
+
+/// generated canon-lines: traverses, feeds, arcs and motionless commands, as rs274 writes them
+static std::string canon_program(unsigned int lines) {
+    std::ostringstream o;
+    o.setf( std::ios::fixed );
+    o.precision(4);
+    o << "    1 N..... CHANGE_TOOL(1)\n";
+    for (unsigned int n=2; n<=lines; ++n) {
+        double x = (n%200)*0.05 - 5.0;
+        double y = ((n/200)%200)*0.05 - 5.0;
+        o << "    " << n << " N" << n*10 << "  ";
+        switch (n%4) {
+            case 0: o << "STRAIGHT_TRAVERSE(" << x << ", " << y << ", 2.0000, 0.0000, 0.0000, 0.0000)\n"; break;
+            case 1: o << "STRAIGHT_FEED(" << x << ", " << y << ", -1.0000, 0.0000, 0.0000, 0.0000)\n"; break;
+            case 2: o << "ARC_FEED(" << x+0.5 << ", " << y << ", " << x+0.25 << ", " << y << ", 1, -1.0000, 0.0000, 0.0000, 0.0000)\n"; break;
+            default: o << "SET_FEED_RATE(" << 100.0+n%50 << ")\n";
+        }
+    }
+    return o.str();
+}
+
+int main( int argc, char **argv ) {
+    unsigned int min_depth = (argc>1) ? atoi(argv[1]) : 6;
+    unsigned int max_depth = (argc>2) ? atoi(argv[2]) : 10;
+    unsigned int repeats = (argc>3) ? atoi(argv[3]) : 3;
+    unsigned int threads = (argc>4) ? atoi(argv[4]) : 1;
+    std::string json_file = (argc>5) ? argv[5] : "";
+    fprintf( stderr, "cutsim_suite_bench depths %u-%u repeats=%u threads=%u\n", min_depth, max_depth, repeats, threads );
+
+    Suite suite;
+    srand(1);
+    for (unsigned int r=0; r<repeats; ++r) {
+        fprintf( stderr, "run %u\n", r );
+        for (unsigned int depth=min_depth; depth<=max_depth; ++depth) {
+            octree_cases( suite, depth, threads );
+            facing_case( suite, "octree.facing", depth, threads, 0.0 );
+            facing_case( suite, "octree.facing.adaptive", depth, threads, 1e-3 );
+            passes_case( suite, "octree.passes", depth, threads, 0 );
+            passes_case( suite, "octree.passes.lazy", depth, threads, 32 );
+            drilling_case( suite, "octree.drilling", depth, threads, false );
+            drilling_case( suite, "octree.drilling.interval", depth, threads, true );
+        }
+        gldata_cases( suite, 200 );
+        
+        const unsigned int lines = 100000;
+        std::istringstream program( canon_program(lines) );
+        g2m::canonReader reader;
+        Step s_parse(suite, "canon.parse");
+        reader.readCanon( program );
+        s_parse.done( reader.getCanonLines().size() );
+    }
+
+    if ( json_file.empty() ) {
+        suite.write( std::cout, repeats, threads );
+    } else {
+        std::ofstream out( json_file.c_str() );
+        suite.write( out, repeats, threads );
+    }
+    return 0;
+}
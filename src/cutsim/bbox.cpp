@@ -18,6 +18,8 @@
 */
 
 #include <cassert>
+#include <cmath>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 
@@ -105,6 +107,20 @@ bool Bbox::overlaps(const Bbox& b) const {
         return true;
 }
 
+double Bbox::distance(const GLVertex& p) const {
+    double dx = std::max( 0.0, std::max( (double)minpt.x - p.x, (double)p.x - maxpt.x ) );
+    double dy = std::max( 0.0, std::max( (double)minpt.y - p.y, (double)p.y - maxpt.y ) );
+    double dz = std::max( 0.0, std::max( (double)minpt.z - p.z, (double)p.z - maxpt.z ) );
+    return sqrt( dx*dx + dy*dy + dz*dz );
+}
+
+double Bbox::distance(const Bbox& b) const {
+    double dx = std::max( 0.0, std::max( (double)minpt.x - b.maxpt.x, (double)b.minpt.x - maxpt.x ) );
+    double dy = std::max( 0.0, std::max( (double)minpt.y - b.maxpt.y, (double)b.minpt.y - maxpt.y ) );
+    double dz = std::max( 0.0, std::max( (double)minpt.z - b.maxpt.z, (double)b.minpt.z - maxpt.z ) );
+    return sqrt( dx*dx + dy*dy + dz*dz );
+}
+
 // return the bounding box values as a vector:
 //  0    1    2    3    4    5
 // [minx maxx miny maxy minz maxz]
@@ -42,6 +42,10 @@ class Bbox {
         bool isInside(GLVertex& p) const;
         /// return true if *this overlaps Bbox b
         bool overlaps(const Bbox& other) const;
+        /// distance from p to the closest point of this Bbox, zero if p is inside
+        double distance(const GLVertex& p) const;
+        /// distance between the closest points of this Bbox and other, zero if they overlap
+        double distance(const Bbox& other) const;
         /// reset the Bbox (sets initialized=false)
         void clear();
         /// Add a Point to the Bbox.
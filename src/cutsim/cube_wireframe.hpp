@@ -77,8 +77,8 @@ protected:
                 ) {
                 for (unsigned int i=0; i <12 ; i++ ) {
                     std::vector< unsigned int > lineSeg;
-                    GLVertex p1 = *(node->vertex)[ segTable[i][0 ] ];
-                    GLVertex p2 = *(node->vertex)[ segTable[i][1 ] ];
+                    GLVertex p1 = node->corner( segTable[i][0 ] );
+                    GLVertex p2 = node->corner( segTable[i][1 ] );
                     Color line_color;
                     if (node->is_outside()) {
                         line_color = outside_color;
@@ -104,8 +104,8 @@ protected:
             // current node done, now recurse into tree.
             if ( node->childcount == 8 ) {
                 for (unsigned int m=0;m<8;m++) {
-                    //if ( !node->child[m]->valid() )
-                        updateGL( node->child[m] );
+                    //if ( !node->child(m)->valid() )
+                        updateGL( node->child(m) );
                 }
             }
         }
@@ -17,59 +17,237 @@
  *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/foreach.hpp>
+
 #include "cutsim.hpp"
+#include "instrumentation.hpp"
 
 namespace cutsim {
 
-Cutsim::Cutsim (double octree_size, unsigned int octree_max_depth, GLData* gld): g(gld) {
+static Stage update_gl_stage("cutsim.update_gl");
+static Stage sum_stage("cutsim.sum");
+static Stage diff_stage("cutsim.diff");
+static Stage intersect_stage("cutsim.intersect");
+static Stage cutting_stage("cutsim.cut");
+static Stage meshing_stage("cutsim.mesh");
+
+void CutTask::run() {
+    cutsim->cut_stage();
+}
+
+void MeshTask::run() {
+    cutsim->mesh_stage();
+}
+
+Cutsim::Cutsim (double octree_size, unsigned int octree_max_depth, GLData* gld, StockBackend backend): g(gld) {
     GLVertex octree_center(0,0,0);
-    tree = new Octree(octree_size, octree_max_depth, octree_center, g );
-    std::cout << "Cutsim() ctor: tree before init: " << tree->str() << "\n";
-    tree->init(2u);
-    tree->debug=false;
-    std::cout << "Cutsim() ctor: tree after init: " << tree->str() << "\n";
-    
-    iso_algo = new MarchingCubes(g, tree);
-    //iso_algo = new CubeWireFrame(g, tree);    
+    tree = NULL;
+    linear_tree = NULL;
+    if ( backend == LINEAR_OCTREE ) {
+        linear_tree = new LinearOctree(octree_size, octree_max_depth, octree_center );
+        linear_tree->init(2u);
+        std::cout << "Cutsim() ctor: tree after init: " << linear_tree->str() << "\n";
+        iso_algo = new MarchingCubes(g, linear_tree);
+    } else {
+        tree = new Octree(octree_size, octree_max_depth, octree_center, g );
+        std::cout << "Cutsim() ctor: tree before init: " << tree->str() << "\n";
+        tree->init(2u);
+        tree->set_threads(0); // one thread per core
+        tree->debug=false;
+        std::cout << "Cutsim() ctor: tree after init: " << tree->str() << "\n";
+        
+        iso_algo = new MarchingCubes(g, tree);
+        //iso_algo = new CubeWireFrame(g, tree);    
+    }
+    // vertices of nodes deleted by an operation are removed when the GLData is updated,
+    // so that operations can run while the meshing stage works on the GLData
+    g->beginDeferredRemoval();
+    max_operations = 16;
+    cutting = false;
+    meshing = false;
+    pipeline.setMaxThreadCount(2); // one thread for each stage
 } 
 
 Cutsim::~Cutsim() {
+    wait();
     delete iso_algo;
     delete tree;
+    delete linear_tree;
     delete g;
 }
 
 void Cutsim::updateGL() {
-    std::clock_t start, stop;
-    start = std::clock();
+    CUTSIM_TIMER( update_gl_stage );
+    meshMutex.lock();
+    treeMutex.lock();
+    g->flushDeferredRemoval();
     iso_algo->updateGL();
+    treeMutex.unlock();
     g->swap();
-    stop = std::clock();
-    std::cout << "cutsim.cpp updateGL() : " << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
+    meshMutex.unlock();
+}
+
+void Cutsim::set_chunk_depth( unsigned int depth ) {
+    if ( !tree )
+        return;
+    QMutexLocker locker( &meshMutex );
+    static_cast<MarchingCubes*>( iso_algo )->set_chunk_depth( depth );
 }
 
 void Cutsim::sum_volume( const Volume* volume ) {
-    std::clock_t start, stop;
-    start = std::clock();
-    tree->sum( volume );
-    stop = std::clock();
-    std::cout << "cutsim.cpp sum_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
+    CUTSIM_TIMER( sum_stage );
+    treeMutex.lock();
+    apply( SUM, volume );
+    treeMutex.unlock();
 }
 
 void Cutsim::diff_volume( const Volume* volume ) {
-    std::clock_t start, stop;
-    start = std::clock();
-    tree->diff( volume );
-    stop = std::clock();
-    std::cout << "cutsim.cpp diff_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
+    CUTSIM_TIMER( diff_stage );
+    treeMutex.lock();
+    apply( DIFF, volume );
+    treeMutex.unlock();
+}
+
+void Cutsim::diff_volumes( const std::vector<const Volume*>& volumes ) {
+    CUTSIM_TIMER( diff_stage );
+    UnionVolume all;
+    BOOST_FOREACH( const Volume* volume, volumes ) {
+        all.add( volume );
+    }
+    treeMutex.lock();
+    apply( DIFF, &all );
+    treeMutex.unlock();
 }
 
 void Cutsim::intersect_volume( const Volume* volume ) {
-    std::clock_t start, stop;
-    start = std::clock();
-    tree->intersect( volume );
-    stop = std::clock();
-    std::cout << "cutsim.cpp intersect_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
+    CUTSIM_TIMER( intersect_stage );
+    treeMutex.lock();
+    apply( INTERSECT, volume );
+    treeMutex.unlock();
+}
+
+void Cutsim::apply( Operation op, const Volume* volume ) {
+    switch (op) {
+        case SUM:
+            if (tree) tree->sum( volume );
+            else linear_tree->sum( volume );
+            break;
+        case DIFF:
+            if (tree) tree->diff( volume );
+            else linear_tree->diff( volume );
+            break;
+        case INTERSECT:
+            if (tree) tree->intersect( volume );
+            else linear_tree->intersect( volume );
+            break;
+    }
+}
+
+void Cutsim::queue( Operation op, const Volume* volume ) {
+    QueuedOperation q;
+    q.op = op;
+    q.vol = volume->clone(); // the caller may move its Volume before we cut with it
+    QMutexLocker locker( &pipelineMutex );
+    while ( operations.size() >= max_operations )
+        queueNotFull.wait( &pipelineMutex );
+    operations.push_back( q );
+    if ( !cutting ) {
+        cutting = true;
+        pipeline.start( new CutTask(this) );
+    }
+}
+
+bool Cutsim::queue_full() {
+    QMutexLocker locker( &pipelineMutex );
+    return operations.size() >= max_operations;
+}
+
+void Cutsim::wait() {
+    QMutexLocker locker( &pipelineMutex );
+    while ( cutting || meshing )
+        idle.wait( &pipelineMutex );
+}
+
+void Cutsim::cut_stage() {
+    for (;;) {
+        pipelineMutex.lock();
+        if ( operations.empty() ) {
+            cutting = false;
+            idle.wakeAll();
+            pipelineMutex.unlock();
+            return;
+        }
+        QueuedOperation q = operations.front();
+        operations.pop_front();
+        if ( q.op == DIFF && !operations.empty() && operations.front().op == DIFF ) {
+            // diff all the queued moves in one traversal of the tree
+            UnionVolume* all = new UnionVolume();
+            all->add( q.vol );
+            delete q.vol;
+            while ( !operations.empty() && operations.front().op == DIFF ) {
+                all->add( operations.front().vol );
+                delete operations.front().vol;
+                operations.pop_front();
+            }
+            q.vol = all;
+        }
+        queueNotFull.wakeAll();
+        pipelineMutex.unlock();
+        
+        treeMutex.lock();
+        {
+            CUTSIM_TIMER( cutting_stage );
+            apply( q.op, q.vol );
+        }
+        treeMutex.unlock();
+        
+        // only nodes inside the Volume change, except that intersect changes all nodes outside it
+        Bbox region = q.vol->bb;
+        if ( q.op == INTERSECT && tree )
+            region = tree->root->bb();
+        delete q.vol;
+        
+        pipelineMutex.lock();
+        dirty.push_back( region );
+        if ( !meshing ) {
+            meshing = true;
+            pipeline.start( new MeshTask(this) );
+        }
+        pipelineMutex.unlock();
+        emit signalDiffDone();
+    }
+}
+
+void Cutsim::mesh_stage() {
+    for (;;) {
+        std::vector<Bbox> regions;
+        pipelineMutex.lock();
+        if ( dirty.empty() ) {
+            meshing = false;
+            idle.wakeAll();
+            pipelineMutex.unlock();
+            return;
+        }
+        regions.swap( dirty ); // operations cut from now on go to the next round
+        pipelineMutex.unlock();
+        
+        mesh( regions );
+        emit signalGLDone();
+    }
+}
+
+void Cutsim::mesh( const std::vector<Bbox>& regions ) {
+    CUTSIM_TIMER( meshing_stage );
+    meshMutex.lock();
+    BOOST_FOREACH( const Bbox& region, regions ) {
+        // the cutting stage may run the next operation between two regions
+        treeMutex.lock();
+        g->flushDeferredRemoval();
+        iso_algo->updateGL( region );
+        treeMutex.unlock();
+    }
+    g->swap();
+    meshMutex.unlock();
 }
 
 } // end namespace
@@ -22,18 +22,21 @@
 
 #include <QObject>
 #include <QRunnable>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
 
 #include <string>
 #include <iostream>
 #include <cmath>
 #include <vector>
-#include <ctime>
+#include <deque>
 
 #include <boost/bind.hpp>
-#include <boost/timer.hpp>
 
 #include "octree.hpp"
 #include "octnode.hpp"
+#include "linear_octree.hpp"
 #include "volume.hpp"
 #include "marching_cubes.hpp"
 #include "cube_wireframe.hpp"
@@ -42,123 +45,144 @@
 
 namespace cutsim {
 
-/// Task to diff a volume from the tree
-class DiffTask : public QObject, public QRunnable  {
-    Q_OBJECT
+class Cutsim;
+
+/// the cutting stage of the Cutsim pipeline, runs the queued Volume operations
+class CutTask : public QRunnable {
 public:
-    /// create task for cutting Volume from Octree which is drawn with GLData
-    DiffTask(Octree* t, GLData* g, const Volume* v) : tree(t), gld(g), vol(v) {
-    }
-    /// run the task
-    void run() {
-        qDebug() << "DiffTask thread" << QThread::currentThread();
-        std::clock_t start, stop;
-        start = std::clock();
-        tree->diff( vol );
-        stop = std::clock();
-        qDebug() << "   " << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) ;
-        qDebug() << "DiffTask thread DONE " << QThread::currentThread();
-        emit signalDone();
-    }
-signals:
-    /// emitted when the task is done
-    void signalDone();
+    /// create the task for given Cutsim
+    CutTask(Cutsim* c) : cutsim(c) {}
+    /// run the stage until the queue is empty
+    void run();
 private:
-    Octree* tree;
-    GLData* gld;
-    const Volume* vol;
+    Cutsim* cutsim;
 };
 
-/// task for updating GLData of an Octree
-class UpdateGLTask : public QObject, public QRunnable  {
-    Q_OBJECT
+/// the meshing stage of the Cutsim pipeline, updates GLData in the dirty regions
+class MeshTask : public QRunnable {
 public:
-    /// Create task for updating GLData based on given Octree. Use the given IsoSurfaceAlgorithm for the update
-    UpdateGLTask(Octree* t, GLData* g, IsoSurfaceAlgorithm* ia) : 
-        tree(t), gld(g), iso_algo(ia) {
-    }
-    /// run the task
-    void run() {
-        qDebug() << "UpdateGLTask thread" << QThread::currentThread();
-        std::clock_t start, stop;
-        start = std::clock();
-        iso_algo->updateGL();
-        gld->swap();
-        stop = std::clock();
-        qDebug() << "   " << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) ;
-        //std::cout << "cutsim.cpp updateGL() : " << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
-        emit signalDone();
-    }
-signals:
-    /// emitted when current move done
-    void signalDone();
+    /// create the task for given Cutsim
+    MeshTask(Cutsim* c) : cutsim(c) {}
+    /// run the stage until there are no dirty regions
+    void run();
 private:
-    Octree* tree;
-    GLData* gld;
-    IsoSurfaceAlgorithm* iso_algo;
-}; 
+    Cutsim* cutsim;
+};
 
 /// a Cutsim stores an Octree stock model, uses an iso-surface extraction
 /// algorithm to generate surface triangles, and communicates with
 /// the corresponding GLData surface which is used by GLWidget for rendering
+///
+/// Volume operations can also run in a two-stage pipeline on worker threads.
+/// queue_*() puts a copy of the Volume into a bounded queue. The cutting stage
+/// applies the operations to the stock, and adds the bounding-box
+/// of each to a list of dirty regions. Consecutive queued diffs are applied 
+/// together as one UnionVolume. The meshing stage takes the dirty regions,
+/// updates the GLData in them, and swaps the GLData buffers.
+/// The stages take turns on the stock: each operation, and the meshing of each region,
+/// holds treeMutex. Vertices of nodes deleted by the cutting stage are only queued
+/// in the GLData, and removed by the meshing stage, so the cutting stage never writes to GLData.
 class Cutsim : public QObject {
     Q_OBJECT
 public:
+    /// the data structure used for the stock model
+    enum StockBackend { 
+        POINTER_OCTREE, ///< Octree, with parent/child pointers
+        LINEAR_OCTREE   ///< LinearOctree, a flat array of leaves sorted by Morton code
+    };
     /// create a cutting simulation
     /// \param octree_size side length of the depth=0 octree cube
     /// \param octree_max_depth maximum sub-division depth of the octree
     /// \param gld the GLData used to draw this tree
-    Cutsim(double octree_size, unsigned int octree_max_depth, GLData* gld);
+    /// \param backend the data structure for the stock model
+    Cutsim(double octree_size, unsigned int octree_max_depth, GLData* gld, StockBackend backend = POINTER_OCTREE);
     virtual ~Cutsim();
     /// subtract/diff given Volume
     void diff_volume( const Volume* vol );
+    /// subtract/diff all the given Volumes, with one traversal of the tree
+    void diff_volumes( const std::vector<const Volume*>& vols );
     /// sum/union given Volume
     void sum_volume( const Volume* vol );
     /// intersect/"and" given Volume
     void intersect_volume( const Volume* vol );
     /// update the GL-data
     void updateGL(); 
+    /// mesh the Octree stock into one GLData chunk for each region at the given depth, 
+    /// or into one vertex array for depth 0. call this before the first updateGL().
+    void set_chunk_depth( unsigned int depth );
+    /// the LinearOctree stock model, or NULL if a pointer Octree is used
+    const LinearOctree* linear_octree() const { return linear_tree; }
+    
+// the pipeline
+    /// queue a diff with vol for the cutting stage. vol is copied, so it may be changed after this call.
+    /// blocks while the queue is full.
+    void queue_diff_volume( const Volume* vol ) { queue( DIFF, vol ); }
+    /// queue a sum with vol for the cutting stage
+    void queue_sum_volume( const Volume* vol ) { queue( SUM, vol ); }
+    /// queue an intersect with vol for the cutting stage
+    void queue_intersect_volume( const Volume* vol ) { queue( INTERSECT, vol ); }
+    /// true if the next queue_*() call would block
+    bool queue_full();
+    /// block until all queued operations are cut and meshed
+    void wait();
+    /// set the number of operations the queue holds
+    void set_max_queued( unsigned int n ) { 
+        QMutexLocker locker( &pipelineMutex );
+        max_operations = (n>0) ? n : 1; 
+    }
 signals:
-    /// emitted when diff is done
+    /// emitted by the cutting stage when a queued operation is done
     void signalDiffDone();
-    /// emitted when GL update is done
+    /// emitted by the meshing stage when the GLData has been updated and swapped
     void signalGLDone();
 public slots:
-    /// call to signal that diff-task is done
-    void slotDiffDone() {
-        qDebug() << " Cutsim::slotDiffDone() ";
-        emit signalDiffDone();
-    }
-    /// call to signal that gl-task is done
-    void slotGLDone() {
-        emit signalGLDone();
-    }
     /// diff the given Volume from the stock
     void slot_diff_volume( const Volume* vol) { diff_volume(vol);}
-    /// multithreaded diff (FIXME: broken)
-    void slot_diff_volume_mt( const Volume* vol) { 
-        DiffTask* dt = new DiffTask(tree, g, vol);
-        connect( dt, SIGNAL( signalDone() ), this, SLOT( slotDiffDone() ) );
-        QThreadPool::globalInstance()->start(dt);
-        
-        //QThreadPool::globalInstance()->waitForDone();
-    }
-    /// multithreaded GL-update (broken...)
-    void update_gl_mt( ) { 
-        UpdateGLTask* ua = new UpdateGLTask(tree, g, iso_algo);
-        connect( ua, SIGNAL( signalDone() ), this, SLOT( slotGLDone() ) );
-        QThreadPool::globalInstance()->start(ua);
-        
-        //QThreadPool::globalInstance()->waitForDone();
-    }
+    /// queue a diff with the given Volume for the pipeline
+    void slot_diff_volume_mt( const Volume* vol) { queue_diff_volume(vol); }
     /// sum given Volume to tree
     void slot_sum_volume( const Volume* vol)  { sum_volume(vol);} 
     /// intersect three with volume
     void slot_int_volume( const Volume* vol)  { intersect_volume(vol);}
+protected:
+    friend class CutTask;
+    friend class MeshTask;
+    /// the Volume operations
+    enum Operation { SUM, DIFF, INTERSECT };
+    /// a queued operation, with a copy of the Volume
+    struct QueuedOperation {
+        /// the operation
+        Operation op;
+        /// the Volume, owned by the queue
+        Volume* vol;
+    };
+    /// copy vol into the queue, and start the cutting stage if it is idle
+    void queue( Operation op, const Volume* vol );
+    /// apply op with vol to the stock. the caller holds treeMutex.
+    void apply( Operation op, const Volume* vol );
+    /// run by CutTask
+    void cut_stage();
+    /// run by MeshTask
+    void mesh_stage();
+    /// update and swap the GLData for the given dirty regions
+    void mesh( const std::vector<Bbox>& regions );
 private:
     IsoSurfaceAlgorithm* iso_algo; // the isosurface-extraction algorithm to use
     Octree* tree; // this is the stock model
+    LinearOctree* linear_tree; // or this, with the LINEAR_OCTREE backend
     GLData* g; // this is the graphics object drawn on the screen, representing the stock
+    
+    std::deque<QueuedOperation> operations; // operations waiting for the cutting stage
+    unsigned int max_operations; // the size of the queue
+    std::vector<Bbox> dirty; // regions changed by the cutting stage, waiting for the meshing stage
+    bool cutting; // a CutTask is running
+    bool meshing; // a MeshTask is running
+    QMutex pipelineMutex; // protects operations, dirty, cutting, and meshing
+    QWaitCondition queueNotFull; // woken when the cutting stage takes an operation
+    QWaitCondition idle; // woken when a stage stops
+    QMutex treeMutex; // held while the stock, or the vertices of its nodes, are read or written
+    QMutex meshMutex; // held while the GLData work-buffer is updated and swapped
+    QThreadPool pipeline; // runs the CutTask and the MeshTask
 };
 
 } // end namespace
@@ -0,0 +1,160 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <sstream>
+
+#include <boost/foreach.hpp>
+
+#include "distance_cache.hpp"
+#include "morton.hpp"
+#include "volume.hpp"
+#include "instrumentation.hpp"
+
+namespace cutsim {
+
+static Counter lookup_counter("distance_cache.lookups");
+static Counter dist_counter("volume.dist");
+
+DistanceCache::DistanceCache(std::size_t slots) {
+    // slot() masks the key, so the table size is rounded up to a power of two
+    std::size_t size = 1;
+    while ( size < slots )
+        size *= 2;
+    Entry empty = { empty_key, 0.0 };
+    table.resize(size, empty);
+    mask = table.size()-1;
+    inv_unit = 1.0;
+    enabled = false;
+    n_lookups = 0;
+    n_evaluations = 0;
+}
+
+void DistanceCache::set_lattice(const GLVertex& lattice_origin, double unit, unsigned int levels) {
+    origin = lattice_origin;
+    inv_unit = 1.0/unit;
+    enabled = ( levels <= 20 ); // coordinates 0..2^levels must fit in 21 bits
+    clear();
+}
+
+void DistanceCache::clear() {
+    BOOST_FOREACH( std::size_t idx, used ) {
+        table[idx].key = empty_key;
+    }
+    used.clear();
+}
+
+std::size_t DistanceCache::slot(boost::uint64_t key) const {
+    // the low bits of the Morton code, samples close in space end up close in the table
+    return (std::size_t)( key & mask );
+}
+
+boost::uint64_t DistanceCache::key(const GLVertex& p) const {
+    // p is inside the root node, so the lattice coordinates are positive and truncation rounds
+    return morton_encode( (boost::uint32_t)( (p.x-origin.x)*inv_unit + 0.5 ),
+                          (boost::uint32_t)( (p.y-origin.y)*inv_unit + 0.5 ),
+                          (boost::uint32_t)( (p.z-origin.z)*inv_unit + 0.5 ) );
+}
+
+void DistanceCache::dist(const Volume* vol, const GLVertex* p, const boost::uint64_t* keys, double* d, unsigned int n) {
+    if ( batch_x.size() < n ) {
+        batch_x.resize(n);
+        batch_y.resize(n);
+        batch_z.resize(n);
+        batch_d.resize(n);
+        batch_key.resize(n);
+        batch_idx.resize(n);
+    }
+    CUTSIM_COUNT( lookup_counter, n );
+    unsigned int m = 0; // number of points to evaluate
+    for (unsigned int i=0; i<n; ++i) {
+        ++n_lookups;
+        boost::uint64_t k = 0;
+        if (enabled) {
+            k = keys ? keys[i] : key( p[i] );
+            std::size_t idx = slot(k);
+            while ( table[idx].key != empty_key && table[idx].key != k )
+                idx = (idx+1) & mask; // linear probing
+            if ( table[idx].key == k ) {
+                d[i] = table[idx].value;
+                continue;
+            }
+        }
+        batch_x[m] = p[i].x;
+        batch_y[m] = p[i].y;
+        batch_z[m] = p[i].z;
+        batch_key[m] = k;
+        batch_idx[m] = i;
+        ++m;
+    }
+    if ( m == 0 )
+        return;
+    vol->distances( &batch_x[0], &batch_y[0], &batch_z[0], &batch_d[0], m );
+    n_evaluations += m;
+    CUTSIM_COUNT( dist_counter, m );
+    for (unsigned int j=0; j<m; ++j) {
+        d[ batch_idx[j] ] = batch_d[j];
+        if (enabled)
+            insert( batch_key[j], batch_d[j] );
+    }
+}
+
+void DistanceCache::insert(boost::uint64_t k, double value) {
+    std::size_t idx = slot(k);
+    while ( table[idx].key != empty_key ) {
+        if ( table[idx].key == k ) { // the same point twice in one batch
+            table[idx].value = value;
+            return;
+        }
+        idx = (idx+1) & mask;
+    }
+    table[idx].key = k;
+    table[idx].value = value;
+    used.push_back(idx);
+    if ( 2*used.size() > table.size() ) // keep load-factor below 1/2
+        grow();
+}
+
+void DistanceCache::grow() {
+    std::vector<Entry> old;
+    old.swap(table);
+    Entry empty = { empty_key, 0.0 };
+    table.resize( 2*old.size(), empty );
+    mask = table.size()-1;
+    used.clear();
+    BOOST_FOREACH( const Entry& e, old ) {
+        if ( e.key != empty_key ) {
+            std::size_t idx = slot( e.key );
+            while ( table[idx].key != empty_key )
+                idx = (idx+1) & mask;
+            table[idx] = e;
+            used.push_back(idx);
+        }
+    }
+}
+
+std::string DistanceCache::str() const {
+    std::ostringstream o;
+    o << " DistanceCache: " << n_lookups << " lookups, " << n_evaluations << " dist() evaluations, "
+      << table.size() << " slots\n";
+    return o.str();
+}
+
+} // end namespace
+// end of file distance_cache.cpp
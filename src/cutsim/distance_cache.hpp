@@ -0,0 +1,120 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISTANCE_CACHE_H
+#define DISTANCE_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "glvertex.hpp"
+
+namespace cutsim {
+
+class Volume;
+
+/// \class DistanceCache
+/// per-operation store of Volume::dist() samples at octree corner vertices.
+///
+/// the corners of all Octnodes lie on a regular lattice with spacing equal to
+/// the half-side of the smallest node. Neighbouring nodes, and a node and its
+/// children, share corners. During one sum/diff/intersect operation the
+/// distance at each lattice point only needs to be evaluated once, so the
+/// samples are stored in an open-addressing hash table keyed by the Morton
+/// code of the integer lattice coordinates.
+///
+/// clear() is called at the start of each Volume operation. It only resets
+/// the slots that were filled during the previous operation.
+///
+/// points are looked up in batches, and all points not found in the table are
+/// evaluated with one call to Volume::distances().
+class DistanceCache {
+public:
+    /// an empty cache with the given initial number of slots, it grows as samples are added.
+    /// the number of slots is rounded up to a power of two.
+    DistanceCache(std::size_t slots = 4096);
+    /// set the lattice: origin is the minimum corner of the root node,
+    /// unit the lattice spacing, and 2^levels the number of lattice cells per axis.
+    void set_lattice(const GLVertex& origin, double unit, unsigned int levels);
+    /// forget all samples, call this before each new Volume operation
+    void clear();
+    /// put vol->dist(p[i]) in d[i] for the n points p, evaluating only the points not sampled since clear().
+    /// keys[i] is the Morton code of the lattice coordinates of p[i], if keys is NULL the codes are computed from p.
+    void dist(const Volume* vol, const GLVertex* p, const boost::uint64_t* keys, double* d, unsigned int n);
+    /// false if the lattice is too fine for Morton keys
+    bool is_enabled() const { return enabled; }
+    /// number of dist() lookups since creation
+    unsigned long lookups() const { return n_lookups; }
+    /// number of Volume::dist() evaluations since creation
+    unsigned long evaluations() const { return n_evaluations; }
+    /// string output
+    std::string str() const;
+protected:
+    /// one sample in the hash table
+    struct Entry {
+        /// Morton code of the lattice point, or empty_key
+        boost::uint64_t key;
+        /// the cached distance
+        double value;
+    };
+    /// marks an unused slot. Morton codes use at most 63 bits so this never is a valid key.
+    static const boost::uint64_t empty_key = ~0ULL;
+    /// the Morton code of the lattice point nearest to p
+    boost::uint64_t key(const GLVertex& p) const;
+    /// store a sample
+    void insert(boost::uint64_t key, double value);
+    /// double the table size, re-inserting all samples
+    void grow();
+    /// index of the slot for key in the table
+    std::size_t slot(boost::uint64_t key) const;
+    /// the hash table, size is a power of two
+    std::vector<Entry> table;
+    /// table.size()-1
+    std::size_t mask;
+    /// the slots filled since clear()
+    std::vector<std::size_t> used;
+    /// x-coordinates of the points to evaluate in one batch
+    std::vector<GLfloat> batch_x;
+    /// y-coordinates of the points to evaluate in one batch
+    std::vector<GLfloat> batch_y;
+    /// z-coordinates of the points to evaluate in one batch
+    std::vector<GLfloat> batch_z;
+    /// distances of the points in the batch
+    std::vector<double> batch_d;
+    /// keys of the points in the batch
+    std::vector<boost::uint64_t> batch_key;
+    /// index into the output array of the points in the batch
+    std::vector<unsigned int> batch_idx;
+    /// the minimum corner of the lattice
+    GLVertex origin;
+    /// 1/(lattice spacing)
+    double inv_unit;
+    /// false if the lattice is too fine for a 64-bit Morton code, then dist() is not cached
+    bool enabled;
+    /// statistics
+    unsigned long n_lookups;
+    /// statistics
+    unsigned long n_evaluations;
+};
+
+} // end namespace
+#endif
+// end file distance_cache.hpp
@@ -19,20 +19,25 @@
 
 #include <iostream>
 #include <cassert>
-#include <set>
 #include <vector>
-
-#include <QtDebug>
+#include <algorithm>
+#include <functional>
 
 #include "gldata.hpp"
 #include "octnode.hpp"
+#include "instrumentation.hpp"
 
 namespace cutsim {
 
+static Stage swap_stage("gldata.swap");
+
 GLData::GLData() {
     // some reasonable defaults...
     renderIndex = 0;
     workIndex = 1;
+    deferRemoval = 0;
+    chunkVertices = 0;
+    chunkPolygons = 0;
     
     glp[workIndex].type = GL_TRIANGLES;
     glp[workIndex].polyVerts = 3;
@@ -42,6 +47,18 @@ GLData::GLData() {
     swap(); // to intialize glp etc.. (?)
 }
 
+GLData::~GLData() {
+    BOOST_FOREACH( GLChunk* c, chunks ) {
+        delete c;
+    }
+}
+
+void GLData::swap() {
+    CUTSIM_TIMER( swap_stage );
+    swapBuffers();
+    copyBuffers();
+}
+
 /// add a vertex with given position and color, return its index
 unsigned int GLData::addVertex(float x, float y, float z, float r, float g, float b) {
     return addVertex( GLVertex(x,y,z,r,g,b), NULL );
@@ -51,9 +68,13 @@ unsigned int GLData::addVertex(float x, float y, float z, float r, float g, floa
 unsigned int GLData::addVertex(GLVertex v, Octnode* n) {
     // add vertex with empty polygon-list.
     unsigned int idx = vertexArray[workIndex].size();
-    vertexArray[workIndex].append(v);
-    vertexDataArray.append( VertexData() );
+    vertexArray[workIndex].push_back(v);
+    markVertex( idx );
+    vertexDataArray.push_back( VertexData() );
     vertexDataArray[idx].node = n;
+    vertexDataArray[idx].key = 0;
+    vertexDataArray[idx].nextShared = VertexMap::NOT_FOUND;
+    vertexDataArray[idx].normal_dirty = false;
     assert( vertexArray[workIndex].size() == vertexDataArray.size() );
     return idx; // return index of newly appended vertex
 }
@@ -65,97 +86,369 @@ unsigned int GLData::addVertex(float x, float y, float z, float r, float g, floa
     return id;
 }
 
+/// return the vertex with the given non-zero key and the position and color of v,
+/// or add v as a new vertex with this key.
+/// the position and color of a shared vertex are set when it is added, and do not change
+/// while it exists: every polygon that uses it computed the same position. an Octnode which
+/// computes another position for the key, e.g. from corner samples that differ from those
+/// of its neighbour, gets a vertex of its own, so remeshing one node never moves the
+/// triangles of another.
+/// a shared vertex belongs to no Octnode, it is removed together with its last polygon.
+unsigned int GLData::addSharedVertex(boost::uint64_t key, const GLVertex& v) {
+    assert( key != 0 );
+    unsigned int first = sharedVertices.find( key );
+    for ( unsigned int found = first; found != VertexMap::NOT_FOUND; found = vertexDataArray[found].nextShared ) {
+        if ( vertexArray[workIndex][ found ].samePositionAndColor( v ) )
+            return found;
+    }
+    unsigned int idx = addVertex( v, NULL );
+    vertexDataArray[idx].key = key;
+    vertexDataArray[idx].nextShared = first;
+    sharedVertices.set( key, idx );
+    return idx;
+}
+
+/// the list of a key starts in sharedVertices, the key is erased with its last vertex
+void GLData::unlinkShared( unsigned int vertexIdx ) {
+    boost::uint64_t key = vertexDataArray[vertexIdx].key;
+    unsigned int next = vertexDataArray[vertexIdx].nextShared;
+    unsigned int n = sharedVertices.find( key );
+    if ( n == vertexIdx ) {
+        if ( next == VertexMap::NOT_FOUND )
+            sharedVertices.erase( key );
+        else
+            sharedVertices.set( key, next );
+        return;
+    }
+    while ( vertexDataArray[n].nextShared != vertexIdx )
+        n = vertexDataArray[n].nextShared;
+    vertexDataArray[n].nextShared = next;
+}
+
+void GLData::relinkShared( unsigned int oldIdx, unsigned int newIdx ) {
+    boost::uint64_t key = vertexDataArray[newIdx].key;
+    unsigned int n = sharedVertices.find( key );
+    if ( n == oldIdx ) {
+        sharedVertices.set( key, newIdx );
+        return;
+    }
+    while ( vertexDataArray[n].nextShared != oldIdx )
+        n = vertexDataArray[n].nextShared;
+    vertexDataArray[n].nextShared = newIdx;
+}
+
 /// set vertex normal
 void GLData::setNormal(unsigned int vertexIdx, float nx, float ny, float nz) {
     vertexArray[workIndex][vertexIdx].setNormal(nx,ny,nz);
+    markVertex( vertexIdx );
 }
 
 /// modify given vertex
 void GLData::modifyVertex( unsigned int id, float x, float y, float z, float r, float g, float b, float nx, float ny, float nz) {
     GLVertex p = GLVertex(x,y,z,r,g,b,nx,ny,nz);
     vertexArray[workIndex][id] = p;
+    markVertex( id );
 }
 
 /// remove vertex with given index
 void GLData::removeVertex( unsigned int vertexIdx ) {
-    // i) for each polygon of this vertex, call remove_polygon:
-    typedef std::set< unsigned int, std::greater<unsigned int> > PolygonSet;
-    PolygonSet pset = vertexDataArray[vertexIdx].polygons;
-    BOOST_FOREACH( unsigned int polygonIdx, pset ) {
-        removePolygon( polygonIdx );
-    }
-    // ii) overwrite with last vertex:
-    unsigned int lastIdx = vertexArray[workIndex].size()-1;
-    if (vertexIdx != lastIdx) {
-        vertexArray[workIndex][vertexIdx] = vertexArray[workIndex][lastIdx];
-        vertexDataArray[vertexIdx] = vertexDataArray[lastIdx];
-        // notify octree-node with new index here!
-        // vertex that was at lastIdx is now at vertexIdx
-        vertexDataArray[vertexIdx].node->swapIndex( lastIdx, vertexIdx );
-        
-        // request each polygon to re-number this vertex.
-        BOOST_FOREACH( unsigned int polygonIdx, vertexDataArray[vertexIdx].polygons ) {
-            unsigned int idx = polygonIdx*polygonVertices();
-            for (int m=0;m<polygonVertices();++m) {
-                if ( indexArray[workIndex][ idx+m ] == lastIdx )
-                    indexArray[workIndex][ idx+m ] = vertexIdx;
+    if ( deferRemoval ) { // Octnodes on several threads may call this, so only queue the vertex
+        Locker locker( &removeMutex );
+        removedVertices.push_back( vertexIdx );
+        return;
+    }
+    removeVertexNow( vertexIdx );
+}
+
+/// remove vertex with given index, and its polygons, from the work-buffer
+void GLData::removeVertexNow( unsigned int vertexIdx ) {
+    // i) for each polygon of this vertex, call remove_polygon.
+    // this takes the polygon out of the list, and renumbers a moved polygon in the list.
+    orphanList.clear();
+    while ( !vertexDataArray[vertexIdx].empty() )
+        removePolygonNow( vertexDataArray[vertexIdx].polygons.back(), orphanList );
+    // ii) remove the vertex, and the shared vertices which were only used by its polygons
+    orphanList.push_back( vertexIdx );
+    eraseVertices( orphanList );
+}
+
+/// removing from the highest index down, the last vertex which is moved
+/// into the removed slot is never itself in the list, so all indices stay valid.
+void GLData::eraseVertices( std::vector<unsigned int>& vertices ) {
+    std::sort( vertices.begin(), vertices.end(), std::greater<unsigned int>() );
+    vertices.erase( std::unique( vertices.begin(), vertices.end() ), vertices.end() );
+    BOOST_FOREACH( unsigned int vertexIdx, vertices ) {
+        assert( vertexDataArray[vertexIdx].empty() );
+        if ( vertexDataArray[vertexIdx].key )
+            unlinkShared( vertexIdx );
+        // overwrite with last vertex:
+        unsigned int lastIdx = vertexArray[workIndex].size()-1;
+        if (vertexIdx != lastIdx) {
+            vertexArray[workIndex][vertexIdx] = vertexArray[workIndex][lastIdx];
+            markVertex( vertexIdx );
+            vertexDataArray[vertexIdx] = vertexDataArray[lastIdx];
+            // notify octree-node with new index here!
+            // vertex that was at lastIdx is now at vertexIdx
+            if ( vertexDataArray[vertexIdx].node )
+                vertexDataArray[vertexIdx].node->swapIndex( lastIdx, vertexIdx );
+            if ( vertexDataArray[vertexIdx].key )
+                relinkShared( lastIdx, vertexIdx );
+            if ( vertexDataArray[vertexIdx].normal_dirty )
+                normalsDirty.push_back( vertexIdx );
+            
+            // request each polygon to re-number this vertex.
+            BOOST_FOREACH( unsigned int polygonIdx, vertexDataArray[vertexIdx].polygons ) {
+                unsigned int idx = polygonIdx*polygonVertices();
+                for (int m=0;m<polygonVertices();++m) {
+                    if ( indexArray[workIndex][ idx+m ] == lastIdx ) {
+                        indexArray[workIndex][ idx+m ] = vertexIdx;
+                        markIndex( idx+m );
+                    }
+                }
             }
         }
+        // shorten array
+        vertexArray[workIndex].resize( vertexArray[workIndex].size()-1 );
+        vertexDataArray.resize( vertexDataArray.size()-1 );
     }
-    // shorten array
-    vertexArray[workIndex].resize( vertexArray[workIndex].size()-1 );
-    vertexDataArray.resize( vertexDataArray.size()-1 );
     assert( vertexArray[workIndex].size() == vertexDataArray.size() );
-    //std::cout << " removeVertex done.\n";
+}
+
+/// queue vertices given to removeVertex(), until the matching endDeferredRemoval().
+/// calls may be nested.
+void GLData::beginDeferredRemoval() {
+    ++deferRemoval;
+}
+
+/// end deferred removal, and remove the queued vertices when the outermost call ends
+void GLData::endDeferredRemoval() {
+    assert( deferRemoval > 0 );
+    if ( --deferRemoval == 0 )
+        flushDeferredRemoval();
+}
+
+/// remove the queued polygons and vertices now, also when removal is still deferred.
+/// polygons are removed first, from the highest index down, so that the last polygon
+/// which removePolygonNow() moves into the removed slot is never itself in the queue.
+/// then the polygons of the queued vertices are removed, and finally the vertices.
+void GLData::flushDeferredRemoval() {
+    orphanList.clear();
+    std::sort( removedPolygons.begin(), removedPolygons.end(), std::greater<unsigned int>() );
+    BOOST_FOREACH( unsigned int polygonIdx, removedPolygons ) {
+        removePolygonNow( polygonIdx, orphanList );
+    }
+    removedPolygons.clear();
+    BOOST_FOREACH( unsigned int vertexIdx, removedVertices ) {
+        while ( !vertexDataArray[vertexIdx].empty() )
+            removePolygonNow( vertexDataArray[vertexIdx].polygons.back(), orphanList );
+        orphanList.push_back( vertexIdx );
+    }
+    removedVertices.clear();
+    eraseVertices( orphanList );
+}
+
+/// remove all vertices and polygons from the work-buffer
+void GLData::clear() {
+    vertexArray[workIndex].resize(0);
+    indexArray[workIndex].resize(0);
+    vertexDataArray.resize(0);
+    polygonDataArray.resize(0);
+    sharedVertices.clear();
+    normalsDirty.clear();
+    removedVertices.clear(); // the queued vertices are gone too
+    removedPolygons.clear();
 }
 
 /// add a polygon, return its index
 int GLData::addPolygon( std::vector<GLuint>& verts) {
+    return addPolygon( verts, NULL );
+}
+
+/// add a polygon created by the given Octnode, return its index.
+/// the Octnode is notified with swapPolygonIndex() when the polygon moves.
+int GLData::addPolygon( std::vector<GLuint>& verts, Octnode* n) {
     // append to indexArray, then request each vertex to update
     unsigned int polygonIdx = indexArray[workIndex].size()/polygonVertices();
     BOOST_FOREACH( GLuint vertex, verts ) {
-        indexArray[workIndex].append(vertex);
+        markIndex( indexArray[workIndex].size() );
+        indexArray[workIndex].push_back(vertex);
         vertexDataArray[vertex].addPolygon(polygonIdx); // add index to vertex i1
+        if ( vertexDataArray[vertex].key )
+            markNormal( vertex );
     }
+    PolygonData pd;
+    pd.node = n;
+    polygonDataArray.push_back( pd );
     return polygonIdx;
 }
 
-/// remove polygon at given index
+/// remove polygon at given index. vertices which are only shared by this polygon are removed too.
 void GLData::removePolygon( unsigned int polygonIdx) {
+    if ( deferRemoval ) {
+        Locker locker( &removeMutex );
+        removedPolygons.push_back( polygonIdx );
+        return;
+    }
+    orphanList.clear();
+    removePolygonNow( polygonIdx, orphanList );
+    eraseVertices( orphanList );
+}
+
+/// remove polygon at given index from the work-buffer
+void GLData::removePolygonNow( unsigned int polygonIdx, std::vector<unsigned int>& orphans ) {
     unsigned int idx = polygonVertices()*polygonIdx; // start-index for polygon
     // i) request remove for each vertex in polygon:
-    for (int m=0; m<polygonVertices() ; ++m) // this polygon has the following 3/4 vertices. we call removePolygon on them all
-        vertexDataArray[ indexArray[workIndex][idx+m]   ].removePolygon(polygonIdx);
+    for (int m=0; m<polygonVertices() ; ++m) { // this polygon has the following 3/4 vertices. we call removePolygon on them all
+        unsigned int vertex = indexArray[workIndex][idx+m];
+        vertexDataArray[ vertex ].removePolygon(polygonIdx);
+        if ( vertexDataArray[ vertex ].key ) {
+            if ( vertexDataArray[ vertex ].empty() )
+                orphans.push_back( vertex );
+            else
+                markNormal( vertex );
+        }
+    }
     
     unsigned int last_index = (indexArray[workIndex].size()-polygonVertices());
     // if deleted polygon is last on the list, do nothing??
     if (idx!=last_index) { 
         // ii) remove from polygon-list by overwriting with last element
-        for (int m=0; m<polygonVertices(); ++m)
+        for (int m=0; m<polygonVertices(); ++m) {
             indexArray[workIndex][idx+m  ] = indexArray[workIndex][ last_index+m   ];
-        // iii) for the moved polygon, request that each vertex update the polygon number
-        for (int m=0; m<polygonVertices() ; ++m) {
-            vertexDataArray[ indexArray[workIndex][idx+m   ] ].addPolygon( idx/polygonVertices() ); // this is the new polygon index
-            vertexDataArray[ indexArray[workIndex][idx+m   ] ].removePolygon( last_index/polygonVertices() ); // this polygon is no longer there!
+            markIndex( idx+m );
         }
+        // iii) for the moved polygon, request that each vertex update the polygon number
+        for (int m=0; m<polygonVertices() ; ++m)
+            vertexDataArray[ indexArray[workIndex][idx+m   ] ].swapPolygon( last_index/polygonVertices(), idx/polygonVertices() );
+        polygonDataArray[polygonIdx] = polygonDataArray[ last_index/polygonVertices() ];
+        if ( polygonDataArray[polygonIdx].node ) // the Octnode renumbers the moved polygon
+            polygonDataArray[polygonIdx].node->swapPolygonIndex( last_index/polygonVertices(), polygonIdx );
     }
     indexArray[workIndex].resize( indexArray[workIndex].size()-polygonVertices() ); // shorten array
+    polygonDataArray.resize( polygonDataArray.size()-1 );
 } 
 
+/// add an empty chunk, return its number
+unsigned int GLData::addChunk() {
+    if ( !freeChunks.empty() ) {
+        unsigned int chunk = freeChunks.back();
+        freeChunks.pop_back();
+        return chunk;
+    }
+    Locker locker( &renderMutex ); // the renderer loops over the chunks
+    chunks.push_back( new GLChunk() );
+    return chunks.size()-1;
+}
+
+/// remove all vertices and polygons of the chunk, and free it. the chunk number
+/// may be returned by addChunk() again after the next swap().
+void GLData::removeChunk( unsigned int chunk ) {
+    clearChunk( chunk );
+    removedChunks.push_back( chunk );
+}
+
+/// remove all vertices and polygons of the chunk, the storage is kept for the new ones
+void GLData::clearChunk( unsigned int chunk ) {
+    GLChunk* c = chunks[chunk];
+    if ( c->vertexArray[workIndex].empty() && c->indexArray[workIndex].empty() )
+        return;
+    markChunk( chunk );
+    chunkVertices -= c->vertexArray[workIndex].size();
+    chunkPolygons -= c->indexArray[workIndex].size()/polygonVertices();
+    c->vertexArray[workIndex].clear();
+    c->indexArray[workIndex].clear();
+}
+
+/// set the normal of each vertex of the chunk to the area-weighted average of the normals of its polygons.
+/// vertices on the border of the chunk only see the polygons of this chunk.
+void GLData::updateChunkNormals( unsigned int chunk ) {
+    if ( polygonVertices() < 3 )
+        return;
+    markChunk( chunk );
+    std::vector<GLVertex>& vertices = chunks[chunk]->vertexArray[workIndex];
+    const std::vector<GLuint>& indices = chunks[chunk]->indexArray[workIndex];
+    normalSums.assign( vertices.size(), GLVertex(0,0,0) );
+    for ( std::size_t idx=0; idx+2 < indices.size(); idx+=polygonVertices() ) {
+        const GLVertex& p1 = vertices[ indices[idx  ] ];
+        const GLVertex& p2 = vertices[ indices[idx+1] ];
+        const GLVertex& p3 = vertices[ indices[idx+2] ];
+        GLVertex n = (p1-p2).cross( p1-p3 ); // length is twice the area
+        for (int m=0; m<polygonVertices(); ++m)
+            normalSums[ indices[idx+m] ] += n;
+    }
+    for ( std::size_t v=0; v<vertices.size(); ++v ) {
+        if ( normalSums[v].norm() > 0.0 )
+            vertices[v].setNormal( normalSums[v].x, normalSums[v].y, normalSums[v].z );
+    }
+}
+
+/// the other chunks are the same in both buffers
+void GLData::copyChunkBuffers() {
+    BOOST_FOREACH( unsigned int chunk, copyChunks ) {
+        GLChunk* c = chunks[chunk];
+        c->vertexArray[workIndex] = c->vertexArray[renderIndex];
+        c->indexArray[workIndex] = c->indexArray[renderIndex];
+        c->version[workIndex] = c->version[renderIndex];
+        c->changed = false;
+    }
+    copyChunks.clear();
+    // a chunk removed before the last swap is empty in both buffers now
+    BOOST_FOREACH( unsigned int chunk, removedChunks ) {
+        if ( !chunks[chunk]->changed )
+            freeChunks.push_back( chunk );
+    }
+    removedChunks.clear();
+}
+
+void GLData::markNormal( unsigned int vertexIdx ) {
+    if ( !vertexDataArray[vertexIdx].normal_dirty ) {
+        vertexDataArray[vertexIdx].normal_dirty = true;
+        normalsDirty.push_back( vertexIdx );
+    }
+}
+
+/// set the normal of each shared vertex, whose polygons have changed, to the 
+/// area-weighted average of the normals of its polygons
+void GLData::updateNormals() {
+    if ( polygonVertices() < 3 ) { // no normals for points and lines
+        normalsDirty.clear();
+        return;
+    }
+    BOOST_FOREACH( unsigned int vertexIdx, normalsDirty ) {
+        // vertices may have moved, or been removed, since they were listed
+        if ( vertexIdx >= (unsigned int)vertexDataArray.size() || !vertexDataArray[vertexIdx].normal_dirty )
+            continue;
+        vertexDataArray[vertexIdx].normal_dirty = false;
+        GLVertex n(0,0,0);
+        BOOST_FOREACH( unsigned int polygonIdx, vertexDataArray[vertexIdx].polygons ) {
+            unsigned int idx = polygonIdx*polygonVertices();
+            const GLVertex& p1 = vertexArray[workIndex][ indexArray[workIndex][idx  ] ];
+            const GLVertex& p2 = vertexArray[workIndex][ indexArray[workIndex][idx+1] ];
+            const GLVertex& p3 = vertexArray[workIndex][ indexArray[workIndex][idx+2] ];
+            n += (p1-p2).cross( p1-p3 ); // length is twice the area
+        }
+        if ( n.norm() > 0.0 ) {
+            vertexArray[workIndex][vertexIdx].setNormal( n.x, n.y, n.z );
+            markVertex( vertexIdx );
+        }
+    }
+    normalsDirty.clear();
+}
+
 /// string output
 void GLData::print() {
     std::cout << "GLData vertices: \n";
     //int n = 0;
-    for( int n = 0; n < vertexArray[workIndex].size(); ++n ) {
+    for( unsigned int n = 0; n < vertexArray[workIndex].size(); ++n ) {
         std::cout << n << " : ";
-        vertexArray[workIndex][n].str();
+        std::cout << vertexArray[workIndex][n].str();
         std::cout << " polys: "; 
         //vertexDataArray[n].str();
         std::cout << "\n";
     }
     std::cout << "GLData polygons: \n";
     int polygonIndex = 0;
-    for( int n=0; n< indexArray[workIndex].size(); n=n+polygonVertices() ) {
+    for( unsigned int n=0; n< indexArray[workIndex].size(); n=n+polygonVertices() ) {
         std::cout << polygonIndex << " : ";
         for (int m=0;m<polygonVertices() ;++m)
             std::cout << indexArray[workIndex][n+m] << " "; 
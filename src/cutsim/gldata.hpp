@@ -20,19 +20,18 @@
 #ifndef GL_DATA_H
 #define GL_DATA_H
 
-#include <QObject>
-#include <QGLBuffer>
-#include <QVarLengthArray>
-#include <QMutex>
-#include <QMutexLocker>
-
 #include <iostream>
-#include <set>
+#include <vector>
 #include <cmath>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
+#include <boost/cstdint.hpp>
 
 #include "glvertex.hpp"
+#include "index_list.hpp"
+#include "vertex_map.hpp"
+#include "task_scheduler.hpp"
 
 namespace cutsim {
 
@@ -43,27 +42,91 @@ class Octnode;
 struct VertexData {
     /// string output
     void str() {
-        BOOST_FOREACH( GLuint pIdx, polygons ) {
+        BOOST_FOREACH( unsigned int pIdx, polygons ) {
             std::cout << pIdx << " ";
         }
     }
-    /// insert polygon-id to polygon set
-    inline void addPolygon( unsigned int idx ) { polygons.insert( idx ); }
-    /// remove polygon-id from polygon set
+    /// insert polygon-id to polygon list
+    inline void addPolygon( unsigned int idx ) { polygons.push_back( idx ); }
+    /// remove polygon-id from polygon list
     inline void removePolygon(unsigned int idx ) { polygons.erase( idx ); }
-    /// is the polygon set empty?
+    /// change polygon-id oldIdx to newIdx, for a polygon that was moved
+    inline void swapPolygon(unsigned int oldIdx, unsigned int newIdx ) { polygons.replace( oldIdx, newIdx ); }
+    /// is the polygon list empty?
     inline bool empty() { return polygons.empty(); }
 // DATA
-    /// The set of polygons. Each polygon has an uint index which is stored here.
-    /// Note: we want to access polygons from highest index to lowest, thus compare with "greater"
-    typedef std::set< unsigned int, std::greater<unsigned int> > PolygonSet;
-    /// the polygons to which this vertex belongs. i.e. for each vertex we store in this set all the polygons to which it belongs.
-    PolygonSet polygons;
+    /// The list of polygons. Each polygon has an uint index which is stored here.
+    /// A vertex of a marching-cubes surface has about six polygons, these need no heap allocation.
+    typedef IndexList<6> PolygonList;
+    /// the polygons to which this vertex belongs. i.e. for each vertex we store in this list all the polygons to which it belongs.
+    PolygonList polygons;
     /// the Octnode that created this vertex. 
     /// when an Octnode is cut the corresponding vertex/vertices are deleted.
     /// when a vertex is deleted, the Octnode that generated it is notified
     Octnode* node;
     // (an alternative callback-mechanism would be to store a function-pointer or similar)
+    /// the key of a shared vertex, see GLData::addSharedVertex(). zero for a vertex owned by node.
+    boost::uint64_t key;
+    /// the next shared vertex with the same key, or VertexMap::NOT_FOUND
+    unsigned int nextShared;
+    /// true if the vertex is in the list of vertices waiting for GLData::updateNormals()
+    bool normal_dirty;
+};
+
+/// the blocks of an array that were written to since the last GLData::swapBuffers().
+/// a block is BLOCK_SIZE consecutive elements.
+class BlockList {
+public:
+    /// number of bits of an element index that are the position within its block
+    static const unsigned int BLOCK_BITS = 6;
+    /// number of elements in a block
+    static const unsigned int BLOCK_SIZE = 1u << BLOCK_BITS;
+    /// note that element idx was written
+    inline void mark( unsigned int idx ) {
+        unsigned int block = idx >> BLOCK_BITS;
+        if ( block >= listed.size() )
+            listed.resize( 2*block+1, 0 );
+        if ( !listed[block] ) {
+            listed[block] = 1;
+            blocks.push_back( block );
+        }
+    }
+    /// note that all elements of the block were written
+    inline void markBlock( unsigned int block ) { mark( block << BLOCK_BITS ); }
+    /// move the list of blocks to list, and start a new one
+    void take( std::vector<unsigned int>& list ) {
+        BOOST_FOREACH( unsigned int block, blocks ) {
+            listed[block] = 0;
+        }
+        list.swap( blocks );
+        blocks.clear();
+    }
+private:
+    /// the written blocks
+    std::vector<unsigned int> blocks;
+    /// non-zero for the blocks in the list
+    std::vector<unsigned char> listed;
+};
+
+/// a block of the surface with its own vertex and index arrays, see GLData::addChunk().
+/// the indices of a chunk refer to the vertices of the same chunk.
+struct GLChunk {
+    GLChunk() : changed(false) { version[0] = version[1] = 0; }
+    /// vertex coordinates, double buffered like the arrays of GLData
+    std::vector<GLVertex> vertexArray[2];
+    /// polygon indices
+    std::vector<GLuint> indexArray[2];
+    /// incremented each time the chunk is changed, so a renderer can tell when to upload it again
+    unsigned int version[2];
+    /// true if the work-buffer has changed since the last swapBuffers()
+    bool changed;
+};
+
+/// additional polygon data, not needed for OpenGL rendering
+struct PolygonData {
+    /// the Octnode that created this polygon, or NULL. 
+    /// when a polygon is moved to a new index, the Octnode is notified
+    Octnode* node;
 };
 
 
@@ -118,17 +181,59 @@ struct GLParameters {
 };
 
 /// a GLData object holds data which is drawn by OpenGL using VBOs
+///
+/// vertices and polygons are either in the global arrays, where removing one moves the
+/// last vertex or polygon into its place, or in chunks. A chunk holds the surface of one 
+/// region, and is cleared and rebuilt as a whole, so its arrays stay contiguous
+/// and a renderer needs to upload only the chunks whose version has changed.
 class GLData {
 public:
     GLData();
+    virtual ~GLData();
     unsigned int addVertex(float x, float y, float z, float r, float g, float b);
     unsigned int addVertex(GLVertex v, Octnode* n);
     unsigned int addVertex(float x, float y, float z, float r, float g, float b, Octnode* n);
+    unsigned int addSharedVertex(boost::uint64_t key, const GLVertex& v);
     void setNormal(unsigned int vertexIdx, float nx, float ny, float nz);
     void modifyVertex( unsigned int id, float x, float y, float z, float r, float g, float b, float nx, float ny, float nz);
     void removeVertex( unsigned int vertexIdx );
+    void beginDeferredRemoval();
+    void endDeferredRemoval();
+    void flushDeferredRemoval();
+    void clear();
     int addPolygon( std::vector<GLuint>& verts);
+    int addPolygon( std::vector<GLuint>& verts, Octnode* n);
     void removePolygon( unsigned int polygonIdx);
+    void updateNormals();
+    /// number of vertices in the work-buffer, including those of the chunks
+    int vertexCount() const { return vertexArray[workIndex].size() + chunkVertices; }
+    /// number of polygons in the work-buffer, including those of the chunks
+    int polygonCount() const { return polygonDataArray.size() + chunkPolygons; }
+    
+// chunks
+    unsigned int addChunk();
+    void removeChunk( unsigned int chunk );
+    void clearChunk( unsigned int chunk );
+    /// add a vertex to the chunk, return its index in the chunk
+    unsigned int addChunkVertex( unsigned int chunk, const GLVertex& v ) {
+        markChunk( chunk );
+        std::vector<GLVertex>& vertices = chunks[chunk]->vertexArray[workIndex];
+        vertices.push_back( v );
+        ++chunkVertices;
+        return vertices.size()-1;
+    }
+    /// vertex idx of the chunk in the work-buffer
+    const GLVertex& chunkVertex( unsigned int chunk, unsigned int idx ) const { 
+        return chunks[chunk]->vertexArray[workIndex][idx]; 
+    }
+    /// add a polygon to the chunk, verts are polygonVertices() indices of vertices of the chunk
+    void addChunkPolygon( unsigned int chunk, const GLuint* verts ) {
+        markChunk( chunk );
+        std::vector<GLuint>& indices = chunks[chunk]->indexArray[workIndex];
+        indices.insert( indices.end(), verts, verts+polygonVertices() );
+        ++chunkPolygons;
+    }
+    void updateChunkNormals( unsigned int chunk );
     void print() ;
 
 // type of GLData
@@ -178,15 +283,21 @@ public:
     static const unsigned int normal_offset = 24;
     
     /// renderer locks this while rendering, swapBuffer locks while swapping
-    QMutex renderMutex; 
+    Lock renderMutex; 
     /// locked wile updateGL-task works on workIndex
-    QMutex workMutex;
+    Lock workMutex;
+    /// locked while removeVertex() queues a vertex, when removal is deferred
+    Lock removeMutex;
     
 // these 'getters' used by OpenGL renderer to render this GLData
     /// pointer to the vertex-array
-    const GLVertex* getVertexArray() const { return vertexArray[renderIndex].data(); }
+    const GLVertex* getVertexArray() const { 
+        return vertexArray[renderIndex].empty() ? NULL : &vertexArray[renderIndex][0]; 
+    }
     /// pointer to the index-array
-    const GLuint* getIndexArray() const { return indexArray[renderIndex].data(); }
+    const GLuint* getIndexArray() const { 
+        return indexArray[renderIndex].empty() ? NULL : &indexArray[renderIndex][0]; 
+    }
     /// number of vertices per polygon (usually 3 or 4)
     inline const int polygonVertices() const { return glp[renderIndex].polyVerts; }
     /// the GLtype
@@ -197,27 +308,62 @@ public:
     inline const GLenum polygonFillMode() const { return glp[renderIndex].polygonMode_mode;}
     /// length of indexArray
     inline const int indexCount() const { return indexArray[renderIndex].size(); }
-    
-    /// call swap() then copy()
-    void swap() {
-        swapBuffers();
-        copyBuffers();
+    /// length of vertexArray
+    inline const int vertexArrayCount() const { return vertexArray[renderIndex].size(); }
+    /// move the lists of the vertex and index blocks, which have changed in the render-buffer 
+    /// since the last call, to vertices and indices. a renderer which keeps a copy of the arrays, 
+    /// e.g. in buffer objects, updates these blocks. the caller holds renderMutex.
+    void takeUploadBlocks( std::vector<unsigned int>& vertices, std::vector<unsigned int>& indices ) {
+        uploadVertexBlocks.take( vertices );
+        uploadIndexBlocks.take( indices );
     }
+    /// number of chunk slots, some of which may be empty. the caller holds renderMutex.
+    unsigned int chunkCount() const { return chunks.size(); }
+    /// pointer to the vertex-array of chunk n
+    const GLVertex* getChunkVertexArray(unsigned int n) const { 
+        const std::vector<GLVertex>& vertices = chunks[n]->vertexArray[renderIndex];
+        return vertices.empty() ? NULL : &vertices[0]; 
+    }
+    /// pointer to the index-array of chunk n
+    const GLuint* getChunkIndexArray(unsigned int n) const { 
+        const std::vector<GLuint>& indices = chunks[n]->indexArray[renderIndex];
+        return indices.empty() ? NULL : &indices[0]; 
+    }
+    /// length of the vertex-array of chunk n
+    int chunkVertexCount(unsigned int n) const { return chunks[n]->vertexArray[renderIndex].size(); }
+    /// length of the index-array of chunk n
+    int chunkIndexCount(unsigned int n) const { return chunks[n]->indexArray[renderIndex].size(); }
+    /// the version of chunk n, which changes when the chunk is rebuilt
+    unsigned int chunkVersion(unsigned int n) const { return chunks[n]->version[renderIndex]; }
+    
+    /// call swapBuffers() then copyBuffers()
+    void swap();
     /// change workIndex<->renderIndex
     void swapBuffers() {  // neither rendering nor working is allowed during this operation!
         renderMutex.lock();
         workMutex.lock();
             renderIndex = (renderIndex==0) ? 1 : 0 ;
             workIndex = (workIndex==0) ? 1 : 0 ;
+            copyChunks.swap( changedChunks ); // these are out of date in the new work-buffer
+            vertexBlocks.take( copyVertexBlocks );
+            indexBlocks.take( copyIndexBlocks );
+            BOOST_FOREACH( unsigned int block, copyVertexBlocks ) { // these are new in the render-buffer
+                uploadVertexBlocks.markBlock( block );
+            }
+            BOOST_FOREACH( unsigned int block, copyIndexBlocks ) {
+                uploadIndexBlocks.markBlock( block );
+            }
         workMutex.unlock();
         renderMutex.unlock();
     }
-    /// copy render-buffer to work-buffer
+    /// copy render-buffer to work-buffer. only the blocks written before the last
+    /// swapBuffers() differ, so only those are copied.
     void copyBuffers() { // rendering is allowed durint this call, since we only read from [renderIndex] here
         workMutex.lock();
-            vertexArray[workIndex] = vertexArray[renderIndex];
-            indexArray[workIndex] = indexArray[renderIndex];
+            copyBlocks( vertexArray, copyVertexBlocks );
+            copyBlocks( indexArray, copyIndexBlocks );
             glp[workIndex] = glp[renderIndex];
+            copyChunkBuffers();
         workMutex.unlock();
     }
     
@@ -228,14 +374,95 @@ protected:
     
 // data. double buffered. rendering uses [renderIndex], worker-task uses [workIndex]
     /// vertex coordinates
-    QVarLengthArray<GLVertex>    vertexArray[2];
+    std::vector<GLVertex>    vertexArray[2];
     /// non-OpenGL data associated with vertices. This correspoinds allways to the workIndex.
     /// only one array, since not needed for OpenGL drawing!
-    QVarLengthArray<VertexData>  vertexDataArray; 
+    std::vector<VertexData>  vertexDataArray; 
+    /// non-OpenGL data associated with polygons, for the workIndex.
+    std::vector<PolygonData> polygonDataArray;
+    /// the index of the first shared vertex with each key, the others follow VertexData::nextShared
+    VertexMap sharedVertices;
+    /// take a shared vertex out of the list of vertices with its key
+    void unlinkShared( unsigned int vertexIdx );
+    /// the shared vertex which moved from oldIdx to newIdx keeps its place in the list of its key
+    void relinkShared( unsigned int oldIdx, unsigned int newIdx );
+    /// shared vertices whose polygons have changed since the last updateNormals()
+    std::vector<unsigned int> normalsDirty;
     /// polygon indices
-    QVarLengthArray<GLuint>      indexArray[2];
+    std::vector<GLuint>      indexArray[2];
     /// parameters for rendering this GLData
     GLParameters glp[2];
+    /// remove a vertex, also when removal is deferred
+    void removeVertexNow( unsigned int vertexIdx );
+    /// remove a polygon, also when removal is deferred. shared vertices left without polygons are put in orphans.
+    void removePolygonNow( unsigned int polygonIdx, std::vector<unsigned int>& orphans );
+    /// remove the given vertices, which have no polygons, from the highest index down
+    void eraseVertices( std::vector<unsigned int>& vertices );
+    /// vertices to be removed by eraseVertices(), kept to reuse its storage
+    std::vector<unsigned int> orphanList;
+    /// put the vertex in the normalsDirty list
+    void markNormal( unsigned int vertexIdx );
+    /// put the chunk in the changedChunks list, and give its work-buffer a new version
+    void markChunk( unsigned int chunk ) {
+        GLChunk* c = chunks[chunk];
+        if ( !c->changed ) {
+            c->changed = true;
+            c->version[workIndex] = c->version[renderIndex] + 1;
+            changedChunks.push_back( chunk );
+        }
+    }
+    /// note that vertex idx of the work-buffer was written
+    inline void markVertex( unsigned int idx ) { vertexBlocks.mark( idx ); }
+    /// note that index idx of the work-buffer was written
+    inline void markIndex( unsigned int idx ) { indexBlocks.mark( idx ); }
+    /// copy the given blocks of array from the render-buffer to the work-buffer, and make the sizes equal
+    template <class Array>
+    void copyBlocks( Array* array, const std::vector<unsigned int>& blocks ) {
+        const Array& from = array[renderIndex];
+        Array& to = array[workIndex];
+        to.resize( from.size() ); // elements past the end of the work-buffer were appended, so they are in a block
+        BOOST_FOREACH( unsigned int block, blocks ) {
+            int end = std::min( (int)((block+1) << BlockList::BLOCK_BITS), (int)from.size() );
+            for ( int n = block << BlockList::BLOCK_BITS; n < end; ++n )
+                to[n] = from[n];
+        }
+    }
+    /// vertex blocks written since the last swapBuffers()
+    BlockList vertexBlocks;
+    /// index blocks written since the last swapBuffers()
+    BlockList indexBlocks;
+    /// vertex blocks changed in the render-buffer since the last takeUploadBlocks()
+    BlockList uploadVertexBlocks;
+    /// index blocks changed in the render-buffer since the last takeUploadBlocks()
+    BlockList uploadIndexBlocks;
+    /// vertex blocks written before the last swapBuffers(), copied by copyBuffers()
+    std::vector<unsigned int> copyVertexBlocks;
+    /// index blocks written before the last swapBuffers(), copied by copyBuffers()
+    std::vector<unsigned int> copyIndexBlocks;
+    /// copy the chunks changed before the last swapBuffers() from the render-buffer to the work-buffer
+    void copyChunkBuffers();
+    /// the chunks, allocated one by one so that a chunk does not move when a slot is added
+    std::vector<GLChunk*> chunks;
+    /// chunks changed in the work-buffer since the last swapBuffers()
+    std::vector<unsigned int> changedChunks;
+    /// chunks changed before the last swapBuffers(), copied by copyBuffers()
+    std::vector<unsigned int> copyChunks;
+    /// removed chunks, which are free for addChunk() once they are empty in both buffers
+    std::vector<unsigned int> removedChunks;
+    /// free chunk slots
+    std::vector<unsigned int> freeChunks;
+    /// number of vertices in the work-buffers of the chunks
+    int chunkVertices;
+    /// number of polygons in the work-buffers of the chunks
+    int chunkPolygons;
+    /// the sum of the polygon normals at each vertex, used by updateChunkNormals()
+    std::vector<GLVertex> normalSums;
+    /// number of beginDeferredRemoval() calls not yet ended by endDeferredRemoval()
+    unsigned int deferRemoval;
+    /// vertices queued by removeVertex() while removal is deferred
+    std::vector<unsigned int> removedVertices;
+    /// polygons queued by removePolygon() while removal is deferred
+    std::vector<unsigned int> removedPolygons;
     
     /// index of the render-buffer, either 0 or 1
     /// the renderer renders from this buffer while the updateGL-task is free to work on the other buffer
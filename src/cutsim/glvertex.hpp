@@ -22,8 +22,16 @@
 
 #include <cassert>
 #include <cmath>
-#include <QGLBuffer>
-#include <QString>
+#include <iostream>
+#include <string>
+#include <sstream>
+
+// only the GL types and enums are used, the core does not link with OpenGL
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
 
 namespace cutsim {
 
@@ -82,6 +90,10 @@ struct GLVertex {
         g=green;
         b=blue;
     }
+    /// true if p has exactly the same position and color, the normal is not compared
+    bool samePositionAndColor( const GLVertex& p ) const {
+        return x == p.x && y == p.y && z == p.z && r == p.r && g == p.g && b == p.b;
+    }
     
     /// assume p1-p2-p3 forms a triangle. set normals. set color.
     static void set_normal_and_color(GLVertex& p1,GLVertex& p2,GLVertex& p3, Color c ) {
@@ -95,7 +107,11 @@ struct GLVertex {
         p3.setColor( c );
     }
     /// string output
-    QString str() { return QString("(%1, %2, %3 )").arg(x).arg(y).arg(z); }
+    std::string str() const { 
+        std::ostringstream o;
+        o << "(" << x << ", " << y << ", " << z << " )";
+        return o.str();
+    }
     
 // DATA
     /// x-coordinate
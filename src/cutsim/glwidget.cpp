@@ -18,6 +18,7 @@
 */
 
 #include <iostream>
+#include <algorithm>
 
 #include <QObject>
 #include <QTimer>
@@ -33,44 +34,160 @@ GLWidget::GLWidget( QWidget *parent, char *name ) {
     showEntireScene();
     file_number=0;
     corner_axis=true;
+    use_vbo=true;
+    show_frame_time=false;
+    frameTime=0;
+}
+
+GLWidget::~GLWidget() {
+    makeCurrent(); // the buffer objects are deleted in our context
+    BOOST_FOREACH( GLDataBuffers* b, glBuffers ) {
+        delete b;
+    }
 }
 
 /// add new GLData object and return pointer to it.
 GLData* GLWidget::addGLData() {
     GLData* g = new GLData();
     glObjects.push_back(g);
+    glBuffers.push_back( new GLDataBuffers() );
     return g;
 }
 
 /// loop through glObjects and for each GLData draw it using VBO
 void GLWidget::draw()  {
-
-    BOOST_FOREACH( GLData* g, glObjects ) { // draw each object
-
+    frameTimer.start();
+    for ( unsigned int i=0; i<glObjects.size(); ++i ) { // draw each object
+        GLData* g = glObjects[i];
+        GLDataBuffers* b = glBuffers[i];
         // apply a transformation-matrix here !?
-        QMutexLocker locker( &(g->renderMutex) );
+        Locker locker( &(g->renderMutex) );
         glPolygonMode( g->polygonFaceMode(), g->polygonFillMode()  ); 
         glEnableClientState(GL_VERTEX_ARRAY);
         glEnableClientState(GL_COLOR_ARRAY);
         glEnableClientState(GL_NORMAL_ARRAY);
-        // http://www.opengl.org/sdk/docs/man/xhtml/glNormalPointer.xml
-        glNormalPointer( GLData::coordinate_type, sizeof( GLData::vertex_type ),    ((GLbyte*)g->getVertexArray()  + GLData::normal_offset ) );
-        // http://www.opengl.org/sdk/docs/man/xhtml/glColorPointer.xml
-        glColorPointer(  3, GLData::color_type     , sizeof( GLData::vertex_type ), ((GLbyte*)g->getVertexArray()  + GLData::color_offset  ) ); 
-        glVertexPointer( 3, GLData::coordinate_type, sizeof( GLData::vertex_type ), ((GLbyte*)g->getVertexArray()  + GLData::vertex_offset  ) ); 
-        // http://www.opengl.org/sdk/docs/man/xhtml/glDrawElements.xml
-        glDrawElements( g->GLType() , g->indexCount() , GLData::index_type, g->getIndexArray());
+        if ( use_vbo ) {
+            upload( g, b );
+            drawBuffers( g, b->arrays, g->indexCount() );
+            for ( unsigned int n=0; n<g->chunkCount(); ++n ) {
+                if ( g->chunkIndexCount(n) > 0 )
+                    drawBuffers( g, *b->chunks[n], g->chunkIndexCount(n) );
+            }
+        } else {
+            drawArrays( g, g->getVertexArray(), g->getIndexArray(), g->indexCount() );
+            for ( unsigned int n=0; n<g->chunkCount(); ++n ) { // each chunk has its own arrays
+                if ( g->chunkIndexCount(n) > 0 )
+                    drawArrays( g, g->getChunkVertexArray(n), g->getChunkIndexArray(n), g->chunkIndexCount(n) );
+            }
+        }
         glDisableClientState(GL_VERTEX_ARRAY);
         glDisableClientState(GL_COLOR_ARRAY);
         glDisableClientState(GL_NORMAL_ARRAY);
     }
+    if ( show_frame_time ) {
+        glFinish(); // wait until the GPU has drawn the frame
+        double t = 1e-6*frameTimer.nsecsElapsed();
+        frameTime = (frameTime > 0) ? 0.9*frameTime + 0.1*t : t; // average over about ten frames
+    }
     lastFrameTime = QTime::currentTime();
 }
 
+void GLWidget::upload( GLData* g, GLDataBuffers* b ) {
+    g->takeUploadBlocks( vertexBlocks, indexBlocks );
+    uploadBlocks( b->arrays.vertices, b->arrays.vertexCapacity, (const GLbyte*)g->getVertexArray(), 
+                  sizeof( GLData::vertex_type ), g->vertexArrayCount(), vertexBlocks );
+    uploadBlocks( b->arrays.indices, b->arrays.indexCapacity, (const GLbyte*)g->getIndexArray(), 
+                  sizeof( GLuint ), g->indexCount(), indexBlocks );
+    // a chunk is uploaded as a whole when its version changes
+    while ( b->chunks.size() < g->chunkCount() )
+        b->chunks.push_back( new GLBuffers() );
+    for ( unsigned int n=0; n<g->chunkCount(); ++n ) {
+        GLBuffers* c = b->chunks[n];
+        if ( c->version == g->chunkVersion(n) )
+            continue;
+        uploadAll( c->vertices, c->vertexCapacity, (const GLbyte*)g->getChunkVertexArray(n), 
+                   sizeof( GLData::vertex_type ), g->chunkVertexCount(n) );
+        uploadAll( c->indices, c->indexCapacity, (const GLbyte*)g->getChunkIndexArray(n), 
+                   sizeof( GLuint ), g->chunkIndexCount(n) );
+        c->version = g->chunkVersion(n);
+    }
+}
+
+// consecutive blocks are written with one call
+void GLWidget::uploadBlocks( QGLBuffer& buffer, int& capacity, const GLbyte* data, int size, int count, std::vector<unsigned int>& blocks ) {
+    if ( !buffer.isCreated() || count > capacity ) {
+        uploadAll( buffer, capacity, data, size, count );
+        return;
+    }
+    if ( blocks.empty() )
+        return;
+    std::sort( blocks.begin(), blocks.end() );
+    buffer.bind();
+    std::size_t first = 0;
+    while ( first < blocks.size() ) {
+        std::size_t last = first;
+        while ( last+1 < blocks.size() && blocks[last+1] == blocks[last]+1 )
+            ++last;
+        int begin = blocks[first] << BlockList::BLOCK_BITS;
+        int end = std::min( (int)( (blocks[last]+1) << BlockList::BLOCK_BITS ), count );
+        if ( begin < end ) // blocks past the end were removed
+            buffer.write( begin*size, data + begin*size, (end-begin)*size );
+        first = last+1;
+    }
+    buffer.release();
+}
+
+// the buffer grows by doubling, so that a growing mesh is not re-allocated on each upload
+void GLWidget::uploadAll( QGLBuffer& buffer, int& capacity, const GLbyte* data, int size, int count ) {
+    if ( !buffer.isCreated() ) {
+        buffer.create();
+        buffer.setUsagePattern( QGLBuffer::DynamicDraw );
+    }
+    buffer.bind();
+    if ( count > capacity ) {
+        capacity = std::max( count, 2*capacity );
+        buffer.allocate( capacity*size );
+    }
+    if ( count > 0 )
+        buffer.write( 0, data, count*size );
+    buffer.release();
+}
+
+void GLWidget::drawBuffers( GLData* g, GLBuffers& b, int count ) {
+    if ( count == 0 )
+        return;
+    const GLbyte* vertices = NULL; // offsets into the bound vertex buffer
+    b.vertices.bind();
+    glNormalPointer( GLData::coordinate_type, sizeof( GLData::vertex_type ),    vertices + GLData::normal_offset );
+    glColorPointer(  3, GLData::color_type     , sizeof( GLData::vertex_type ), vertices + GLData::color_offset );
+    glVertexPointer( 3, GLData::coordinate_type, sizeof( GLData::vertex_type ), vertices + GLData::vertex_offset );
+    b.vertices.release();
+    b.indices.bind();
+    glDrawElements( g->GLType() , count , GLData::index_type, NULL );
+    b.indices.release();
+}
+
+void GLWidget::drawArrays( GLData* g, const GLVertex* vertices, const GLuint* indices, int count ) {
+    if ( count == 0 )
+        return;
+    // http://www.opengl.org/sdk/docs/man/xhtml/glNormalPointer.xml
+    glNormalPointer( GLData::coordinate_type, sizeof( GLData::vertex_type ),    ((GLbyte*)vertices  + GLData::normal_offset ) );
+    // http://www.opengl.org/sdk/docs/man/xhtml/glColorPointer.xml
+    glColorPointer(  3, GLData::color_type     , sizeof( GLData::vertex_type ), ((GLbyte*)vertices  + GLData::color_offset  ) ); 
+    glVertexPointer( 3, GLData::coordinate_type, sizeof( GLData::vertex_type ), ((GLbyte*)vertices  + GLData::vertex_offset  ) ); 
+    // http://www.opengl.org/sdk/docs/man/xhtml/glDrawElements.xml
+    glDrawElements( g->GLType() , count , GLData::index_type, indices );
+}
+
 void GLWidget::postDraw() {
     QGLViewer::postDraw();
     if (corner_axis)
         drawCornerAxis();
+    if (show_frame_time) {
+        glColor3f(1.0, 1.0, 1.0);
+        drawText( 10, height()-10, QString("draw: %1 ms, %2").arg( frameTime, 0, 'f', 2 )
+                                    .arg( use_vbo ? "buffer objects" : "client arrays" ) );
+    }
 }
 
 void GLWidget::slotWriteScreenshot() {
@@ -91,6 +208,18 @@ void GLWidget::keyPressEvent(QKeyEvent *e) {
       handled=true;
       updateGL();
     }
+    if ((e->key()==Qt::Key_V) && (modifiers==Qt::NoButton)) {
+      use_vbo = !use_vbo;
+      frameTime = 0;
+      handled=true;
+      updateGL();
+    }
+    if ((e->key()==Qt::Key_T) && (modifiers==Qt::NoButton)) {
+      show_frame_time = !show_frame_time;
+      frameTime = 0;
+      handled=true;
+      updateGL();
+    }
     
     
     if (!handled)
@@ -27,6 +27,7 @@
 #include <QVarLengthArray>
 #include <QtGui>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QCursor>
 #include <QDataStream>
 #include <QDebug>
@@ -42,14 +43,51 @@
 
 namespace cutsim {
 
+/// the buffer objects which hold the vertices and indices of a GLData, 
+/// or of one of its chunks, on the GPU
+struct GLBuffers {
+    GLBuffers() : vertices(QGLBuffer::VertexBuffer), indices(QGLBuffer::IndexBuffer),
+                  vertexCapacity(0), indexCapacity(0), version(0) {}
+    /// the vertex buffer
+    QGLBuffer vertices;
+    /// the index buffer
+    QGLBuffer indices;
+    /// number of vertices allocated in the vertex buffer
+    int vertexCapacity;
+    /// number of indices allocated in the index buffer
+    int indexCapacity;
+    /// the version of the uploaded chunk
+    unsigned int version;
+};
+
+/// the buffer objects of one GLData
+struct GLDataBuffers {
+    ~GLDataBuffers() {
+        BOOST_FOREACH( GLBuffers* b, chunks ) {
+            delete b;
+        }
+    }
+    /// buffers for the vertex- and index-arrays
+    GLBuffers arrays;
+    /// buffers for each chunk
+    std::vector<GLBuffers*> chunks;
+};
+
 /// OpenGL widget for displaying 3D graphics
+///
+/// the GLData objects are kept in buffer objects on the GPU. after a swap of 
+/// a GLData only the changed blocks of its arrays, and the changed chunks, are uploaded.
+/// key V switches between buffer objects and client-side arrays, and key T 
+/// shows the time taken to draw a frame.
 class GLWidget : public QGLViewer  {
     Q_OBJECT
     public:
         /// create widget
         GLWidget( QWidget *parent=0, char *name=0 ) ;
-        ~GLWidget() {}
+        ~GLWidget();
         GLData* addGLData();
+        /// the average time taken by draw(), in milliseconds, while the frame time is shown
+        double frame_time() const { return frameTime; }
     signals:
 
     public slots:
@@ -69,8 +107,32 @@ class GLWidget : public QGLViewer  {
         virtual void keyPressEvent(QKeyEvent *e);
     private:
         void drawCornerAxis();
+        /// upload the changes of g to its buffer objects b
+        void upload( GLData* g, GLDataBuffers* b );
+        /// upload the given blocks of data, which has count elements of the given size, to buffer
+        void uploadBlocks( QGLBuffer& buffer, int& capacity, const GLbyte* data, int size, int count, std::vector<unsigned int>& blocks );
+        /// upload all of data, which has count elements of the given size, to buffer
+        void uploadAll( QGLBuffer& buffer, int& capacity, const GLbyte* data, int size, int count );
+        /// draw count indices of g from the buffer objects b
+        void drawBuffers( GLData* g, GLBuffers& b, int count );
+        /// draw count indices of g from the client-side arrays
+        void drawArrays( GLData* g, const GLVertex* vertices, const GLuint* indices, int count );
         /// these are the GLData objects which will be drawn in the OpenGL scene
         std::vector<GLData*> glObjects;
+        /// the buffer objects of each GLData in glObjects
+        std::vector<GLDataBuffers*> glBuffers;
+        /// blocks taken from a GLData by upload()
+        std::vector<unsigned int> vertexBlocks;
+        /// blocks taken from a GLData by upload()
+        std::vector<unsigned int> indexBlocks;
+        /// flag to indicate if buffer objects are used, instead of client-side arrays
+        bool use_vbo;
+        /// flag to indicate if the frame time is shown
+        bool show_frame_time;
+        /// the average time taken by draw(), in milliseconds
+        double frameTime;
+        /// measures the time taken by draw()
+        QElapsedTimer frameTimer;
         /// time at which last frame was drawn
         QTime lastFrameTime;
         /// used for number screenshots
@@ -0,0 +1,152 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INDEX_LIST_H
+#define INDEX_LIST_H
+
+#include <cassert>
+#include <cstring>
+
+namespace cutsim {
+
+/// \class IndexList
+/// a short unordered list of vertex- or polygon-indices.
+///
+/// the first N indices are stored inside the list, so that the vertices and polygons
+/// of the GLData, and the Octnodes, need no heap allocation for their indices
+/// in the common case. Longer lists move to an array on the heap, which grows by doubling.
+/// erase() overwrites the index with the last one, so the order of the indices is not kept.
+/// The local storage and the heap pointer share memory, capacity tells which one is in use.
+/// The lists are short (a vertex has about six polygons), so the linear search
+/// in erase() and replace() is faster than a std::set.
+template <unsigned int N>
+class IndexList {
+public:
+    /// iterator over the indices
+    typedef const unsigned int* const_iterator;
+    /// iterator over the indices, they can only be changed through erase() and replace()
+    typedef const_iterator iterator;
+    /// empty list
+    IndexList() : count(0), capacity(N) {}
+    /// copy of other
+    IndexList(const IndexList& other) : count(0), capacity(N) {
+        *this = other;
+    }
+    ~IndexList() { 
+        if ( capacity > N )
+            delete [] heap; 
+    }
+    /// copy other
+    IndexList& operator=(const IndexList& other) {
+        if ( this != &other ) {
+            reserve( other.count );
+            std::memcpy( data(), other.data(), other.count*sizeof(unsigned int) );
+            count = other.count;
+        }
+        return *this;
+    }
+    /// append id
+    inline void push_back(unsigned int id) {
+        if ( count == capacity )
+            reserve( 2*capacity );
+        data()[count++] = id;
+    }
+    /// remove the last index
+    inline void pop_back() { 
+        assert( count > 0 ); 
+        --count; 
+    }
+    /// the last index
+    inline unsigned int back() const { 
+        assert( count > 0 ); 
+        return data()[count-1]; 
+    }
+    /// remove id by overwriting it with the last index. false if id is not in the list.
+    inline bool erase(unsigned int id) {
+        unsigned int* items = data();
+        for (unsigned int n=0; n<count; ++n) {
+            if ( items[n] == id ) {
+                items[n] = items[--count];
+                return true;
+            }
+        }
+        return false;
+    }
+    /// replace oldId with newId. false if oldId is not in the list.
+    inline bool replace(unsigned int oldId, unsigned int newId) {
+        unsigned int* items = data();
+        for (unsigned int n=0; n<count; ++n) {
+            if ( items[n] == oldId ) {
+                items[n] = newId;
+                return true;
+            }
+        }
+        return false;
+    }
+    /// true if id is in the list
+    bool contains(unsigned int id) const {
+        for (unsigned int n=0; n<count; ++n) {
+            if ( data()[n] == id )
+                return true;
+        }
+        return false;
+    }
+    /// number of indices
+    inline unsigned int size() const { return count; }
+    /// true if the list is empty
+    inline bool empty() const { return count == 0; }
+    /// remove all indices. heap storage is kept.
+    inline void clear() { count = 0; }
+    /// index n
+    inline unsigned int operator[](unsigned int n) const { return data()[n]; }
+    /// pointer to the first index
+    inline const unsigned int* begin() const { return data(); }
+    /// pointer past the last index
+    inline const unsigned int* end() const { return data()+count; }
+    /// bytes held on the heap
+    unsigned int heap_bytes() const { return ( capacity > N ) ? capacity*sizeof(unsigned int) : 0; }
+private:
+    /// make room for n indices
+    void reserve(unsigned int n) {
+        if ( n <= capacity )
+            return;
+        unsigned int* items = new unsigned int[n];
+        std::memcpy( items, data(), count*sizeof(unsigned int) );
+        if ( capacity > N )
+            delete [] heap;
+        heap = items;
+        capacity = n;
+    }
+    inline unsigned int* data() { return ( capacity > N ) ? heap : local; }
+    inline const unsigned int* data() const { return ( capacity > N ) ? heap : local; }
+    /// number of indices
+    unsigned int count;
+    /// room for this many indices, in local or on the heap
+    unsigned int capacity;
+    union {
+        /// the indices, when capacity is more than N
+        unsigned int* heap;
+        /// the indices, when capacity is N
+        unsigned int local[N];
+    };
+};
+
+} // end namespace
+#endif
+// end file index_list.hpp
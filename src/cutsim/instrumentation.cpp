@@ -0,0 +1,288 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+
+#include <boost/foreach.hpp>
+
+#include "instrumentation.hpp"
+
+namespace cutsim {
+
+// the registry is created on first use, since Stages and Counters are static 
+// objects in other files, constructed in an unspecified order.
+static std::vector<Stage*>& stage_registry() {
+    static std::vector<Stage*> registry;
+    return registry;
+}
+
+static std::vector<Counter*>& counter_registry() {
+    static std::vector<Counter*> registry;
+    return registry;
+}
+
+/// a call recorded between start_trace() and stop_trace()
+struct TraceEvent {
+    const Stage* stage;
+    long long start;
+    long long ns;
+    int thread;
+};
+
+static std::vector<TraceEvent> trace_buffer;
+static unsigned int trace_next = 0; // the next free slot in trace_buffer
+static bool tracing = false;
+static long long trace_origin = 0; // time of start_trace()
+static int thread_count = 0;
+static __thread int thread_id = -1; // numbers the threads in the order they record their first event
+
+//**************** Stage ********************/
+
+Stage::Stage(const char* name) : stage_name(name) {
+    reset();
+    stage_registry().push_back( this );
+}
+
+void Stage::record(long long start, long long ns) {
+    if ( ns < 0 )
+        ns = 0;
+    unsigned long long t = (unsigned long long)ns;
+    unsigned int n = ( t > 1 ) ? 63 - __builtin_clzll( t ) : 0; // floor(log2(t))
+    if ( n >= BUCKETS )
+        n = BUCKETS-1;
+    #pragma omp atomic
+    calls++;
+    #pragma omp atomic
+    total_ns += t;
+    #pragma omp atomic
+    buckets[n]++;
+    if ( t > max_ns ) {
+        #pragma omp critical (cutsim_stage_max)
+        {
+            if ( t > max_ns )
+                max_ns = t;
+        }
+    }
+    if ( tracing )
+        Instrumentation::trace_event( this, start, ns );
+}
+
+double Stage::percentile(double p) const {
+    if ( calls == 0 )
+        return 0.0;
+    unsigned long long sum = 0;
+    for (unsigned int n=0; n<BUCKETS; ++n) {
+        sum += buckets[n];
+        if ( sum >= p*calls )
+            return (double)( 2ull << n );
+    }
+    return (double)max_ns;
+}
+
+void Stage::reset() {
+    calls = 0;
+    total_ns = 0;
+    max_ns = 0;
+    for (unsigned int n=0; n<BUCKETS; ++n)
+        buckets[n] = 0;
+}
+
+//**************** Counter ********************/
+
+Counter::Counter(const char* name) : counter_name(name), count(0) {
+    counter_registry().push_back( this );
+}
+
+void Counter::add(unsigned long long n) {
+    #pragma omp atomic
+    count += n;
+}
+
+//**************** ScopedTimer ********************/
+
+ScopedTimer::ScopedTimer(Stage& s) : stage(s) {
+    start = Instrumentation::now();
+}
+
+ScopedTimer::~ScopedTimer() {
+    stage.record( start, Instrumentation::now() - start );
+}
+
+//**************** Instrumentation ********************/
+
+bool Instrumentation::enabled() {
+#ifdef CUTSIM_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
+
+long long Instrumentation::now() {
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return 1000000000LL*t.tv_sec + t.tv_nsec;
+}
+
+void Instrumentation::reset() {
+    BOOST_FOREACH( Stage* s, stage_registry() ) {
+        s->reset();
+    }
+    BOOST_FOREACH( Counter* c, counter_registry() ) {
+        c->reset();
+    }
+}
+
+const std::vector<Stage*>& Instrumentation::stages() {
+    return stage_registry();
+}
+
+const std::vector<Counter*>& Instrumentation::counters() {
+    return counter_registry();
+}
+
+void Instrumentation::start_trace(unsigned int max_events) {
+    trace_buffer.resize( max_events );
+    trace_next = 0;
+    trace_origin = now();
+    tracing = true;
+}
+
+void Instrumentation::stop_trace() {
+    tracing = false;
+}
+
+void Instrumentation::trace_event(const Stage* stage, long long start, long long ns) {
+    if ( thread_id < 0 ) {
+        #pragma omp atomic capture
+        thread_id = thread_count++;
+    }
+    unsigned int slot;
+    #pragma omp atomic capture
+    slot = trace_next++;
+    if ( slot >= trace_buffer.size() ) { // full, keep trace_next from wrapping around
+        #pragma omp atomic write
+        trace_next = trace_buffer.size();
+        return;
+    }
+    TraceEvent& e = trace_buffer[slot];
+    e.stage = stage;
+    e.start = start;
+    e.ns = ns;
+    e.thread = thread_id;
+}
+
+unsigned int Instrumentation::trace_events() {
+    return ( trace_next < trace_buffer.size() ) ? trace_next : trace_buffer.size();
+}
+
+std::string Instrumentation::json() {
+    std::ostringstream o;
+    o << "{\n";
+    o << "  \"enabled\": " << ( enabled() ? "true" : "false" ) << ",\n";
+    o << "  \"stages\": [";
+    bool first = true;
+    BOOST_FOREACH( const Stage* s, stage_registry() ) {
+        o << ( first ? "\n" : ",\n" );
+        first = false;
+        char line[512];
+        double mean = s->count() ? (double)s->total()/s->count() : 0.0;
+        snprintf(line, sizeof(line), "    { \"name\": \"%s\", \"count\": %llu, \"total_ms\": %.4f, \"mean_us\": %.4f, "
+                                     "\"max_us\": %.4f, \"p50_us\": %.4f, \"p90_us\": %.4f, \"p99_us\": %.4f,\n",
+                 s->name(), s->count(), 1e-6*s->total(), 1e-3*mean, 1e-3*s->max(),
+                 1e-3*s->percentile(0.5), 1e-3*s->percentile(0.9), 1e-3*s->percentile(0.99) );
+        o << line;
+        // the histogram as [lower limit in ns, count] for the non-empty buckets
+        o << "      \"histogram\": [";
+        bool first_bucket = true;
+        for (unsigned int n=0; n<Stage::BUCKETS; ++n) {
+            if ( s->bucket(n) == 0 )
+                continue;
+            o << ( first_bucket ? "" : ", " ) << "[" << ( n ? 1ull << n : 0ull ) << ", " << s->bucket(n) << "]";
+            first_bucket = false;
+        }
+        o << "] }";
+    }
+    o << "\n  ],\n";
+    o << "  \"counters\": [";
+    first = true;
+    BOOST_FOREACH( const Counter* c, counter_registry() ) {
+        o << ( first ? "\n" : ",\n" );
+        first = false;
+        o << "    { \"name\": \"" << c->name() << "\", \"value\": " << c->value() << " }";
+    }
+    o << "\n  ]\n";
+    o << "}\n";
+    return o.str();
+}
+
+std::string Instrumentation::trace() {
+    std::ostringstream o;
+    o << "{ \"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    unsigned int n = trace_events();
+    for (unsigned int i=0; i<n; ++i) {
+        const TraceEvent& e = trace_buffer[i];
+        char line[256];
+        // complete events, with time-stamp and duration in microseconds
+        snprintf(line, sizeof(line), "%s\n{ \"name\": \"%s\", \"cat\": \"cutsim\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d }",
+                 i ? "," : "", e.stage->name(), 1e-3*( e.start - trace_origin ), 1e-3*e.ns, e.thread );
+        o << line;
+    }
+    o << "\n] }\n";
+    return o.str();
+}
+
+static bool write_file(const std::string& path, const std::string& text) {
+    FILE* out = fopen( path.c_str(), "w" );
+    if ( !out )
+        return false;
+    bool ok = ( fwrite( text.data(), 1, text.size(), out ) == text.size() );
+    return ( fclose(out) == 0 ) && ok;
+}
+
+bool Instrumentation::write_json(const std::string& path) {
+    return write_file( path, json() );
+}
+
+bool Instrumentation::write_trace(const std::string& path) {
+    return write_file( path, trace() );
+}
+
+std::string Instrumentation::str() {
+    std::ostringstream o;
+    BOOST_FOREACH( const Stage* s, stage_registry() ) {
+        if ( s->count() == 0 )
+            continue;
+        char line[256];
+        snprintf(line, sizeof(line), " %-24s %10llu calls %10.3f ms  mean %9.3f us  max %9.3f us\n",
+                 s->name(), s->count(), 1e-6*s->total(), 1e-3*s->total()/s->count(), 1e-3*s->max() );
+        o << line;
+    }
+    BOOST_FOREACH( const Counter* c, counter_registry() ) {
+        if ( c->value() == 0 )
+            continue;
+        o << " " << c->name() << " " << c->value() << "\n";
+    }
+    return o.str();
+}
+
+} // end namespace
+// end of file instrumentation.cpp
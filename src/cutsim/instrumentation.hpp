@@ -0,0 +1,165 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <string>
+#include <vector>
+
+namespace cutsim {
+
+/// \class Stage
+/// the wall-clock latency of one hot-path stage, e.g. Octree::diff() or Octnode::subdivide().
+///
+/// record() counts the call, adds to the total and maximum times, and to a histogram
+/// where bucket n holds the calls that took [2^n, 2^(n+1)) nanoseconds.
+/// Stages are static objects in the file that times them, and register themselves
+/// with Instrumentation when they are constructed. record() may be called from several threads.
+class Stage {
+public:
+    /// number of histogram buckets
+    enum { BUCKETS = 40 };
+    /// create and register a stage, name is e.g. "octree.diff"
+    Stage(const char* name);
+    /// record a call which started at time start and took ns nanoseconds, see Instrumentation::now()
+    void record(long long start, long long ns);
+    /// the name of this stage
+    const char* name() const { return stage_name; }
+    /// number of calls recorded
+    unsigned long long count() const { return calls; }
+    /// total time of the calls, in nanoseconds
+    unsigned long long total() const { return total_ns; }
+    /// the longest call, in nanoseconds
+    unsigned long long max() const { return max_ns; }
+    /// number of calls in histogram bucket n
+    unsigned long long bucket(unsigned int n) const { return buckets[n]; }
+    /// the time, in nanoseconds, within which fraction p of the calls ran. 
+    /// this is the upper limit of a histogram bucket, so it is at most a factor two too large.
+    double percentile(double p) const;
+    /// forget all calls
+    void reset();
+private:
+    const char* stage_name;
+    unsigned long long calls;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long buckets[BUCKETS];
+
+    Stage(const Stage&);
+    Stage& operator=(const Stage&);
+};
+
+/// \class Counter
+/// a named event count, e.g. the number of Volume::dist() evaluations.
+/// like Stage, Counters are static objects which register themselves with Instrumentation.
+class Counter {
+public:
+    /// create and register a counter
+    Counter(const char* name);
+    /// add n to the count, may be called from several threads
+    void add(unsigned long long n);
+    /// the name of this counter
+    const char* name() const { return counter_name; }
+    /// the count
+    unsigned long long value() const { return count; }
+    /// set the count to zero
+    void reset() { count = 0; }
+private:
+    const char* counter_name;
+    unsigned long long count;
+
+    Counter(const Counter&);
+    Counter& operator=(const Counter&);
+};
+
+/// records the time from construction to destruction in a Stage
+class ScopedTimer {
+public:
+    /// start timing
+    ScopedTimer(Stage& s);
+    /// record the time since construction in the Stage
+    ~ScopedTimer();
+private:
+    Stage& stage;
+    long long start;
+
+    ScopedTimer(const ScopedTimer&);
+    ScopedTimer& operator=(const ScopedTimer&);
+};
+
+/// \class Instrumentation
+/// the registry of all Stages and Counters, and output of them as JSON or as a Chrome trace.
+///
+/// the library times its stages only when built with CUTSIM_INSTRUMENTATION defined
+/// (cmake -DENABLE_INSTRUMENTATION=ON). Otherwise the CUTSIM_TIMER() and CUTSIM_COUNT() 
+/// macros expand to nothing, and all Stages and Counters stay at zero.
+///
+/// between start_trace() and stop_trace() each recorded call is also stored as a
+/// trace event, up to a maximum number. trace() returns these in the Chrome
+/// trace-event format, which chrome://tracing and Perfetto display as a timeline.
+class Instrumentation {
+public:
+    /// true if the library was built with CUTSIM_INSTRUMENTATION
+    static bool enabled();
+    /// nanoseconds from a monotonic clock
+    static long long now();
+    /// set all Stages and Counters to zero
+    static void reset();
+    /// the registered Stages
+    static const std::vector<Stage*>& stages();
+    /// the registered Counters
+    static const std::vector<Counter*>& counters();
+    
+    /// start storing trace events, at most max_events of them. earlier events are discarded.
+    /// call this when no operation is running.
+    static void start_trace(unsigned int max_events = 1u<<20);
+    /// stop storing trace events, the stored events are kept for trace()
+    static void stop_trace();
+    /// store a trace event, called by Stage::record()
+    static void trace_event(const Stage* stage, long long start, long long ns);
+    /// number of trace events stored
+    static unsigned int trace_events();
+    
+    /// the Stages and Counters as JSON
+    static std::string json();
+    /// the trace events in the Chrome trace-event format
+    static std::string trace();
+    /// write json() to the file path, false if that fails
+    static bool write_json(const std::string& path);
+    /// write trace() to the file path, false if that fails
+    static bool write_trace(const std::string& path);
+    /// string output, one line for each Stage and Counter that recorded something
+    static std::string str();
+};
+
+} // end namespace
+
+#ifdef CUTSIM_INSTRUMENTATION
+/// time the rest of the enclosing scope in the given Stage
+#define CUTSIM_TIMER(stage) cutsim::ScopedTimer cutsim_scoped_timer( stage )
+/// add n to the given Counter
+#define CUTSIM_COUNT(counter, n) (counter).add( n )
+#else
+#define CUTSIM_TIMER(stage)
+#define CUTSIM_COUNT(counter, n)
+#endif
+
+#endif
+// end file instrumentation.hpp
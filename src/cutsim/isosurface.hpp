@@ -46,15 +46,32 @@ public:
         //update_calls=0;
         //valid_count=0;
         //debugValid();
+        tree->flush(); // the deferred operations, see Octree::set_lazy()
         updateGL( tree->root );
         //debugValid();
         
         //std::cout << update_calls << " calls made\n";
         //std::cout << valid_count << " valid_nodes\n";
     }
+    /// update GLData, only for the invalid nodes which overlap region
+    virtual void updateGL( const Bbox& region ) {
+        tree->flush( region );
+        updateGL( tree->root, region );
+    }
 protected:
     /// update the GLData for the given Octnode. re-implement in sub-class
     virtual void updateGL( Octnode* node) =0 ;
+    /// find the invalid nodes below node which overlap region, and update them with updateGL(Octnode*)
+    void updateGL( Octnode* node, const Bbox& region ) {
+        if ( node->valid() || !node->bb().overlaps( region ) )
+            return;
+        if ( node->childcount == 8 ) {
+            for (unsigned int m=0;m<8;m++)
+                updateGL( node->child(m), region );
+        } else {
+            updateGL( node );
+        }
+    }
     /// when the given Octnode is deleted all associated GLData vertices are removed here.
     void remove_node_vertices(Octnode* current ) {
         while( !current->vertexSetEmpty() ) {
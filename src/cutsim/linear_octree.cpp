@@ -0,0 +1,338 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include <boost/foreach.hpp>
+
+#include "linear_octree.hpp"
+#include "morton.hpp"
+#include "volume.hpp"
+
+namespace cutsim {
+
+// ( Octnode::direction[n] + (1,1,1) )/2
+const boost::uint32_t LinearOctree::corner_offset[8][3] = {
+    {1,1,0}, {0,1,0}, {0,0,0}, {1,0,0},
+    {1,1,1}, {0,1,1}, {0,0,1}, {1,0,1}
+};
+
+// children are numbered by their Morton octant x + 2*y + 4*z
+const unsigned int LinearOctree::corner_child[8] = { 3, 2, 0, 1, 7, 6, 4, 5 };
+
+// sort order of leaves
+static bool code_less(const LinearOctnode& a, const LinearOctnode& b) {
+    return a.code < b.code;
+}
+
+LinearOctree::LinearOctree(double scale, unsigned int depth, const GLVertex& centerp) {
+    assert( depth <= 20 ); // lattice coordinates must fit in a 64-bit Morton code
+    root_scale = scale;
+    max_depth = depth;
+    center = centerp;
+    set_lattice();
+    LinearOctnode root;
+    root.code = 0;
+    root.depth = 0;
+    root.state = Octnode::OUTSIDE;
+    for (int n=0;n<8;++n)
+        root.f[n] = -1;
+    nodes.push_back(root);
+}
+
+void LinearOctree::set_lattice() {
+    origin = center - GLVertex(root_scale, root_scale, root_scale);
+    unit = root_scale / pow(2.0, (int)max_depth-1);
+    samples.set_lattice( origin, unit, max_depth );
+}
+
+void LinearOctree::init(const unsigned int n) {
+    for (unsigned int m=0;m<n;++m) {
+        std::vector<LinearOctnode> out;
+        out.reserve( 8*nodes.size() );
+        BOOST_FOREACH( const LinearOctnode& node, nodes ) {
+            if ( node.depth+1u >= max_depth ) {
+                out.push_back(node);
+                continue;
+            }
+            boost::uint32_t h = side(node.depth+1);
+            for (unsigned int c=0;c<8;++c) {
+                LinearOctnode child = node;
+                child.code = node.code | morton_encode( (c&1)*h, ((c>>1)&1)*h, ((c>>2)&1)*h );
+                child.depth = node.depth+1;
+                out.push_back(child);
+            }
+        }
+        nodes.swap(out);
+    }
+}
+
+GLVertex LinearOctree::corner(const LinearOctnode& node, int n) const {
+    boost::uint32_t x,y,z;
+    morton_decode(node.code, x, y, z);
+    boost::uint32_t s = side(node.depth);
+    return GLVertex( origin.x + unit*( x + corner_offset[n][0]*s ),
+                     origin.y + unit*( y + corner_offset[n][1]*s ),
+                     origin.z + unit*( z + corner_offset[n][2]*s ) );
+}
+
+void LinearOctree::apply(const Volume* vol, Operation op) {
+    samples.clear();
+    // all leaves overlapping vol->bb lie between the leaf containing the minimum corner
+    // of the bb and the leaf containing the maximum corner, in Morton order.
+    // the bb is grown by one lattice cell so that leaves touching it are included.
+    Iterator first = nodes.begin();
+    Iterator last = nodes.end();
+    if ( op != INTERSECT ) { // intersect changes everything outside vol
+        double lim = pow(2.0, (int)max_depth) - 1;
+        LinearOctnode lo, hi;
+        lo.code = morton_encode( (boost::uint32_t) std::max( 0.0, std::min( lim, floor( (vol->bb.minpt.x-origin.x)/unit )-1 ) ),
+                                 (boost::uint32_t) std::max( 0.0, std::min( lim, floor( (vol->bb.minpt.y-origin.y)/unit )-1 ) ),
+                                 (boost::uint32_t) std::max( 0.0, std::min( lim, floor( (vol->bb.minpt.z-origin.z)/unit )-1 ) ) );
+        hi.code = morton_encode( (boost::uint32_t) std::max( 0.0, std::min( lim, floor( (vol->bb.maxpt.x-origin.x)/unit )+1 ) ),
+                                 (boost::uint32_t) std::max( 0.0, std::min( lim, floor( (vol->bb.maxpt.y-origin.y)/unit )+1 ) ),
+                                 (boost::uint32_t) std::max( 0.0, std::min( lim, floor( (vol->bb.maxpt.z-origin.z)/unit )+1 ) ) );
+        first = std::upper_bound( nodes.begin(), nodes.end(), lo, code_less );
+        if ( first != nodes.begin() )
+            --first; // the leaf containing the minimum corner
+        last = std::upper_bound( first, nodes.end(), hi, code_less );
+    }
+    std::vector<LinearOctnode> out;
+    out.reserve( last-first );
+    traverse( first, last, 0, 0, vol, op, out );
+    // replace the range [first,last) with out, moving the tail of the array at most once
+    std::size_t begin = first-nodes.begin();
+    std::size_t n_old = last-first;
+    if ( out.size() > n_old ) {
+        std::copy( out.begin(), out.begin()+n_old, first );
+        nodes.insert( nodes.begin()+begin+n_old, out.begin()+n_old, out.end() );
+    } else {
+        std::copy( out.begin(), out.end(), first );
+        nodes.erase( nodes.begin()+begin+out.size(), nodes.begin()+begin+n_old );
+    }
+}
+
+void LinearOctree::traverse(Iterator first, Iterator last, boost::uint64_t code, unsigned int depth,
+                            const Volume* vol, Operation op, std::vector<LinearOctnode>& out) {
+    if ( first == last )
+        return;
+    if ( first->depth == depth ) { // this cell is a leaf
+        assert( last-first == 1 );
+        apply( *first, vol, op, out );
+        return;
+    }
+    if ( op != INTERSECT && !overlaps(code, depth, vol->bb) ) { // nothing in this cell changes
+        out.insert( out.end(), first, last );
+        return;
+    }
+    // split [first,last) into the ranges of the eight child cells
+    boost::uint32_t h = side(depth+1);
+    for (unsigned int c=0;c<8;++c) {
+        boost::uint64_t child_code = code | morton_encode( (c&1)*h, ((c>>1)&1)*h, ((c>>2)&1)*h );
+        Iterator end = last;
+        if ( c < 7 ) {
+            LinearOctnode next;
+            next.code = code | morton_encode( ((c+1)&1)*h, (((c+1)>>1)&1)*h, (((c+1)>>2)&1)*h );
+            end = std::lower_bound( first, last, next, code_less );
+        }
+        traverse( first, end, child_code, depth+1, vol, op, out );
+        first = end;
+    }
+}
+
+bool LinearOctree::overlaps(boost::uint64_t code, unsigned int depth, const Bbox& bb) const {
+    boost::uint32_t x,y,z;
+    morton_decode(code, x, y, z);
+    double s = unit*side(depth);
+    double minx = origin.x + unit*x;
+    double miny = origin.y + unit*y;
+    double minz = origin.z + unit*z;
+    return !( (minx+s < bb.minpt.x) || (minx > bb.maxpt.x) ||
+              (miny+s < bb.minpt.y) || (miny > bb.maxpt.y) ||
+              (minz+s < bb.minpt.z) || (minz > bb.maxpt.z) );
+}
+
+void LinearOctree::apply(LinearOctnode node, const Volume* vol, Operation op, std::vector<LinearOctnode>& out) {
+    boost::uint32_t x,y,z;
+    morton_decode(node.code, x, y, z);
+    boost::uint32_t s = side(node.depth);
+    if ( op == INTERSECT ) {
+        if ( node.state == Octnode::OUTSIDE ) {
+            append(node, out);
+            return;
+        }
+    } else {
+        if ( ( op == SUM  && node.state == Octnode::INSIDE ) || 
+             ( op == DIFF && node.state == Octnode::OUTSIDE ) ) {
+            append(node, out);
+            return;
+        }
+        if ( !overlaps(node.code, node.depth, vol->bb) ) { // node does not change
+            append(node, out);
+            return;
+        }
+    }
+    
+    bool inside = true;
+    bool outside = true;
+    GLVertex p[8];
+    boost::uint64_t keys[8];
+    for (int n=0;n<8;++n) {
+        boost::uint32_t cx = x + corner_offset[n][0]*s;
+        boost::uint32_t cy = y + corner_offset[n][1]*s;
+        boost::uint32_t cz = z + corner_offset[n][2]*s;
+        p[n] = GLVertex( origin.x + unit*cx, origin.y + unit*cy, origin.z + unit*cz );
+        keys[n] = morton_encode(cx,cy,cz);
+    }
+    double dist[8];
+    samples.dist( vol, p, keys, dist, 8 ); // all eight corners in one batch
+    for (int n=0;n<8;++n) {
+        double d = dist[n];
+        // same rules as Octnode::sum(), Octnode::diff(), and Octnode::intersect()
+        if (op == SUM) {
+            if ( d > node.f[n] )
+                node.color = vol->color;
+            node.f[n] = std::max<double>( node.f[n], d );
+        } else if (op == DIFF) {
+            if ( -d < node.f[n] )
+                node.color = vol->color;
+            node.f[n] = std::min<double>( node.f[n], -d );
+        } else {
+            if ( d < node.f[n] )
+                node.color = vol->color;
+            node.f[n] = std::min<double>( node.f[n], d );
+        }
+        if ( node.f[n] >= 0.0 )
+            outside = false;
+        else
+            inside = false;
+    }
+    unsigned char prev_state = node.state;
+    node.state = inside ? Octnode::INSIDE : ( outside ? Octnode::OUTSIDE : Octnode::UNDECIDED );
+    
+    if ( node.state != Octnode::UNDECIDED || node.depth+1u >= max_depth ) {
+        append(node, out);
+        return;
+    }
+    // subdivide. As in Octnode, new children are in the state the node was in before the operation
+    boost::uint32_t h = side(node.depth+1);
+    LinearOctnode child;
+    child.depth = node.depth+1;
+    child.color = node.color;
+    child.state = ( prev_state == Octnode::INSIDE ) ? Octnode::INSIDE : Octnode::OUTSIDE;
+    for (int n=0;n<8;++n)
+        child.f[n] = ( child.state == Octnode::INSIDE ) ? 1 : -1;
+    for (unsigned int c=0;c<8;++c) {
+        child.code = node.code | morton_encode( (c&1)*h, ((c>>1)&1)*h, ((c>>2)&1)*h );
+        apply( child, vol, op, out );
+    }
+}
+
+void LinearOctree::append(const LinearOctnode& node, std::vector<LinearOctnode>& out) const {
+    out.push_back(node);
+    while ( out.size() >= 8 ) {
+        const LinearOctnode& last = out.back();
+        if ( last.depth == 0 || last.state == Octnode::UNDECIDED )
+            return;
+        // siblings have the same code above the bits of their own level
+        unsigned int shift = 3*(max_depth - last.depth + 1);
+        boost::uint64_t prefix = last.code >> shift;
+        std::size_t first = out.size()-8;
+        for (std::size_t m=first; m<out.size()-1; ++m) {
+            if ( out[m].depth != last.depth || out[m].state != last.state || (out[m].code >> shift) != prefix )
+                return;
+        }
+        // the eight children of one node, all inside or all outside. merge.
+        LinearOctnode parent;
+        parent.code = prefix << shift;
+        parent.depth = last.depth-1;
+        parent.state = last.state;
+        parent.color = last.color;
+        for (int n=0;n<8;++n)
+            parent.f[n] = out[ first + corner_child[n] ].f[n];
+        out.resize( first );
+        out.push_back( parent );
+    }
+}
+
+// binary format: magic, version, root_scale, max_depth, center, number of leaves, leaves.
+// native byte-order.
+static const char linear_octree_magic[4] = {'L','O','C','T'};
+static const boost::uint32_t linear_octree_version = 2; // version 2 stores the distances as floats
+
+void LinearOctree::write(std::ostream& stream) const {
+    boost::uint64_t count = nodes.size();
+    stream.write( linear_octree_magic, 4 );
+    stream.write( (const char*)&linear_octree_version, sizeof(linear_octree_version) );
+    stream.write( (const char*)&root_scale, sizeof(root_scale) );
+    stream.write( (const char*)&max_depth, sizeof(max_depth) );
+    stream.write( (const char*)&center.x, sizeof(center.x) );
+    stream.write( (const char*)&center.y, sizeof(center.y) );
+    stream.write( (const char*)&center.z, sizeof(center.z) );
+    stream.write( (const char*)&count, sizeof(count) );
+    if ( count )
+        stream.write( (const char*)&nodes[0], count*sizeof(LinearOctnode) );
+}
+
+bool LinearOctree::read(std::istream& stream) {
+    char magic[4];
+    boost::uint32_t version;
+    boost::uint64_t count;
+    stream.read( magic, 4 );
+    stream.read( (char*)&version, sizeof(version) );
+    if ( !stream || memcmp(magic, linear_octree_magic, 4) != 0 || version != linear_octree_version )
+        return false;
+    stream.read( (char*)&root_scale, sizeof(root_scale) );
+    stream.read( (char*)&max_depth, sizeof(max_depth) );
+    stream.read( (char*)&center.x, sizeof(center.x) );
+    stream.read( (char*)&center.y, sizeof(center.y) );
+    stream.read( (char*)&center.z, sizeof(center.z) );
+    stream.read( (char*)&count, sizeof(count) );
+    if ( !stream )
+        return false;
+    nodes.resize( count );
+    if ( count )
+        stream.read( (char*)&nodes[0], count*sizeof(LinearOctnode) );
+    set_lattice();
+    return !stream.fail();
+}
+
+std::string LinearOctree::str() const {
+    std::ostringstream o;
+    o << " LinearOctree: " << nodes.size() << " leaf-nodes, " 
+      << nodes.size()*sizeof(LinearOctnode)/1024 << " kB (" << sizeof(LinearOctnode) << " bytes/leaf)\n";
+    std::vector<int> leaves(max_depth);
+    std::vector<int> surface(max_depth);
+    BOOST_FOREACH( const LinearOctnode& n, nodes ) {
+        ++leaves[n.depth];
+        if ( n.state == Octnode::UNDECIDED )
+            ++surface[n.depth];
+    }
+    for (unsigned int m=0;m<max_depth;++m)
+        o << "depth="<<m <<"  " << leaves[m] << " leaves, surface=" << surface[m] << " \n";
+    o << samples.str();
+    return o.str();
+}
+
+} // end namespace
+// end of file linear_octree.cpp
@@ -0,0 +1,144 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LINEAR_OCTREE_H
+#define LINEAR_OCTREE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "bbox.hpp"
+#include "glvertex.hpp"
+#include "octnode.hpp"
+#include "distance_cache.hpp"
+
+namespace cutsim {
+
+class Volume;
+
+/// a leaf of the LinearOctree
+struct LinearOctnode {
+    /// Morton code of the minimum corner of this node, in lattice units
+    boost::uint64_t code;
+    /// value of distance-field at corner vertex, corners numbered as in Octnode
+    float f[8];
+    /// the color of this node
+    Color color;
+    /// the tree-depth of this node
+    unsigned char depth;
+    /// the state of this node, one of Octnode::NodeState
+    unsigned char state;
+};
+
+/// Linear (pointerless) octree.
+///
+/// Only the leaf nodes are stored, in one flat array sorted by the Morton code
+/// of their minimum corner. Sorting by Morton code is the same as a depth-first
+/// traversal of the pointer-based Octree, so each boolean operation is a single
+/// forward scan which writes a new array: leaves that the Volume overlaps are
+/// subdivided in place, and complete families of eight siblings with the same
+/// inside/outside state are merged back into their parent.
+///
+/// The leaves use the same lattice as the DistanceCache: a node at depth d has
+/// side-length 2^(max_depth-d) lattice units. max_depth can be at most 20.
+///
+/// Since the whole stock is one array it can be copied by value, or written to
+/// and read from a stream with write() and read().
+class LinearOctree {
+    public:
+        /// create an octree with a root node with scale=root_scale, maximum
+        /// tree-depth of max_depth and centered at centerp.
+        LinearOctree(double root_scale, unsigned int max_depth, const GLVertex& centerPoint);
+        virtual ~LinearOctree() {}
+        
+    // bolean operations on tree
+        /// diff given Volume from tree
+        void diff(const Volume* vol) { apply( vol, DIFF ); }
+        /// sum given Volume to tree
+        void sum(const Volume* vol) { apply( vol, SUM ); }
+        /// intersect tree with given Volume
+        void intersect(const Volume* vol) { apply( vol, INTERSECT ); }
+        
+        /// subdivide all leaves n times
+        void init(const unsigned int n);
+        /// the leaf nodes, sorted by Morton code
+        const std::vector<LinearOctnode>& leaves() const { return nodes; }
+        /// return corner vertex n of the given leaf
+        GLVertex corner(const LinearOctnode& node, int n) const;
+        /// return max depth
+        unsigned int get_max_depth() const { return max_depth; }
+        /// return the maximum cube side-length, (i.e. at depth=0)
+        double get_root_scale() const { return root_scale; }
+        /// write the tree to a binary stream
+        void write(std::ostream& stream) const;
+        /// read a tree written by write(). returns false if the stream does not contain a tree.
+        bool read(std::istream& stream);
+        /// string output
+        std::string str() const;
+    protected:
+        /// the boolean operations
+        enum Operation { SUM, DIFF, INTERSECT };
+        /// iterator into the leaves
+        typedef std::vector<LinearOctnode>::iterator Iterator;
+        /// apply the operation to all leaves
+        void apply(const Volume* vol, Operation op);
+        /// apply the operation to the leaves [first,last) inside the cell with given code and depth, 
+        /// skipping cells which vol does not overlap. The resulting leaves are appended to out.
+        void traverse(Iterator first, Iterator last, boost::uint64_t code, unsigned int depth,
+                      const Volume* vol, Operation op, std::vector<LinearOctnode>& out);
+        /// true if the cell with given code and depth overlaps bb
+        bool overlaps(boost::uint64_t code, unsigned int depth, const Bbox& bb) const;
+        /// apply the operation to node, and append the resulting leaves to out
+        void apply(LinearOctnode node, const Volume* vol, Operation op, std::vector<LinearOctnode>& out);
+        /// append node to out, and merge the last eight entries of out into their parent if possible
+        void append(const LinearOctnode& node, std::vector<LinearOctnode>& out) const;
+        /// side-length of a node at given depth, in lattice units
+        boost::uint32_t side(unsigned int depth) const { return 1u << (max_depth-depth); }
+        /// set the lattice of the DistanceCache
+        void set_lattice();
+        
+    // DATA
+        /// the root scale, i.e. half the side-length of depth=0 cube
+        double root_scale;
+        /// the maximum tree-depth
+        unsigned int max_depth;
+        /// center of the root node
+        GLVertex center;
+        /// minimum corner of the root node
+        GLVertex origin;
+        /// lattice spacing, i.e. half the side-length of the smallest node
+        double unit;
+        /// the leaves, sorted by Morton code
+        std::vector<LinearOctnode> nodes;
+        /// distance samples at corner vertices, shared during one operation
+        DistanceCache samples;
+        /// corner n of a node is at the minimum corner plus corner_offset[n] times the side-length
+        static const boost::uint32_t corner_offset[8][3];
+        /// corner n of a node is corner n of child corner_child[n]
+        static const unsigned int corner_child[8];
+    private:
+        LinearOctree() {  }
+};
+
+} // end namespace
+#endif
+// end file linear_octree.hpp
@@ -17,119 +17,415 @@
  *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cmath>
+
 #include "marching_cubes.hpp"
+#include "instrumentation.hpp"
 
 namespace cutsim {
 
+static Stage update_stage("mc.update_gl");
+static Stage node_stage("mc.node");
+
+void MarchingCubes::updateGL() {
+    CUTSIM_TIMER( update_stage );
+    remeshed = 0;
+    dirty_count = 0;
+    rebuilt = 0;
+    if (!linear_tree) {
+        tree->flush(); // the deferred operations, see Octree::set_lazy()
+        std::vector<Octnode*> nodes;
+        if ( chunk_depth ) {
+            std::vector<boost::uint64_t> cells;
+            tree->take_dirty( nodes );
+            if ( full_update ) {
+                collect_cells( tree->root, cells );
+                full_update = false;
+            } else {
+                dirty_cells( nodes, cells );
+            }
+            rebuild_chunks( cells );
+        } else if ( full_update ) { // the nodes changed before we were created are not in the dirty list
+            IsoSurfaceAlgorithm::updateGL();
+            tree->take_dirty( nodes ); // all done by the traversal
+            full_update = false;
+        } else {
+            tree->take_dirty( nodes );
+            update_nodes( nodes );
+        }
+        g->updateNormals();
+        total_remeshed += remeshed;
+        return;
+    }
+    g->clear();
+    GLVertex corners[8];
+    BOOST_FOREACH( const LinearOctnode& node, linear_tree->leaves() ) {
+        if ( node.state == Octnode::UNDECIDED ) {
+            for (int n=0;n<8;++n)
+                corners[n] = linear_tree->corner(node, n);
+            mc_cube( corners, node.f, node.color, NULL );
+            ++remeshed;
+        }
+    }
+    total_remeshed += remeshed;
+}
+
+void MarchingCubes::updateGL( const Bbox& region ) {
+    if ( linear_tree || full_update ) {
+        updateGL();
+        return;
+    }
+    CUTSIM_TIMER( update_stage );
+    remeshed = 0;
+    rebuilt = 0;
+    std::vector<Octnode*> nodes;
+    tree->flush( region );
+    tree->take_dirty( region, nodes );
+    if ( chunk_depth ) {
+        std::vector<boost::uint64_t> cells;
+        dirty_cells( nodes, cells );
+        rebuild_chunks( cells );
+    } else {
+        update_nodes( nodes );
+    }
+    g->updateNormals();
+    total_remeshed += remeshed;
+}
+
+void MarchingCubes::update_nodes(const std::vector<Octnode*>& nodes) {
+    dirty_count = nodes.size();
+    BOOST_FOREACH( Octnode* node, nodes ) {
+        node->clearVertexSet();
+    }
+    g->flushDeferredRemoval(); // so that the old triangles are not drawn together with the new ones
+    BOOST_FOREACH( Octnode* node, nodes ) {
+        if ( !node->isLeaf() ) // its children are in the list, if they have a surface
+            continue;
+        if ( node->is_undecided() ) {
+            if (shared)
+                mc_node_shared(node);
+            else
+                mc_node(node);
+            ++remeshed;
+        }
+        node->setValid();
+    }
+}
+
 void MarchingCubes::updateGL(Octnode* node) {
     // traverse tree here and call polygonize_node
     if (node->valid())
         return;
     
     if ( node->is_undecided() && node->isLeaf() ) {
-        mc_node(node);
+        if (shared)
+            mc_node_shared(node);
+        else
+            mc_node(node);
         node->setValid();
+        ++remeshed;
     }
     
     // current node done, now recurse into tree.
     if ( node->childcount == 8 ) {
         for (unsigned int m=0;m<8;m++) {
-                if (!node->child[m]->valid())
-                    updateGL( node->child[m] );
+                if (!node->child(m)->valid())
+                    updateGL( node->child(m) );
+        }
+    }
+}
+
+void MarchingCubes::collect_cells(Octnode* node, std::vector<boost::uint64_t>& cells) {
+    if ( !node->is_undecided() )
+        return;
+    if ( node->isLeaf() || node->depth == chunk_depth ) {
+        cells.push_back( cell_key(node) );
+        return;
+    }
+    for (int m=0;m<8;++m)
+        collect_cells( node->child(m), cells );
+}
+
+// a node at or below the chunk depth changes only the chunk of its cell. a larger node
+// changes the chunk at its minimum corner if it is a leaf, and all chunks inside it,
+// from which the leaves may have been pruned.
+void MarchingCubes::dirty_cells(const std::vector<Octnode*>& nodes, std::vector<boost::uint64_t>& cells) {
+    dirty_count = nodes.size();
+    BOOST_FOREACH( Octnode* node, nodes ) {
+        if ( node->depth >= chunk_depth || node->isLeaf() )
+            cells.push_back( cell_key(node) );
+        if ( node->depth >= chunk_depth )
+            continue;
+        BOOST_FOREACH( boost::uint64_t cell, cell_of_chunk ) {
+            if ( !cell )
+                continue;
+            GLVertex center = cell_center( cell );
+            if ( node->bb().isInside( center ) )
+                cells.push_back( cell );
+        }
+    }
+}
+
+void MarchingCubes::rebuild_chunks(std::vector<boost::uint64_t>& cells) {
+    std::sort( cells.begin(), cells.end() );
+    cells.erase( std::unique( cells.begin(), cells.end() ), cells.end() );
+    BOOST_FOREACH( boost::uint64_t cell, cells ) {
+        unsigned int chunk = chunk_of_cell.find( cell );
+        if ( chunk != VertexMap::NOT_FOUND )
+            g->clearChunk( chunk );
+        chunk_vertices.clear();
+        mesh_cell( cell, chunk );
+        if ( chunk == VertexMap::NOT_FOUND ) // no surface, before or after
+            continue;
+        if ( chunk_vertices.size() == 0 ) { // the surface was cut away
+            g->removeChunk( chunk );
+            chunk_of_cell.erase( cell );
+            cell_of_chunk[chunk] = 0;
+        } else {
+            g->updateChunkNormals( chunk );
+        }
+        ++rebuilt;
+    }
+}
+
+void MarchingCubes::mesh_cell(boost::uint64_t cell, unsigned int& chunk) {
+    GLVertex p = cell_center( cell );
+    Octnode* node = tree->root;
+    while ( node->depth < chunk_depth && !node->isLeaf() ) { // go down to the child that contains p
+        for (int m=0;m<8;++m) {
+            if ( node->child(m)->bb().isInside( p ) ) {
+                node = node->child(m);
+                break;
+            }
         }
     }
+    if ( node->depth < chunk_depth && cell_key(node) != cell ) 
+        return; // a larger leaf, which belongs to the chunk at its minimum corner
+    mesh_subtree( node, cell, chunk );
+}
+
+void MarchingCubes::mesh_subtree(Octnode* node, boost::uint64_t cell, unsigned int& chunk) {
+    if ( node->isLeaf() ) {
+        if ( node->is_undecided() ) {
+            mc_node_chunk( node, cell, chunk );
+            ++remeshed;
+        }
+        node->setValid();
+        return;
+    }
+    for (int m=0;m<8;++m)
+        mesh_subtree( node->child(m), cell, chunk );
+}
+
+/// run mc on one Octnode, the triangles use the vertices of the chunk on the edges of node
+void MarchingCubes::mc_node_chunk( Octnode* node, boost::uint64_t cell, unsigned int& chunk) {
+    CUTSIM_TIMER( node_stage );
+    assert( node->childcount == 0 ); // don't call this on non-leafs!
+    assert( node->is_undecided() );
+    unsigned int edgeTableIndex = mc_edgeTableIndex(node->f);
+    if ( triTable[edgeTableIndex][0] == -1 )
+        return;
+    if ( chunk == VertexMap::NOT_FOUND ) {
+        chunk = g->addChunk();
+        chunk_of_cell.set( cell, chunk );
+        if ( chunk >= cell_of_chunk.size() )
+            cell_of_chunk.resize( chunk+1, 0 );
+        cell_of_chunk[chunk] = cell;
+    }
+    GLVertex corners[8];
+    for (int n=0;n<8;++n)
+        corners[n] = node->corner(n);
+    unsigned int edges = edgeTable[edgeTableIndex];
+    GLuint vertex[12];
+    for (int e=0;e<12;++e) {
+        if ( edges & (1u<<e) ) {
+            boost::uint64_t key = edge_key(node, e);
+            GLVertex p = interpolate( corners, node->f, edgeCorners[e][0], edgeCorners[e][1] );
+            p.setColor( node->color );
+            vertex[e] = chunk_vertices.find( key );
+            if ( vertex[e] != VertexMap::NOT_FOUND && !g->chunkVertex(chunk, vertex[e]).samePositionAndColor( p ) ) {
+                vertex[e] = g->addChunkVertex( chunk, p ); // the neighbour has other samples on this edge
+            } else if ( vertex[e] == VertexMap::NOT_FOUND ) {
+                vertex[e] = g->addChunkVertex( chunk, p );
+                chunk_vertices.set( key, vertex[e] );
+            }
+        }
+    }
+    GLuint triangle[3];
+    for (unsigned int i=0; triTable[edgeTableIndex][i] != -1 ; i+=3 ) {
+        triangle[0] = vertex[ triTable[edgeTableIndex][i    ] ];
+        triangle[1] = vertex[ triTable[edgeTableIndex][i+1  ] ];
+        triangle[2] = vertex[ triTable[edgeTableIndex][i+2  ] ];
+        g->addChunkPolygon( chunk, triangle );
+    }
+}
+
+// the key of a cell is its x,y,z index in the lattice of chunk cells, 18 bits each, with bit 63 set.
+// a node at or below the chunk depth is in the cell that contains its center, a larger node 
+// in the cell at its minimum corner.
+boost::uint64_t MarchingCubes::cell_key(const Octnode* node) const {
+    GLVertex p = node->center();
+    if ( node->depth < chunk_depth ) // the center of the cell at the minimum corner
+        p = node->center() - GLVertex(node->scale, node->scale, node->scale) + GLVertex(chunk_size, chunk_size, chunk_size)*0.5;
+    boost::uint64_t x = (boost::uint64_t)floor( (p.x - lattice_origin.x)/chunk_size );
+    boost::uint64_t y = (boost::uint64_t)floor( (p.y - lattice_origin.y)/chunk_size );
+    boost::uint64_t z = (boost::uint64_t)floor( (p.z - lattice_origin.z)/chunk_size );
+    return x | (y<<18) | (z<<36) | ((boost::uint64_t)1<<63);
+}
+
+GLVertex MarchingCubes::cell_center(boost::uint64_t cell) const {
+    const boost::uint64_t mask = (1u<<18)-1;
+    return lattice_origin + GLVertex( (double)( cell      & mask) + 0.5,
+                                      (double)((cell>>18) & mask) + 0.5,
+                                      (double)((cell>>36) & mask) + 0.5 ) * chunk_size;
 }
 
 /// run mc on one Octnode
 /// this generates one or more triangles which are pushed to the GLData
 void MarchingCubes::mc_node( Octnode* node) {
+    CUTSIM_TIMER( node_stage );
     assert( node->childcount == 0 ); // don't call this on non-leafs!
     assert( node->is_undecided() );
-    unsigned int edgeTableIndex = mc_edgeTableIndex(node);
+    GLVertex corners[8];
+    for (int n=0;n<8;++n)
+        corners[n] = node->corner(n);
+    mc_cube( corners, node->f, node->color, node );
+}
+
+/// run mc on one Octnode, the triangles use the shared vertices on the edges of node
+void MarchingCubes::mc_node_shared( Octnode* node) {
+    CUTSIM_TIMER( node_stage );
+    assert( node->childcount == 0 ); // don't call this on non-leafs!
+    assert( node->is_undecided() );
+    GLVertex corners[8];
+    for (int n=0;n<8;++n)
+        corners[n] = node->corner(n);
+    unsigned int edgeTableIndex = mc_edgeTableIndex(node->f);
+    unsigned int edges = edgeTable[edgeTableIndex];
+    unsigned int vertex[12];
+    for (int e=0;e<12;++e) {
+        if ( edges & (1u<<e) ) {
+            GLVertex p = interpolate( corners, node->f, edgeCorners[e][0], edgeCorners[e][1] );
+            p.setColor( node->color );
+            vertex[e] = g->addSharedVertex( edge_key(node, e), p );
+        }
+    }
+    std::vector< unsigned int > triangle(3);
+    for (unsigned int i=0; triTable[edgeTableIndex][i] != -1 ; i+=3 ) {
+        triangle[0] = vertex[ triTable[edgeTableIndex][i    ] ];
+        triangle[1] = vertex[ triTable[edgeTableIndex][i+1  ] ];
+        triangle[2] = vertex[ triTable[edgeTableIndex][i+2  ] ];
+        node->addPolygonIndex( g->addPolygon(triangle, node) );
+    }
+}
+
+// the key of an edge is the lattice point at its lower end, its direction, and the depth of the node.
+// bits 0-53 are the x,y,z lattice coordinates, 54-55 the direction, 56-61 the depth. 
+// bit 63 is set, so that the key is not zero.
+boost::uint64_t MarchingCubes::edge_key(const Octnode* node, int e) const {
+    GLVertex a = node->corner( edgeCorners[e][0] );
+    GLVertex b = node->corner( edgeCorners[e][1] );
+    GLVertex lower( std::min(a.x,b.x), std::min(a.y,b.y), std::min(a.z,b.z) );
+    boost::uint64_t x = (boost::uint64_t)floor( (lower.x - lattice_origin.x)/lattice_spacing + 0.5 );
+    boost::uint64_t y = (boost::uint64_t)floor( (lower.y - lattice_origin.y)/lattice_spacing + 0.5 );
+    boost::uint64_t z = (boost::uint64_t)floor( (lower.z - lattice_origin.z)/lattice_spacing + 0.5 );
+    boost::uint64_t direction = ( a.x != b.x ) ? 0 : ( ( a.y != b.y ) ? 1 : 2 );
+    return x | (y<<18) | (z<<36) | (direction<<54) | ((boost::uint64_t)node->depth<<56) | ((boost::uint64_t)1<<63);
+}
+
+/// run mc on one cube with given corners and distance-field values f at the corners.
+/// the triangles are associated with node, which may be NULL.
+void MarchingCubes::mc_cube( const GLVertex* corners, const float* f, const Color& color, Octnode* node) {
+    unsigned int edgeTableIndex = mc_edgeTableIndex(f);
     unsigned int edges = edgeTable[edgeTableIndex];
-    std::vector< GLVertex > vertices = interpolated_vertices(node, edges);
+    std::vector< GLVertex > vertices = interpolated_vertices(corners, f, edges);
     for (unsigned int i=0; triTable[edgeTableIndex][i] != -1 ; i+=3 ) {
         std::vector< unsigned int > triangle;
         GLVertex p1 = vertices[ triTable[edgeTableIndex][i    ] ];
         GLVertex p2 = vertices[ triTable[edgeTableIndex][i+1  ] ];
         GLVertex p3 = vertices[ triTable[edgeTableIndex][i+2  ] ];
-        GLVertex::set_normal_and_color( p1, p2, p3, node->color );
+        GLVertex::set_normal_and_color( p1, p2, p3, color );
         triangle.push_back( g->addVertex(  p1, node ) );
         triangle.push_back( g->addVertex(  p2, node ) );
         triangle.push_back( g->addVertex(  p3, node ) );
         g->addPolygon(triangle);
-        node->addIndex( triangle[0] );
-        node->addIndex( triangle[1] );
-        node->addIndex( triangle[2] );
+        if (node) {
+            node->addIndex( triangle[0] );
+            node->addIndex( triangle[1] );
+            node->addIndex( triangle[2] );
+        }
     }
 }
         
-std::vector<GLVertex> MarchingCubes::interpolated_vertices(const Octnode* node, unsigned int edges) {
+std::vector<GLVertex> MarchingCubes::interpolated_vertices(const GLVertex* corners, const float* f, unsigned int edges) {
     std::vector<GLVertex> vertices(12);
-    vertices[0] = *(node->vertex[0]); // intialize these to the node-vertex positions (?why?)
-    vertices[1] = *(node->vertex[1]);
-    vertices[2] = *(node->vertex[2]);
-    vertices[3] = *(node->vertex[3]);
-    vertices[4] = *(node->vertex[4]);
-    vertices[5] = *(node->vertex[5]);
-    vertices[6] = *(node->vertex[6]);
-    vertices[7] = *(node->vertex[7]);
+    for (int n=0;n<8;++n)
+        vertices[n] = corners[n]; // intialize these to the node-vertex positions (?why?)
     if ( edges & 1 )
-        vertices[0] = interpolate( node, 0 , 1 );
+        vertices[0] = interpolate( corners, f, 0 , 1 );
     if ( edges & 2 )
-        vertices[1] = interpolate( node, 1 , 2 );
+        vertices[1] = interpolate( corners, f, 1 , 2 );
     if ( edges & 4 )
-        vertices[2] = interpolate( node, 2 , 3 );
+        vertices[2] = interpolate( corners, f, 2 , 3 );
     if ( edges & 8 )
-        vertices[3] = interpolate( node, 3 , 0 );
+        vertices[3] = interpolate( corners, f, 3 , 0 );
     if ( edges & 16 )
-        vertices[4] = interpolate( node, 4 , 5 );
+        vertices[4] = interpolate( corners, f, 4 , 5 );
     if ( edges & 32 )
-        vertices[5] = interpolate( node, 5 , 6 );
+        vertices[5] = interpolate( corners, f, 5 , 6 );
     if ( edges & 64 )
-        vertices[6] = interpolate( node, 6 , 7 );
+        vertices[6] = interpolate( corners, f, 6 , 7 );
     if ( edges & 128 )
-        vertices[7] = interpolate( node, 7 , 4 );
+        vertices[7] = interpolate( corners, f, 7 , 4 );
     if ( edges & 256 )
-        vertices[8] = interpolate( node, 0 , 4 );
+        vertices[8] = interpolate( corners, f, 0 , 4 );
     if ( edges & 512 )
-        vertices[9] = interpolate( node, 1 , 5 );
+        vertices[9] = interpolate( corners, f, 1 , 5 );
     if ( edges & 1024 )
-        vertices[10] = interpolate( node, 2 , 6 );
+        vertices[10] = interpolate( corners, f, 2 , 6 );
     if ( edges & 2048 )
-        vertices[11] = interpolate( node, 3 , 7 );
+        vertices[11] = interpolate( corners, f, 3 , 7 );
     return vertices;
 }
         
 /// use linear interpolation of the distance-field between vertices idx1 and idx2
 /// to generate a new iso-surface vertex on the idx1-idx2 edge
-GLVertex MarchingCubes::interpolate(const Octnode* node, int idx1, int idx2) {
+GLVertex MarchingCubes::interpolate(const GLVertex* corners, const float* f, int idx1, int idx2) {
     // p = p1 - f1 (p2-p1)/(f2-f1)
-    if (!( fabs(node->f[idx2] - node->f[idx1] ) > 1e-16 ))
-        std::cout << "mc::interpolate error " << node->f[idx2] << " and " << node->f[idx1] << " don't differ in sign!\n";
+    if (!( fabs(f[idx2] - f[idx1] ) > 1e-16 ))
+        std::cout << "mc::interpolate error " << f[idx2] << " and " << f[idx1] << " don't differ in sign!\n";
         
-    //assert( ( (node->f[idx2] * node->f[idx1] )  < 0 ) ); // should have unequal sign!
-    assert( fabs(node->f[idx2] - node->f[idx1] ) > 1e-16 );
-    return *(node->vertex[idx1]) -( *(node->vertex[idx2])-(*(node->vertex[idx1])) ) * 
-                                    (1.0/(node->f[idx2] - node->f[idx1])) *  node->f[idx1];
+    //assert( ( (f[idx2] * f[idx1] )  < 0 ) ); // should have unequal sign!
+    assert( fabs(f[idx2] - f[idx1] ) > 1e-16 );
+    return corners[idx1] -( corners[idx2] - corners[idx1] ) * 
+                                    (1.0/(f[idx2] - f[idx1])) *  f[idx1];
 }
 
         
 // based on the funcion values (positive or negative) at the corners of the node,
 // calculate the edgeTableIndex
-unsigned int MarchingCubes::mc_edgeTableIndex(const Octnode* node) {
+unsigned int MarchingCubes::mc_edgeTableIndex(const float* f) {
     unsigned int edgeTableIndex = 0;
-    if (node->f[0] < 0.0 ) edgeTableIndex |= 1;
-    if (node->f[1] < 0.0 ) edgeTableIndex |= 2;
-    if (node->f[2] < 0.0 ) edgeTableIndex |= 4;
-    if (node->f[3] < 0.0 ) edgeTableIndex |= 8;
-    if (node->f[4] < 0.0 ) edgeTableIndex |= 16;
-    if (node->f[5] < 0.0 ) edgeTableIndex |= 32;
-    if (node->f[6] < 0.0 ) edgeTableIndex |= 64;
-    if (node->f[7] < 0.0 ) edgeTableIndex |= 128;
+    if (f[0] < 0.0 ) edgeTableIndex |= 1;
+    if (f[1] < 0.0 ) edgeTableIndex |= 2;
+    if (f[2] < 0.0 ) edgeTableIndex |= 4;
+    if (f[3] < 0.0 ) edgeTableIndex |= 8;
+    if (f[4] < 0.0 ) edgeTableIndex |= 16;
+    if (f[5] < 0.0 ) edgeTableIndex |= 32;
+    if (f[6] < 0.0 ) edgeTableIndex |= 64;
+    if (f[7] < 0.0 ) edgeTableIndex |= 128;
     return edgeTableIndex;
 }
 
+// edge n of the cube goes from corner edgeCorners[n][0] to edgeCorners[n][1].
+// bit n of an edgeTable entry is set if the surface crosses edge n.
+const int MarchingCubes::edgeCorners[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0},
+    {4, 5}, {5, 6}, {6, 7}, {7, 4},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
 // I think the tables are from http://paulbourke.net/geometry/polygonise/
 
 // this table stores indices into the triTable below, i.e. it tells
@@ -29,6 +29,7 @@
 #include "isosurface.hpp"
 #include "bbox.hpp"
 #include "octnode.hpp"
+#include "linear_octree.hpp"
 #include "gldata.hpp"
 
 namespace cutsim {
@@ -36,26 +37,147 @@ namespace cutsim {
 /// Marching-cubes isosurface extraction from distance field stored in Octree
 /// see http://en.wikipedia.org/wiki/Marching_cubes
 ///
+/// The first updateGL() traverses the whole Octree. After that only the nodes in
+/// the dirty list of the Octree, i.e. the leaves changed by sum(), diff() and intersect(),
+/// are re-polygonised.
+///
+/// The vertices of an Octree surface are shared: each vertex lies on an edge of the 
+/// lattice of node corners, and the triangles with a vertex on the same edge, also
+/// triangles of neighbouring nodes, use the same GLData vertex if they put it at the same
+/// position. Neighbours may have different samples at the corners of an edge, e.g. when
+/// only one of them was evaluated by a cut, and then each has a vertex of its own there.
+/// The vertex normals are the average of the triangle normals.
+///
+/// With set_chunk_depth() the triangles go to GLData chunks instead, one for each cell 
+/// of the lattice of nodes at the chunk depth. A leaf larger than a cell belongs to the
+/// chunk of the cell at its minimum corner. A chunk changed by an operation is cleared and 
+/// re-polygonised as a whole, so no vertex of another node is moved or renumbered.
+/// Vertices are shared within a chunk.
 class MarchingCubes : public IsoSurfaceAlgorithm {
 public:
     /// create algorithm
-    MarchingCubes(GLData* gl, Octree* tr) : IsoSurfaceAlgorithm(gl,tr) {
+    MarchingCubes(GLData* gl, Octree* tr) : IsoSurfaceAlgorithm(gl,tr), linear_tree(NULL) {
+        g->setTriangles(); 
+        g->setPolygonModeFill(); 
+        tree->set_track_dirty(true);
+        // edge keys have 18 bits for each lattice coordinate, which goes up to 2^max_depth
+        assert( tree->max_depth <= 17 ); 
+        lattice_origin = tree->root->center() - GLVertex(tree->root_scale, tree->root_scale, tree->root_scale);
+        lattice_spacing = tree->root_scale / pow(2.0, (int)tree->max_depth-1);
+        shared = true;
+        chunk_depth = 0;
+        init_counters();
+    }
+    /// create algorithm for a LinearOctree
+    MarchingCubes(GLData* gl, LinearOctree* lt) : IsoSurfaceAlgorithm(gl,NULL), linear_tree(lt) {
         g->setTriangles(); 
         g->setPolygonModeFill(); 
+        shared = false;
+        chunk_depth = 0;
+        init_counters();
+    }
+    virtual ~MarchingCubes() { 
+        if (tree)
+            tree->set_track_dirty(false);
     }
-    virtual ~MarchingCubes() { }
+    /// update GLData. The LinearOctree does not keep track of the vertices of each node, 
+    /// so for a LinearOctree the whole surface is re-generated.
+    virtual void updateGL();
+    /// update GLData in region. for a LinearOctree this is the same as updateGL()
+    virtual void updateGL( const Bbox& region );
+    /// number of leaves polygonised by the last updateGL()
+    unsigned int remeshed_leaves() const { return remeshed; }
+    /// number of nodes taken from the dirty list by the last updateGL()
+    unsigned int dirty_nodes() const { return dirty_count; }
+    /// number of leaves polygonised by all updateGL() calls
+    unsigned long total_remeshed_leaves() const { return total_remeshed; }
+    /// give each triangle of an Octree surface its own three vertices, with the triangle normal, 
+    /// as the LinearOctree surface does. call this before the first updateGL().
+    void set_shared_vertices(bool on) { shared = on && (tree != NULL); }
+    /// put the triangles in one GLData chunk for each Octree region at the given depth, 
+    /// or in the global GLData arrays for depth 0, the default. call this before the first updateGL().
+    void set_chunk_depth(unsigned int depth) {
+        assert( full_update );
+        assert( !tree || depth < tree->max_depth );
+        chunk_depth = tree ? depth : 0;
+        chunk_size = tree ? 2*tree->root_scale / pow(2.0, (int)depth) : 0;
+    }
+    /// number of chunks rebuilt by the last updateGL()
+    unsigned int rebuilt_chunks() const { return rebuilt; }
 protected:
     void updateGL(Octnode* node);
+    /// remove the old vertices of the given dirty nodes, and polygonise the undecided leaves among them
+    void update_nodes(const std::vector<Octnode*>& nodes);
+    /// reset the counters
+    void init_counters() {
+        full_update = true;
+        remeshed = 0;
+        dirty_count = 0;
+        total_remeshed = 0;
+        rebuilt = 0;
+    }
     void mc_node(Octnode* node); 
+    /// run marching-cubes on a node, with shared vertices
+    void mc_node_shared(Octnode* node);
+    /// the key for GLData::addSharedVertex() of the vertex on edge e of node
+    boost::uint64_t edge_key(const Octnode* node, int e) const;
+    /// add the cells with a surface below node to cells
+    void collect_cells(Octnode* node, std::vector<boost::uint64_t>& cells);
+    /// add the cells changed by the given dirty nodes to cells
+    void dirty_cells(const std::vector<Octnode*>& nodes, std::vector<boost::uint64_t>& cells);
+    /// clear and re-polygonise the chunks of the given cells
+    void rebuild_chunks(std::vector<boost::uint64_t>& cells);
+    /// polygonise the leaves of the cell into the chunk, which is added if it does not exist
+    void mesh_cell(boost::uint64_t cell, unsigned int& chunk);
+    /// polygonise the leaves below node into the chunk of cell
+    void mesh_subtree(Octnode* node, boost::uint64_t cell, unsigned int& chunk);
+    /// run marching-cubes on a leaf, with the vertices shared within the chunk of cell
+    void mc_node_chunk(Octnode* node, boost::uint64_t cell, unsigned int& chunk);
+    /// the cell of the chunk that holds the triangles of a leaf, or that contains a smaller node
+    boost::uint64_t cell_key(const Octnode* node) const;
+    /// the center of a cell
+    GLVertex cell_center(boost::uint64_t cell) const;
+    /// run marching-cubes on one cube, and associate the triangles with node (may be NULL)
+    void mc_cube(const GLVertex* corners, const float* f, const Color& color, Octnode* node);
     /// based on the f[] values, generate a list of interpolated vertices, all on the edges of the node.
     /// These vertices are later used for defining triangles.
-    std::vector<GLVertex> interpolated_vertices(const Octnode* node, unsigned int edges) ;
-    GLVertex interpolate(const Octnode* node, int idx1, int idx2);
+    std::vector<GLVertex> interpolated_vertices(const GLVertex* corners, const float* f, unsigned int edges) ;
+    GLVertex interpolate(const GLVertex* corners, const float* f, int idx1, int idx2);
 // DATA
+    /// the LinearOctree to draw, or NULL if drawing an Octree
+    LinearOctree* linear_tree;
+    /// true until the first updateGL(), which traverses the whole Octree
+    bool full_update;
+    /// leaves polygonised by the last updateGL()
+    unsigned int remeshed;
+    /// nodes taken from the dirty list by the last updateGL()
+    unsigned int dirty_count;
+    /// leaves polygonised since the algorithm was created
+    unsigned long total_remeshed;
+    /// true if triangles share vertices
+    bool shared;
+    /// the lattice point with integer coordinates (0,0,0), the minimum corner of the root node
+    GLVertex lattice_origin;
+    /// the distance between lattice points, half of the side-length of the smallest nodes
+    double lattice_spacing;
+    /// the depth of the nodes whose regions are the chunks, or 0 if chunks are not used
+    unsigned int chunk_depth;
+    /// the side-length of a chunk cell
+    double chunk_size;
+    /// the GLData chunk of each cell
+    VertexMap chunk_of_cell;
+    /// the cell of each GLData chunk, zero for chunks not used by this algorithm
+    std::vector<boost::uint64_t> cell_of_chunk;
+    /// the chunk vertex on each edge, while a chunk is polygonised
+    VertexMap chunk_vertices;
+    /// chunks rebuilt by the last updateGL()
+    unsigned int rebuilt;
     /// get table-index based on the funcion values (positive or negative) at the corners
-    unsigned int mc_edgeTableIndex(const Octnode* node);
+    unsigned int mc_edgeTableIndex(const float* f);
     /// Marching-Cubes edge table
     static const unsigned int edgeTable[256];
+    /// the two corners at the ends of each edge
+    static const int edgeCorners[12][2];
     /// Marching-Cubes triangle table
     static const int triTable[256][16]; 
 };
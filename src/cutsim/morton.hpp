@@ -0,0 +1,67 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <boost/cstdint.hpp>
+
+namespace cutsim {
+
+// 3D Morton codes (Z-order). The bits of x, y and z are interleaved as ...zyxzyx
+// so that sorting by Morton code visits an octree depth-first.
+// Each coordinate may use up to 21 bits.
+
+/// spread the lower 21 bits of v so that there are two zero bits between each bit
+inline boost::uint64_t morton_spread(boost::uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x001f00000000ffffULL;
+    v = (v | (v << 16)) & 0x001f0000ff0000ffULL;
+    v = (v | (v <<  8)) & 0x100f00f00f00f00fULL;
+    v = (v | (v <<  4)) & 0x10c30c30c30c30c3ULL;
+    v = (v | (v <<  2)) & 0x1249249249249249ULL;
+    return v;
+}
+
+/// inverse of morton_spread(), collect every third bit of v
+inline boost::uint32_t morton_compact(boost::uint64_t v) {
+    v &= 0x1249249249249249ULL;
+    v = (v ^ (v >>  2)) & 0x10c30c30c30c30c3ULL;
+    v = (v ^ (v >>  4)) & 0x100f00f00f00f00fULL;
+    v = (v ^ (v >>  8)) & 0x001f0000ff0000ffULL;
+    v = (v ^ (v >> 16)) & 0x001f00000000ffffULL;
+    v = (v ^ (v >> 32)) & 0x1fffff;
+    return (boost::uint32_t)v;
+}
+
+/// the Morton code of lattice coordinates (x,y,z)
+inline boost::uint64_t morton_encode(boost::uint32_t x, boost::uint32_t y, boost::uint32_t z) {
+    return morton_spread(x) | (morton_spread(y) << 1) | (morton_spread(z) << 2);
+}
+
+/// the lattice coordinates (x,y,z) of a Morton code
+inline void morton_decode(boost::uint64_t code, boost::uint32_t& x, boost::uint32_t& y, boost::uint32_t& z) {
+    x = morton_compact(code);
+    y = morton_compact(code >> 1);
+    z = morton_compact(code >> 2);
+}
+
+} // end namespace
+#endif
+// end file morton.hpp
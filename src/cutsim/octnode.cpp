@@ -19,6 +19,7 @@
 
 
 #include <list>
+#include <new>
 #include <cassert>
 #include <iostream>
 #include <sstream>
@@ -26,9 +27,13 @@
 #include <boost/foreach.hpp>
 
 #include "octnode.hpp"
+#include "instrumentation.hpp"
 
 namespace cutsim {
 
+static Stage subdivide_stage("octnode.subdivide");
+static Stage delete_children_stage("octnode.delete_children");
+
 //**************** Octnode ********************/
 
 // this defines the position of each octree-vertex with relation to the center of the node
@@ -61,39 +66,36 @@ const char Octnode::octant[8] = {
                     16,
                     32,
                     64,
-                    128
+                    (char)128
                 };
 
-Octnode::Octnode(Octnode* nodeparent, unsigned int index, double nodescale, unsigned int nodedepth, GLData* gl) {
-    g=gl;
+Octnode::Octnode(Octnode* nodeparent, unsigned int index, double nodescale, unsigned int nodedepth, OctnodePool* nodepool) {
+    pool = nodepool;
     parent = nodeparent;
     idx = index;
     scale = nodescale;
     depth = nodedepth;
     
-    //child.resize(8);
-    //vertex.resize(8);
-    //f.resize(8);
     if (parent) {
-        center = parent->childcenter(idx);
+        setCenter( parent->childcenter(idx) );
         state = parent->prev_state;
         prev_state = state;
         color = parent->color;
     } else { // root node has no parent
-        center = new GLVertex(0,0,0); // default center for root is (0,0,0)
+        setCenter( GLVertex(0,0,0) ); // default center for root is (0,0,0)
         state = UNDECIDED;
         prev_state = OUTSIDE;
     }
 
     
     for ( int n=0;n<8;++n) {
-		child[n] = NULL;
-        vertex[n] = new GLVertex(*center + direction[n] * scale ) ;
         if (parent) {
             assert( parent->state == UNDECIDED );
-            assert( parent->prev_state != UNDECIDED );
             //std::cout << parent->prev_state << "\n";
-            if (parent->prev_state == INSIDE) {
+            if (parent->prev_state == UNDECIDED) { // an undecided leaf split by Octree before an operation
+                f[n] = parent->field( corner(n) );
+            }
+            else if (parent->prev_state == INSIDE) {
                 f[n]=1;
                 state = INSIDE;
             }
@@ -111,46 +113,78 @@ Octnode::Octnode(Octnode* nodeparent, unsigned int index, double nodescale, unsi
             f[n] = -1; 
         }
     }
-    bb.clear();
-    bb.addPoint( *vertex[2] ); // vertex[2] has the minimum x,y,z coordinates
-    bb.addPoint( *vertex[4] ); // vertex[4] has the max x,y,z
+    
+    if ( parent && parent->prev_state == UNDECIDED ) { // the state follows from the interpolated field
+        bool inside = true;
+        bool outside = true;
+        for ( int n=0;n<8;++n) {
+            if ( f[n] >= 0.0 )
+                outside = false;
+            else
+                inside = false;
+        }
+        state = inside ? INSIDE : ( outside ? OUTSIDE : UNDECIDED );
+        prev_state = state;
+    }
     
     isosurface_valid = false;
+    dirty_index = -1;
     
+    children = NULL;
     childcount = 0;
+    lazy = 0;
     childStatus = 0;
 }
 
-// call delete on children, vertices, and center
+// destroy children, and return their block to the pool
 Octnode::~Octnode() {
     if (childcount == 8 ) {
-        for(int n=0;n<8;++n) {
-            delete child[n];
-            child[n] = 0;
-            delete vertex[n];
-            vertex[n] = 0;
-        }
+        for(int n=0;n<8;++n)
+            children[n].~Octnode();
+        pool->release( children );
     }
-    delete center;
-    center = 0;
+}
+
+void Octnode::setCenter(const GLVertex& c) {
+    pos[0] = c.x;
+    pos[1] = c.y;
+    pos[2] = c.z;
+}
+
+Bbox Octnode::bb() const {
+    Bbox box;
+    box.addPoint( corner(2) ); // corner 2 has the minimum x,y,z coordinates
+    box.addPoint( corner(4) ); // corner 4 has the max x,y,z
+    return box;
+}
+
+// trilinear interpolation, the weight of corner n is the product over the axes of (1 + u*direction[n])/2
+double Octnode::field(const GLVertex& p) const {
+    GLVertex u = ( p - center() ) * (1.0/scale); // in [-1,1]
+    double value = 0.0;
+    for ( int n=0;n<8;++n) {
+        value += f[n] * (1.0 + u.x*direction[n].x) * (1.0 + u.y*direction[n].y) * (1.0 + u.z*direction[n].z);
+    }
+    return value/8.0;
 }
 
 // return centerpoint of child with index n
-GLVertex* Octnode::childcenter(int n) {
-    return  new GLVertex(*center + ( direction[n] * 0.5*scale ));
+GLVertex Octnode::childcenter(int n) const {
+    return center() + ( direction[n] * 0.5*scale );
 }
 
 
 // create the 8 children of this node
 void Octnode::subdivide() {
+    CUTSIM_TIMER( subdivide_stage );
     if (this->childcount==0) {
         if( state != UNDECIDED )
             std::cout << " subdivide() error: state==" << state << "\n";
             
         assert( state == UNDECIDED );
+        children = pool->allocate(); // storage for all eight children
         for( int n=0;n<8;++n ) {
-            Octnode* newnode = new Octnode( this, n , scale/2.0 , depth+1 , g); // parent,  idx, scale,   depth, GLdata
-            this->child[n] = newnode;
+            new ( children+n ) Octnode( this, n , scale/2.0 , depth+1 , pool); // parent,  idx, scale,   depth, pool
             ++childcount;
         }
     } else {
@@ -159,27 +193,27 @@ void Octnode::subdivide() {
     }
 }
 
-void Octnode::sum(const Volume* vol) {
+void Octnode::sum(const Volume* vol, const double* d) {
     for ( int n=0;n<8;++n) {
-        if (vol->dist( *(vertex[n]) ) > f[n])
+        if (d[n] > f[n])
             color = vol->color;
-        f[n] = std::max<double>( f[n], vol->dist( *(vertex[n]) ) );
+        f[n] = std::max<double>( f[n], d[n] );
     }
     set_state();
 }
-void Octnode::diff(const Volume* vol) {
+void Octnode::diff(const Volume* vol, const double* d) {
     for ( int n=0;n<8;++n)  {
-        if (-1*vol->dist( *(vertex[n]) ) < f[n])
+        if (-1*d[n] < f[n])
             color = vol->color;
-        f[n] = std::min<double>( f[n], -1.0*vol->dist( *(vertex[n]) ) );
+        f[n] = std::min<double>( f[n], -1.0*d[n] );
     }
     set_state();
 }
-void Octnode::intersect(const Volume* vol) {
+void Octnode::intersect(const Volume* vol, const double* d) {
     for ( int n=0;n<8;++n) {
-        if (vol->dist( *(vertex[n]) ) < f[n])
+        if (d[n] < f[n])
             color = vol->color;
-        f[n] = std::min<double>( f[n], vol->dist( *(vertex[n]) ) );
+        f[n] = std::min<double>( f[n], d[n] );
     }
     set_state();
 }
@@ -246,14 +280,14 @@ void Octnode::setUndecided() {
 
 bool Octnode::all_child_state(NodeState s) const {
     if ( childcount == 8 ) {
-        return (  child[0]->state == s ) && 
-                ( child[1]->state == s ) && 
-                ( child[2]->state == s ) && 
-                ( child[3]->state == s ) && 
-                ( child[4]->state == s ) && 
-                ( child[5]->state == s ) && 
-                ( child[6]->state == s ) && 
-                ( child[7]->state == s ) ;
+        return (  children[0].state == s ) && 
+                ( children[1].state == s ) && 
+                ( children[2].state == s ) && 
+                ( children[3].state == s ) && 
+                ( children[4].state == s ) && 
+                ( children[5].state == s ) && 
+                ( children[6].state == s ) && 
+                ( children[7].state == s ) ;
     } else {
         return true;
     }
@@ -261,7 +295,8 @@ bool Octnode::all_child_state(NodeState s) const {
 
 void Octnode::delete_children() {
     if (childcount==8) {
-        NodeState s0 = child[0]->state;
+        CUTSIM_TIMER( delete_children_stage );
+        NodeState s0 = children[0].state;
         //std::cout << spaces() << depth << ":" << idx << " delete_children\n";
         //std::cout << "before: s0= " << s0 << " \n";
         //std::cout << " delete_children() states: ";
@@ -271,7 +306,7 @@ void Octnode::delete_children() {
                 
         for (int n=0;n<8;n++) {
             //std::cout << depth << " deleting " << n << "\n";
-            if ( s0 != child[n]->state ) {
+            if ( s0 != children[n].state ) {
                 std::cout << " delete_children() error: ";
                 //for ( int m=0;m<8;m++ ) {
                 //    std::cout << child[m]->state << " ";
@@ -279,16 +314,35 @@ void Octnode::delete_children() {
                 std::cout << "\n";
                 std::cout << " s0= " << s0 << " \n";
             }
-            assert( s0 == child[n]->state );
-            child[n]->clearVertexSet(  );
-            delete child[n];
-            child[n]=0;
+            assert( s0 == children[n].state );
+            children[n].clearVertexSet(  );
+            children[n].~Octnode();
             childcount--;
         }
+        pool->release( children );
+        children = NULL;
         assert( childcount == 0);
+        if ( state == UNDECIDED ) { // split by force_subdivide(). not set_state(), which would tell a parent
+            state = s0;             // in the middle of an operation that all its children are done.
+            setInvalid();
+        }
     }
     
 }
+
+void Octnode::delete_subtree() {
+    if (childcount==8) {
+        CUTSIM_TIMER( delete_children_stage );
+        for (int n=0;n<8;n++) {
+            children[n].delete_subtree();
+            children[n].clearVertexSet();
+            children[n].~Octnode();
+        }
+        childcount = 0;
+        pool->release( children );
+        children = NULL;
+    }
+}
                     
 
 
@@ -324,38 +378,59 @@ bool Octnode::valid() const {
     return isosurface_valid;
 }
 
+void Octnode::notify_parent(NodeState old_state) {
+    if (!parent)
+        return;
+    if ( state != old_state ) {
+        if ( (state == INSIDE) && (parent->state != INSIDE) )
+            parent->setInside();
+        else if ( (state == OUTSIDE) && (parent->state != OUTSIDE) )
+            parent->setOutside();
+    }
+    if ( !isosurface_valid && parent->valid() )
+        parent->setChildInvalid( idx );
+}
+
 
 void Octnode::addIndex(unsigned int id) { 
-#ifndef NDEBUG
-    std::set<unsigned int>::iterator found = vertexSet.find( id );
-    assert( found == vertexSet.end() ); // we should not have id
-#endif
-    vertexSet.insert(id); 
+    assert( !vertexSet.contains( id ) ); // we should not have id
+    vertexSet.push_back(id); 
 }
 void Octnode::swapIndex(unsigned int oldId, unsigned int newId) {
-#ifndef NDEBUG
-    std::set<unsigned int>::iterator found = vertexSet.find(oldId);
-    assert( found != vertexSet.end() ); // we must have oldId
-#endif
-    vertexSet.erase(oldId);
-    vertexSet.insert(newId);
+    bool found = vertexSet.replace(oldId, newId);
+    assert( found ); // we must have oldId
+    (void)found;
 }
 
 void Octnode::removeIndex(unsigned int id) {
-#ifndef NDEBUG
-    std::set<unsigned int>::iterator found = vertexSet.find( id );
-    assert( found != vertexSet.end() ); // we must have id
-#endif
-    vertexSet.erase(id);
+    bool found = vertexSet.erase(id);
+    assert( found ); // we must have id
+    (void)found;
 }
 
 void Octnode::clearVertexSet( ) {
     while( !vertexSetEmpty() ) {
         unsigned int delId = vertexSetTop();
         removeIndex( delId );
-        g->removeVertex( delId );
+        pool->gldata()->removeVertex( delId );
     }
     assert( vertexSetEmpty() ); // when done, set should be empty
+    while( !polygonSet.empty() ) { // GLData renumbers our polygons with swapPolygonIndex() when it moves them
+        unsigned int delId = polygonSet.back();
+        polygonSet.pop_back();
+        pool->gldata()->removePolygon( delId );
+    }
+}
+
+void Octnode::addPolygonIndex(unsigned int id) { 
+    assert( !polygonSet.contains( id ) ); // we should not have id
+    polygonSet.push_back(id); 
+}
+
+void Octnode::swapPolygonIndex(unsigned int oldId, unsigned int newId) {
+    bool found = polygonSet.replace(oldId, newId);
+    assert( found ); // we must have oldId
+    (void)found;
 }
 
 // string repr
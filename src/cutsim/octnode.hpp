@@ -24,13 +24,14 @@
 #include <sstream>
 
 #include <list>
-#include <set>
 #include <vector>
 
 #include "volume.hpp"
 #include "bbox.hpp"
 #include "glvertex.hpp"
 #include "gldata.hpp"
+#include "octnode_pool.hpp"
+#include "index_list.hpp"
 
 namespace cutsim {
 
@@ -39,32 +40,36 @@ namespace cutsim {
 ///
 /// each node in the octree is a cube with side length scale
 /// the distance field at each corner vertex is stored.
+///
+/// the eight children of a node are allocated as one block from an OctnodePool.
+/// corner vertices and the bounding-box are not stored, corner(n) and bb() compute them
+/// from the center and scale. The layout is kept compact, since a deep tree has
+/// millions of nodes: distances, center and scale are floats, and the state, index, 
+/// depth and valid-flags are packed into bit-fields. See Octree::str() for the bytes per node.
 class Octnode {
     public:
         /// node state, one of inside, outside, or undecided
         enum NodeState  {INSIDE, OUTSIDE, UNDECIDED };
-        /// the current state of this node
-        NodeState state;
-        /// previous state of this node
-        NodeState prev_state;
-        /// the color of this node
-        Color color;
-        /// create suboctant idx of parent with scale nodescale and depth nodedepth
-        Octnode(Octnode* parent, unsigned int idx, double nodescale, unsigned int nodedepth, GLData* g);
-        virtual ~Octnode();
+        /// create suboctant idx of parent with scale nodescale and depth nodedepth.
+        /// children are allocated from the given OctnodePool, and vertices are removed from its GLData.
+        /// the child is INSIDE or OUTSIDE as the parent was before the operation, or if the parent 
+        /// prev_state is UNDECIDED, the child interpolates the distance-field of the parent.
+        Octnode(Octnode* parent, unsigned int idx, double nodescale, unsigned int nodedepth, OctnodePool* pool);
+        ~Octnode();
         /// create all eight children of this node
         void subdivide(); 
-        /// for subdivision even though state is not undecided. called/used from Octree::init()
-        void force_subdivide() { // this is only called from octree-init..
+        /// for subdivision even though state is not undecided. called/used from Octree::init(),
+        /// and from Octree::descend() for a leaf that a Volume passes through between the corners.
+        void force_subdivide() {
             setUndecided();
             subdivide();
         }
-        /// sum Volume to this node
-        void sum(const Volume* vol);
-        /// diff Volume from this node
-        void diff(const Volume* vol);
-        /// intersect this node with given Volume
-        void intersect(const Volume* vol);
+        /// sum Volume to this node, d[n] is the distance of vol at corner(n)
+        void sum(const Volume* vol, const double* d);
+        /// diff Volume from this node, d[n] is the distance of vol at corner(n)
+        void diff(const Volume* vol, const double* d);
+        /// intersect this node with given Volume, d[n] is the distance of vol at corner(n)
+        void intersect(const Volume* vol, const double* d);
         /// is this node outside?
         bool is_inside()    { return (state==INSIDE); }
         /// is this node outside?
@@ -74,8 +79,11 @@ class Octnode {
         
         /// return true if all children of this node in given state s
         bool all_child_state(NodeState s) const;
-        /// delete all children of this node
+        /// delete all children of this node. the children are leaves in the same state, see Octree::prune().
+        /// an undecided node, split by force_subdivide(), takes the state of the children.
         void delete_children();
+        /// delete all nodes below this node, and their vertices and polygons in the GLData
+        void delete_subtree();
 
     // manipulate the valid-flag
         /// set valid-flag true
@@ -84,32 +92,49 @@ class Octnode {
         void setInvalid();
         /// true if the GLData for this node is valid
         bool valid() const;
+        /// tell the parent about a change from old_state, and about an invalid flag, as set_state() does.
+        /// used by Octree when the subtree below this node was operated on by a separate task.
+        void notify_parent(NodeState old_state);
         
-        /// true if this node has child n
-        inline bool hasChild(int n) { return (this->child[n] != NULL); }
+        /// true if this node has children
+        inline bool hasChild(int n) const { return (children != NULL); }
         /// true if this node has no children
-        inline bool isLeaf() {return (childcount==0);}
+        inline bool isLeaf() const {return (childcount==0);}
+        /// child n of this node. call this only if the node has children.
+        inline Octnode* child(int n) const { return children + n; }
+        /// the center point of this node
+        inline GLVertex center() const { return GLVertex( pos[0], pos[1], pos[2] ); }
+        /// move this node, used for the root node
+        void setCenter(const GLVertex& c);
+        /// return corner vertex n of this node
+        inline GLVertex corner(int n) const { return center() + direction[n] * scale; }
+        /// bounding-box corresponding to this node
+        Bbox bb() const;
+        /// the distance-field at point p inside this node, interpolated from the corner values f[]
+        double field(const GLVertex& p) const;
     // DATA
-        /// pointers to child nodes
-        Octnode* child[8];
         /// pointer to parent node
         Octnode* parent;
-        /// number of children
-        unsigned int childcount;
-        /// The eight corners of this node
-        GLVertex* vertex[8]; 
         /// value of distance-field at corner vertex
-        double f[8]; 
-        /// the center point of this node
-        GLVertex* center; // the centerpoint of this node
-        /// the tree-dept of this node
-        unsigned int depth; // depth of node
-        /// the index of this node [0,7]
-        unsigned int idx; // index of node
+        float f[8]; 
         /// the scale of this node, i.e. distance from center out to corner vertices
-        double scale; // distance from center to vertices
-        /// bounding-box corresponding to this node
-        Bbox bb;
+        float scale;
+        /// the color of this node
+        Color color;
+        /// the position of this node in the dirty list of the Octree, or -1
+        int dirty_index;
+        /// the current state of this node
+        NodeState state : 2;
+        /// previous state of this node
+        NodeState prev_state : 2;
+        /// the index of this node [0,7]
+        unsigned int idx : 3;
+        /// the tree-depth of this node
+        unsigned int depth : 5;
+        /// number of children
+        unsigned int childcount : 4;
+        /// true if the Octree has deferred operations on this leaf, see Octree::set_lazy()
+        unsigned int lazy : 1;
     
     // for manipulating vertexSet
         /// add id to the vertex set
@@ -120,10 +145,20 @@ class Octnode {
         void removeIndex(unsigned int id);
         /// is the vertex set empty?
         bool vertexSetEmpty() {return vertexSet.empty(); }
-        /// return begin() for vertex set
-        unsigned int vertexSetTop() { return *(vertexSet.begin()); }
-        /// remove all vertices associated with this node. calls GLData to also remove nodes
+        /// return the last id in the vertex set
+        unsigned int vertexSetTop() { return vertexSet.back(); }
+        /// remove all vertices and polygons associated with this node. calls GLData to also remove nodes
         void clearVertexSet();
+        
+    // for manipulating polygonSet
+        /// add id to the polygon set
+        void addPolygonIndex(unsigned int id);
+        /// swap the id for an existing oldId to the given newId. This is called from GLData when GLData moves a polygon
+        void swapPolygonIndex(unsigned int oldId, unsigned int newId);
+        /// true if this node has no vertices and no polygons in the GLData
+        bool glDataEmpty() { return vertexSet.empty() && polygonSet.empty(); }
+        /// bytes of vertex and polygon indices held on the heap by this node
+        unsigned int heap_bytes() const { return vertexSet.heap_bytes() + polygonSet.heap_bytes(); }
 
         /// string output
         friend std::ostream& operator<<(std::ostream &stream, const Octnode &o);
@@ -150,18 +185,24 @@ class Octnode {
         /// set the given child to invalid
         inline void setChildInvalid( unsigned int id );
 
-        /// the vertex indices that this node has produced. These correspond to vertex id's in the GLData.
-        std::set<unsigned int> vertexSet;
-        /// return center of child with index n
-        GLVertex* childcenter(int n); // return position of child centerpoint
-        /// The GLData, i.e. vertices and polygons, associated with this node
-        /// when this node is deleted we notify the GLData that vertices should be removed
-        GLData* g;
+        /// the eight children, one block from the pool, or NULL
+        Octnode* children;
+        /// the center point of this node
+        float pos[3];
+        /// bit-field indicating if children have valid gldata
+        char childStatus; 
         /// flag for telling isosurface extraction is valid for this node
         /// if false, the node needs updating.
         bool isosurface_valid;
-        /// bit-field indicating if children have valid gldata
-        char childStatus; 
+        /// the vertex indices that this node has produced. These correspond to vertex id's in the GLData.
+        IndexList<4> vertexSet;
+        /// the polygon indices that this node has produced from shared vertices, see GLData::addSharedVertex()
+        IndexList<4> polygonSet;
+        /// return center of child with index n
+        GLVertex childcenter(int n) const; // return position of child centerpoint
+        /// the pool from which children of this node are allocated. 
+        /// its GLData is notified when this node is deleted, so that vertices are removed.
+        OctnodePool* pool;
         
 // STATIC
         /// the direction to the vertices, from the center 
@@ -0,0 +1,87 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <new>
+#include <sstream>
+
+#include <boost/foreach.hpp>
+
+#include "octnode_pool.hpp"
+#include "octnode.hpp"
+
+namespace cutsim {
+
+OctnodePool::OctnodePool(std::size_t blocks_per_slab) {
+    block_bytes = 8*sizeof(Octnode);
+    slab_blocks = blocks_per_slab;
+    in_use = 0;
+    g = NULL;
+}
+
+OctnodePool::~OctnodePool() {
+    // all Octnodes must have been destroyed by now, we only free the storage
+    BOOST_FOREACH( char* slab, slabs ) {
+        ::operator delete( slab );
+    }
+    slabs.clear();
+}
+
+Octnode* OctnodePool::allocate() {
+    lock.lock();
+    if ( free_blocks.empty() )
+        grow();
+    Octnode* block = free_blocks.back();
+    free_blocks.pop_back();
+    ++in_use;
+    lock.unlock();
+    return block;
+}
+
+void OctnodePool::release(Octnode* block) {
+    assert( block );
+    lock.lock();
+    assert( in_use > 0 );
+    free_blocks.push_back( block );
+    --in_use;
+    lock.unlock();
+}
+
+void OctnodePool::grow() {
+    char* slab = static_cast<char*>( ::operator new( slab_blocks*block_bytes ) );
+    slabs.push_back( slab );
+    free_blocks.reserve( free_blocks.size() + slab_blocks );
+    // push in reverse, so that allocate() hands out the slab front-to-back
+    for ( std::size_t n=slab_blocks; n>0; --n )
+        free_blocks.push_back( reinterpret_cast<Octnode*>( slab + (n-1)*block_bytes ) );
+}
+
+std::size_t OctnodePool::bytes() const {
+    return slabs.size()*slab_blocks*block_bytes;
+}
+
+std::string OctnodePool::str() const {
+    std::ostringstream o;
+    o << " OctnodePool: " << in_use << " blocks in use, " << slabs.size() << " slabs, "
+      << bytes()/1024 << " kB (" << block_bytes << " bytes/block)\n";
+    return o.str();
+}
+
+} // end namespace
+// end of file octnode_pool.cpp
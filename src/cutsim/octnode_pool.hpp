@@ -0,0 +1,95 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCTNODE_POOL_H
+#define OCTNODE_POOL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "task_scheduler.hpp"
+
+namespace cutsim {
+
+class Octnode;
+class GLData;
+
+/// \class OctnodePool
+/// fixed-size block allocator for Octnode children.
+///
+/// Octnode::subdivide() always creates all eight children at once, and
+/// Octnode::delete_children() always deletes all eight, so the pool hands out
+/// storage for eight Octnodes as one contiguous block. Blocks are carved out
+/// of large slabs, and released blocks go onto a free-list for re-use.
+/// This replaces eight calls to new/delete per subdivision and keeps
+/// siblings next to each other in memory.
+///
+/// The pool only manages raw storage, the caller constructs the Octnodes
+/// with placement-new and calls the destructor explicitly before release().
+/// allocate() and release() may be called from several threads at once.
+///
+/// A pool serves the nodes of one Octree, and also holds the GLData of that tree,
+/// so that the nodes do not need a pointer of their own to it.
+class OctnodePool {
+public:
+    /// create a pool which allocates slabs of blocks_per_slab blocks at a time
+    OctnodePool(std::size_t blocks_per_slab = 512);
+    virtual ~OctnodePool();
+    /// return raw storage for eight (unconstructed) Octnodes
+    Octnode* allocate();
+    /// return a block previously obtained from allocate() to the free-list
+    void release(Octnode* block);
+    /// number of blocks currently handed out
+    std::size_t blocks_in_use() const { return in_use; }
+    /// number of slabs allocated from the heap
+    std::size_t slab_count() const { return slabs.size(); }
+    /// total bytes held by the pool
+    std::size_t bytes() const;
+    /// set the GLData from which the vertices of deleted nodes are removed
+    void set_gldata(GLData* gl) { g = gl; }
+    /// the GLData of the nodes allocated from this pool
+    GLData* gldata() const { return g; }
+    /// string output
+    std::string str() const;
+private:
+    /// allocate a new slab and put its blocks on the free-list
+    void grow();
+    /// storage for eight Octnodes
+    std::size_t block_bytes;
+    /// number of blocks per slab
+    std::size_t slab_blocks;
+    /// the slabs, each holding slab_blocks blocks
+    std::vector<char*> slabs;
+    /// blocks ready to be handed out by allocate()
+    std::vector<Octnode*> free_blocks;
+    /// number of blocks currently in use
+    std::size_t in_use;
+    /// the GLData of the tree
+    GLData* g;
+    /// protects the free-list, for Octree operations running on several threads
+    Lock lock;
+
+    OctnodePool(const OctnodePool&);
+    OctnodePool& operator=(const OctnodePool&);
+};
+
+} // end namespace
+#endif
+// end file octnode_pool.hpp
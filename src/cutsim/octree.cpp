@@ -19,6 +19,8 @@
 
 #include <list>
 #include <cassert>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -27,28 +29,80 @@
 #include "octree.hpp"
 #include "octnode.hpp"
 #include "volume.hpp"
+#include "instrumentation.hpp"
 
 namespace cutsim {
 
+static Stage sum_stage("octree.sum");
+static Stage diff_stage("octree.diff");
+static Stage intersect_stage("octree.intersect");
+static Counter deferred_counter("octree.deferred");
+static Counter dropped_counter("octree.dropped");
+static Counter pushed_counter("octree.pushed");
+static Counter contained_counter("octree.contained");
+
 //**************** Octree ********************/
 
+// the children of a node span a 3x3x3 lattice, with index x + 3*y + 9*z.
+// corner n of child m is at (1,1,1) + ( Octnode::direction[m] + Octnode::direction[n] )/2
+const unsigned char Octree::child_corner[8][8] = {
+    { 8,  7,  4,  5, 17, 16, 13, 14},   // child 0
+    { 7,  6,  3,  4, 16, 15, 12, 13},   // child 1
+    { 4,  3,  0,  1, 13, 12,  9, 10},   // child 2
+    { 5,  4,  1,  2, 14, 13, 10, 11},   // child 3
+    {17, 16, 13, 14, 26, 25, 22, 23},   // child 4
+    {16, 15, 12, 13, 25, 24, 21, 22},   // child 5
+    {13, 12,  9, 10, 22, 21, 18, 19},   // child 6
+    {14, 13, 10, 11, 23, 22, 19, 20}    // child 7
+};
+
+const unsigned int Octree::none;
+
+Octree::ChildSamples::ChildSamples() {
+    known = 0;
+}
+
+Octree::ChildSamples::ChildSamples(const double* parent_d) {
+    known = 0;
+    for ( int n=0;n<8;++n) { // corner n of the parent is corner n of child n
+        d[ child_corner[n][n] ] = parent_d[n];
+        known |= ( 1u << child_corner[n][n] );
+    }
+}
+
 Octree::Octree(double scale, unsigned int  depth, GLVertex& centerp, GLData* gl) {
     root_scale = scale;
     max_depth = depth;
     g = gl;
                     // parent, idx, scale, depth
-    root = new Octnode( NULL , 0, root_scale, 0 , g);
-    root->center = new GLVertex(centerp);
-    for ( int n=0;n<8;++n) {
-        root->child[n] = NULL;
-    }
+    pool.set_gldata( g );
+    root = new Octnode( NULL , 0, root_scale, 0 , &pool);
+    root->setCenter( centerp );
+    set_lattice( samples );
+    scheduler.set_threads(1);
+    parallel_depth = 3;
+    tolerance = 0.0;
+    max_pending = 0;
+    pending_leaves = 0;
+    free_deferred = none;
+    interval = false;
     debug = false;
     debug_mc = false;
+    track_dirty = false;
 }
 
 Octree::~Octree() {
     delete root;
     root = 0;
+    BOOST_FOREACH( DistanceCache* cache, extra_samples ) {
+        delete cache;
+    }
+    BOOST_FOREACH( const Copy& c, copies ) {
+        delete c.vol;
+    }
+    BOOST_FOREACH( DistanceCache* cache, replay_samples ) {
+        delete cache;
+    }
 }
 
 unsigned int Octree::get_max_depth() const {
@@ -87,7 +141,7 @@ void Octree::get_invalid_leaf_nodes(Octnode* current, std::vector<Octnode*>& nod
         for ( int n=0;n<8;++n) {
             if ( current->hasChild(n) ) {
                 if ( !current->valid() ) {
-                    get_leaf_nodes( current->child[n], nodelist );
+                    get_leaf_nodes( current->child(n), nodelist );
                 }
             }
         }
@@ -101,8 +155,8 @@ void Octree::get_leaf_nodes(Octnode* current, std::vector<Octnode*>& nodelist) c
         nodelist.push_back( current );
     } else {
         for ( int n=0;n<8;++n) {
-            if ( current->child[n] != 0 )
-                get_leaf_nodes( current->child[n], nodelist );
+            if ( current->hasChild(n) )
+                get_leaf_nodes( current->child(n), nodelist );
         }
     }
 }
@@ -112,85 +166,637 @@ void Octree::get_all_nodes(Octnode* current, std::vector<Octnode*>& nodelist) co
     if ( current ) {
         nodelist.push_back( current );
         for ( int n=0;n<8;++n) {
-            if ( current->child[n] != 0 )
-                get_all_nodes( current->child[n], nodelist );
+            if ( current->hasChild(n) )
+                get_all_nodes( current->child(n), nodelist );
         }
     }
 }
 
-// sum (union) of tree and OCTVolume
-void Octree::sum(Octnode* current, const Volume* vol) {
-    if ( !vol->bb.overlaps( current->bb ) || current->is_inside() ) // if no overlap, or already INSIDE, then quit.
-        return; // abort if no overlap.
-    
-    current->sum(vol);
-    if ( (current->childcount == 8) && current->is_undecided()  ) { // recurse into existing tree
-        for(int m=0;m<8;++m) {
-            if ( !current->child[m]->is_inside()  ) // nodes that are already INSIDE cannot change in a sum-operation
-                sum( current->child[m], vol); // call sum on children
+/// a node above parallel_depth whose children are being operated on by separate tasks.
+/// the task that finishes last completes the node.
+struct Octree::Join {
+    Join(Octnode* n, Join* p) : node(n), parent(p), remaining(0), spawned(0) {}
+    /// the node
+    Octnode* node;
+    /// the Join of the parent of node, NULL for the root
+    Join* parent;
+    /// number of child tasks not yet done
+    int remaining;
+    /// bit m set if child m was handed to a task
+    unsigned int spawned;
+    /// the state of each spawned child before the operation
+    Octnode::NodeState state[8];
+};
+
+/// operate on one node. nodes at parallel_depth are done recursively by one task,
+/// above that the children of the node are spawned as separate tasks.
+class Octree::OperationTask : public Task {
+public:
+    /// operate on node. family holds the samples shared with siblings, NULL for the root.
+    OperationTask(Octree* t, Octnode* n, const Volume* v, Operation o, unsigned int c, const ChildSamples* f, Join* j) 
+        : tree(t), node(n), vol(v), op(o), copy(c), family(f ? *f : ChildSamples()), has_family(f != NULL), join(j) {}
+    void run(TaskScheduler& scheduler, unsigned int worker);
+private:
+    Octree* tree;
+    Octnode* node;
+    const Volume* vol;
+    Operation op;
+    unsigned int copy;
+    ChildSamples family;
+    bool has_family;
+    Join* join;
+};
+
+void Octree::OperationTask::run(TaskScheduler& scheduler, unsigned int worker) {
+    DistanceCache& cache = tree->worker_samples(worker);
+    ChildSamples* f = has_family ? &family : NULL;
+    if ( node->depth >= tree->parallel_depth ) {
+        tree->apply( node, vol, op, copy, f, cache ); // the whole subtree on this thread
+    } else if ( !tree->skip( node, vol, op ) ) {
+        double d[8];
+        tree->sample( node, vol, f, cache, d );
+        ChildSamples children(d);
+        bool split = tree->refine( node, vol, op, copy, d, children, cache );
+        tree->operate( node, vol, op, d );
+        if ( tree->descend( node, vol, op, split, children, cache ) ) {
+            Join* j = new Join( node, join );
+            for (int m=0;m<8;++m) {
+                Octnode* c = node->child(m);
+                if ( !tree->skip( c, vol, op ) ) {
+                    j->spawned |= (1u<<m);
+                    j->state[m] = c->state;
+                    c->parent = NULL; // stop propagation of state and valid-flag at c, Octree::finish() does it
+                    ++j->remaining;
+                }
+            }
+            if ( j->remaining > 0 ) {
+                for (int m=0;m<8;++m) {
+                    if ( j->spawned & (1u<<m) )
+                        scheduler.spawn( new OperationTask( tree, node->child(m), vol, op, copy, &children, j ), worker );
+                }
+                return; // the last child to finish completes node
+            }
+            delete j;
         }
-    } else if ( current->is_undecided() ) { // no children, subdivide if undecided
-        if ( (current->depth < (this->max_depth-1)) ) {
-            current->subdivide(); // smash into 8 sub-pieces
-            for(int m=0;m<8;++m) 
-                sum( current->child[m], vol); // call sum on children
+        tree->prune( node );
+    }
+    tree->finish( join );
+}
+
+void Octree::set_threads(unsigned int n) {
+    scheduler.set_threads(n);
+    BOOST_FOREACH( DistanceCache* cache, extra_samples ) {
+        delete cache;
+    }
+    extra_samples.clear();
+    for (unsigned int w=1; w<scheduler.threads(); ++w) {
+        extra_samples.push_back( new DistanceCache() );
+        set_lattice( *extra_samples.back() );
+    }
+}
+
+// corners lie on a lattice with the spacing of the half-side of the smallest node
+void Octree::set_lattice(DistanceCache& cache) const {
+    cache.set_lattice( root->center() - GLVertex(root_scale, root_scale, root_scale),
+                       root_scale / pow(2.0, (int)max_depth-1), max_depth );
+}
+
+void Octree::apply(const Volume* vol, Operation op) {
+    CUTSIM_TIMER( (op==SUM) ? sum_stage : (op==DIFF) ? diff_stage : intersect_stage );
+    samples.clear();
+    unsigned int operation_copy = none;
+    if ( max_pending ) // the caller may change vol after this operation, so it is cloned if it is deferred
+        operation_copy = new_copy();
+    if ( threads() == 1 ) {
+        apply( root, vol, op, operation_copy, NULL, samples );
+    } else {
+        BOOST_FOREACH( DistanceCache* cache, extra_samples ) {
+            cache->clear();
         }
+        if (g)
+            g->beginDeferredRemoval(); // nodes on several threads remove vertices
+        scheduler.run( new OperationTask( this, root, vol, op, operation_copy, NULL, NULL ) );
+        if (g)
+            g->endDeferredRemoval();
     }
-    // now all children of current have their status set, and we can prune.
-    if ( (current->childcount == 8) && ( current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE) ) ) {
-        current->delete_children();
+    if ( operation_copy != none ) {
+        pending_lock.lock();
+        release( operation_copy );
+        pending_lock.unlock();
+    }
+}
+
+void Octree::apply(Octnode* current, const Volume* vol, Operation op, unsigned int copy, ChildSamples* family, DistanceCache& cache) {
+    if ( skip( current, vol, op ) )
+        return;
+    double d[8];
+    sample(current, vol, family, cache, d);
+    ChildSamples children(d);
+    bool split = refine(current, vol, op, copy, d, children, cache);
+    operate(current, vol, op, d);
+    if ( descend(current, vol, op, split, children, cache) ) {
+        for(int m=0;m<8;++m)
+            apply( current->child(m), vol, op, copy, &children, cache );
     }
+    prune(current);
 }
 
+bool Octree::skip(Octnode* node, const Volume* vol, Operation op) const {
+    if ( op == INTERSECT )
+        return node->is_outside();
+    if ( op == SUM ? node->is_inside() : node->is_outside() ) // sum cannot change INSIDE nodes, diff cannot change OUTSIDE nodes
+        return true;
+    Bbox box = node->bb();
+    if ( !vol->overlaps( box ) )
+        return true;
+    if ( !node->isLeaf() || node->lazy ) // the field below is not known from the corners
+        return false;
+    // a leaf does not change if the field at all corners is closer to the surface than vol
+    double distance = vol->distance( box );
+    if ( distance <= 0.0 )
+        return false;
+    for ( int n=0;n<8;++n ) {
+        if ( ( op == SUM ? -node->f[n] : node->f[n] ) > distance )
+            return false;
+    }
+    return true;
+}
 
-void Octree::diff(Octnode* current, const Volume* vol) {
-    if (  !vol->bb.overlaps( current->bb ) || current->is_outside() ) // if no overlap, or already OUTSIDE, then quit.
-        return;   
-    
-    current->diff(vol);
-    if ( ((current->childcount) == 8) && current->is_undecided() ) { // recurse into existing tree
-        for(int m=0;m<8;++m) {
-            //if ( !current->child[m]->is_outside()  ) // nodes that are OUTSIDE don't change
-                diff( current->child[m], vol); // call diff on children
+void Octree::operate(Octnode* node, const Volume* vol, Operation op, const double* d) {
+    if ( op == SUM )
+        node->sum(vol, d);
+    else if ( op == DIFF )
+        node->diff(vol, d);
+    else
+        node->intersect(vol, d);
+}
+
+double Octree::combine(Operation op, double f, double d) {
+    if ( op == SUM )
+        return std::max( f, d );
+    else if ( op == DIFF )
+        return std::min( f, -d );
+    else
+        return std::min( f, d );
+}
+
+bool Octree::refine(Octnode* current, const Volume* vol, Operation op, unsigned int copy, const double* d, ChildSamples& children, DistanceCache& cache) {
+    if ( !current->isLeaf() ) {
+        bool corners = ( op != INTERSECT ); // dist() is single precision, so check the corners too
+        for ( int n=0;n<8 && corners;++n )
+            corners = ( d[n] > 0.0 );
+        if ( corners && vol->contains( current->bb() ) ) { // op makes all of current INSIDE or OUTSIDE
+            clear( current );
+            CUTSIM_COUNT( contained_counter, 1 );
+            return false;
         }
-    } else if (  current->is_undecided() ) { // no children, subdivide if undecided 
-        if ( (current->depth < (this->max_depth-1)) ) {
-            current->subdivide(); // smash into 8 sub-pieces
-            for(int m=0;m<8;++m) {
-                diff( current->child[m], vol); // call diff on children
-            }
+        return true;
+    }
+    if ( current->depth >= (this->max_depth-1) )
+        return false;
+    double linear = 0.0; // the field after op at the center, interpolated from the corners
+    bool inside = true;
+    bool outside = true;
+    bool covers = true; // op alone decides all corners, and so all of current for a convex Volume
+    for ( int n=0;n<8;++n) {
+        double value = combine( op, current->f[n], d[n] );
+        linear += value/8.0;
+        if ( value >= 0.0 )
+            outside = false;
+        else
+            inside = false;
+        if ( op == SUM ? d[n] < 0.0 : ( op == DIFF ? d[n] <= 0.0 : d[n] >= 0.0 ) )
+            covers = false;
+    }
+    if ( current->lazy ) {
+        if ( covers ) { // the deferred operations do not matter
+            drop( current );
+            return false;
+        }
+        // the corners of current may all be decided by the deferred operations, while material 
+        // between them is not. only the children can tell.
+        if ( !inside && !outside && copy != none && defer( current, vol, op, copy ) )
+            return false;
+        DistanceCache* replay = take_replay_samples(); // cache holds samples of vol
+        push( current, copy != none, *replay ); // the children may defer op, if current could.
+        give_replay_samples( replay );
+        return true;
+    }
+    if ( inside || outside ) // current will not be undecided, there is nothing to subdivide unless vol is between the corners
+        return passes( current, vol, op, d );
+    if ( tolerance > 0.0 ) {
+        if ( !( children.known & (1u<<13) ) ) { // the center of current is lattice point 13 of its children
+            GLVertex p = current->center();
+            cache.dist( vol, &p, NULL, &children.d[13], 1 );
+            children.known |= (1u<<13);
+        }
+        // the field at the center before op, as the children of current would be initialized
+        double before = current->is_undecided() ? current->field( current->center() ) : ( current->is_inside() ? 1.0 : -1.0 );
+        if ( fabs( combine( op, before, children.d[13] ) - linear ) <= tolerance && !passes( current, vol, op, d ) )
+            return false; // flat, current stays a leaf
+    }
+    if ( copy != none && !current->is_undecided() && defer( current, vol, op, copy ) )
+        return false;
+    if ( current->is_undecided() ) { // left as a leaf by an earlier operation, the children interpolate its field
+        current->prev_state = Octnode::UNDECIDED;
+        current->subdivide();
+        mark_dirty( current );
+        for (int m=0;m<8;++m) { // the surface of current is now in the children, op may skip some of them
+            if ( current->child(m)->is_undecided() )
+                mark_dirty( current->child(m) );
+        }
+    }
+    return true;
+}
+
+bool Octree::passes(const Octnode* current, const Volume* vol, Operation op, const double* d) const {
+    if ( !interval || op == INTERSECT )
+        return false;
+    for ( int n=0;n<8;++n ) {
+        if ( d[n] > 0.0 ) // the corners see vol
+            return false;
+    }
+    return vol->distance( current->bb() ) == 0.0;
+}
+
+void Octree::set_lazy(unsigned int n) {
+    if ( n == 0 )
+        flush();
+    max_pending = n;
+}
+
+bool Octree::defer(Octnode* current, const Volume* vol, Operation op, unsigned int copy) {
+    bool kept = false;
+    pending_lock.lock();
+    if ( 2*(pending_leaves+1) > pending.size() ) { // grow, keeping the table at most half full
+        std::vector<PendingList> old;
+        old.swap( pending );
+        PendingList empty = { NULL, none, none, 0 };
+        pending.resize( std::max( (std::size_t)64, 2*old.size() ), empty );
+        BOOST_FOREACH( const PendingList& list, old ) {
+            if ( list.node )
+                pending[ find_pending( list.node ) ] = list;
+        }
+    }
+    PendingList& list = pending[ find_pending( current ) ];
+    if ( list.count < max_pending ) {
+        if ( free_deferred == none ) {
+            Pending p = { op, none, none };
+            free_deferred = deferred.size();
+            deferred.push_back( p );
+        }
+        unsigned int idx = free_deferred;
+        free_deferred = deferred[idx].next;
+        deferred[idx].op = op;
+        deferred[idx].copy = copy;
+        deferred[idx].next = none;
+        if ( !copies[copy].vol )
+            copies[copy].vol = vol->clone();
+        ++copies[copy].refs;
+        if ( list.node )
+            deferred[list.last].next = idx;
+        else {
+            list.node = current;
+            list.first = idx;
+            ++pending_leaves;
+        }
+        list.last = idx;
+        ++list.count;
+        kept = true;
+    }
+    pending_lock.unlock();
+    if ( kept ) {
+        current->lazy = 1;
+        CUTSIM_COUNT( deferred_counter, 1 );
+    }
+    return kept;
+}
+
+void Octree::drop(Octnode* current) {
+    pending_lock.lock();
+    std::size_t slot = find_pending( current );
+    CUTSIM_COUNT( dropped_counter, pending[slot].count );
+    for ( unsigned int idx = pending[slot].first; idx != none; ) {
+        unsigned int next = deferred[idx].next;
+        release( deferred[idx].copy );
+        deferred[idx].next = free_deferred;
+        free_deferred = idx;
+        idx = next;
+    }
+    erase_pending( slot );
+    pending_lock.unlock();
+    current->lazy = 0;
+}
+
+void Octree::push(Octnode* current, bool lazy, DistanceCache& cache) {
+    pending_lock.lock();
+    std::size_t slot = find_pending( current );
+    unsigned int idx = pending[slot].first;
+    CUTSIM_COUNT( pushed_counter, pending[slot].count );
+    erase_pending( slot );
+    pending_lock.unlock();
+    current->lazy = 0;
+    // before the first deferred operation current was INSIDE or OUTSIDE, its prev_state, and so are the children.
+    // the corner values of current already include the operations.
+    current->subdivide();
+    mark_dirty( current );
+    while ( idx != none ) {
+        pending_lock.lock(); // deferred may grow while the children defer operations
+        Pending p = deferred[idx];
+        const Volume* vol = copies[p.copy].vol;
+        deferred[idx].next = free_deferred;
+        free_deferred = idx;
+        pending_lock.unlock();
+        cache.clear();
+        for (int m=0;m<8;++m)
+            apply( current->child(m), vol, p.op, lazy ? p.copy : none, NULL, cache );
+        pending_lock.lock(); // after the children took their references to the copy
+        release( p.copy );
+        pending_lock.unlock();
+        idx = p.next;
+    }
+}
+
+std::size_t Octree::find_pending(const Octnode* node) const {
+    std::size_t mask = pending.size()-1;
+    // multiplicative hash of the address, the low bits are the same for all nodes
+    std::size_t slot = (std::size_t)( ( (boost::uint64_t)(std::size_t)node * 0x9E3779B97F4A7C15ULL ) >> 32 ) & mask;
+    while ( pending[slot].node && pending[slot].node != node )
+        slot = (slot+1) & mask;
+    return slot;
+}
+
+void Octree::erase_pending(std::size_t slot) {
+    std::size_t mask = pending.size()-1;
+    PendingList empty = { NULL, none, none, 0 };
+    pending[slot] = empty;
+    --pending_leaves;
+    // move back the lists that probed past the slot, so that find_pending() still reaches them
+    for ( std::size_t next = (slot+1) & mask; pending[next].node; next = (next+1) & mask ) {
+        std::size_t home = find_pending( pending[next].node );
+        if ( home != next ) { // the empty slot is on the probe sequence of the list
+            pending[slot] = pending[next];
+            pending[next] = empty;
+            slot = next;
         }
     }
-    // now all children have their status set, prune.
+}
+
+unsigned int Octree::new_copy() {
+    Copy c = { NULL, 1 };
+    if ( free_copies.empty() ) {
+        copies.push_back( c );
+        return copies.size()-1;
+    }
+    unsigned int idx = free_copies.back();
+    free_copies.pop_back();
+    copies[idx] = c;
+    return idx;
+}
+
+void Octree::release(unsigned int copy) {
+    if ( --copies[copy].refs == 0 ) {
+        delete copies[copy].vol;
+        copies[copy].vol = NULL;
+        free_copies.push_back( copy );
+    }
+}
+
+DistanceCache* Octree::take_replay_samples() {
+    DistanceCache* cache = NULL;
+    pending_lock.lock();
+    if ( !replay_samples.empty() ) {
+        cache = replay_samples.back();
+        replay_samples.pop_back();
+    }
+    pending_lock.unlock();
+    if ( !cache ) {
+        cache = new DistanceCache(64);
+        set_lattice( *cache );
+    }
+    return cache;
+}
+
+void Octree::give_replay_samples(DistanceCache* cache) {
+    pending_lock.lock();
+    replay_samples.push_back( cache );
+    pending_lock.unlock();
+}
+
+// the operations of a leaf are pushed one level down at a time, so that an operation 
+// which fills or removes a child drops the earlier operations on that child. 
+// the lists of the children are pushed in the next round.
+void Octree::flush() {
+    std::vector<Octnode*> nodes;
+    do {
+        nodes.clear();
+        BOOST_FOREACH( const PendingList& list, pending ) {
+            if ( list.node )
+                nodes.push_back( const_cast<Octnode*>( list.node ) );
+        }
+        BOOST_FOREACH( Octnode* node, nodes ) {
+            push( node, true, samples );
+            prune( node );
+        }
+    } while ( !nodes.empty() );
+}
+
+void Octree::flush(const Bbox& region) {
+    std::vector<Octnode*> nodes;
+    do {
+        nodes.clear();
+        BOOST_FOREACH( const PendingList& list, pending ) {
+            if ( list.node && list.node->bb().overlaps( region ) )
+                nodes.push_back( const_cast<Octnode*>( list.node ) );
+        }
+        BOOST_FOREACH( Octnode* node, nodes ) {
+            push( node, true, samples );
+            prune( node );
+        }
+    } while ( !nodes.empty() );
+}
+
+void Octree::clear(Octnode* current) {
+    for (int m=0;m<8;++m) {
+        Octnode* child = current->child(m);
+        if ( child->childcount == 8 )
+            clear( child );
+        else if ( child->lazy )
+            drop( child );
+        forget_dirty( child );
+    }
+    current->delete_subtree();
+    mark_dirty( current ); // the triangles of the subtree may be in a mesh chunk
+}
+
+bool Octree::descend(Octnode* current, const Volume* vol, Operation op, bool split, ChildSamples& children, DistanceCache& cache) {
+    if ( current->childcount != 8 ) { // no children, subdivide if undecided
+        if ( !split )
+            return false;
+        if ( current->is_undecided() )
+            current->subdivide(); // smash into 8 sub-pieces
+        else
+            current->force_subdivide(); // vol passes between the corners, see passes()
+        // the triangles of current are replaced by those of its children. they may be 
+        // in a mesh chunk instead of the vertex set of current, so mark also without GLData.
+        mark_dirty( current );
+    } else if ( !current->is_undecided() ) {
+        return false;
+    }
+    unsigned int visit = 0;
+    for(int m=0;m<8;++m) {
+        if ( !skip( current->child(m), vol, op ) )
+            visit |= (1u<<m);
+    }
+    sample_children(current, vol, visit, children, cache);
+    return true;
+}
+
+// now all children of current have their status set, and we can prune.
+void Octree::prune(Octnode* current) {
     if ( (current->childcount == 8) && ( current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE) ) ) {
+        for(int m=0;m<8;++m)
+            forget_dirty( current->child(m) );
         current->delete_children();
     }
+    if ( current->isLeaf() && !current->valid() )
+        mark_dirty( current );
 }
 
-void Octree::intersect(Octnode* current, const Volume* vol) {
-    if (   current->is_outside() ) // if already OUTSIDE, then quit.
-        return;   
-    
-    current->intersect(vol);
-    if ( ((current->childcount) == 8) && current->is_undecided() ) { // recurse into existing tree
-        for(int m=0;m<8;++m) {
-            //if ( !current->child[m]->is_outside()  ) // nodes that are OUTSIDE don't change
-                intersect( current->child[m], vol); // call diff on children
+void Octree::set_track_dirty(bool on) {
+    if ( !on ) {
+        std::vector<Octnode*> nodes;
+        take_dirty( nodes );
+    }
+    track_dirty = on;
+}
+
+void Octree::mark_dirty(Octnode* node) {
+    if ( !track_dirty || node->dirty_index >= 0 )
+        return;
+    dirty_lock.lock();
+    node->dirty_index = (int)dirty.size();
+    dirty.push_back( node );
+    dirty_lock.unlock();
+}
+
+void Octree::forget_dirty(Octnode* node) {
+    if ( !track_dirty )
+        return;
+    if ( node->dirty_index >= 0 ) {
+        dirty_lock.lock();
+        dirty[ node->dirty_index ] = NULL;
+        dirty_lock.unlock();
+        node->dirty_index = -1;
+    }
+    if ( node->childcount == 8 ) {
+        for(int m=0;m<8;++m)
+            forget_dirty( node->child(m) );
+    }
+}
+
+void Octree::take_dirty(std::vector<Octnode*>& nodes) {
+    BOOST_FOREACH( Octnode* node, dirty ) {
+        if ( node ) {
+            node->dirty_index = -1;
+            nodes.push_back( node );
         }
-    } else if (  current->is_undecided() ) { // no children, subdivide if undecided 
-        if ( (current->depth < (this->max_depth-1)) ) {
-            current->subdivide(); // smash into 8 sub-pieces
-            for(int m=0;m<8;++m) {
-                intersect( current->child[m], vol); // call diff on children
+    }
+    dirty.clear();
+}
+
+void Octree::take_dirty(const Bbox& region, std::vector<Octnode*>& nodes) {
+    std::size_t kept = 0;
+    BOOST_FOREACH( Octnode* node, dirty ) {
+        if ( !node )
+            continue;
+        if ( node->bb().overlaps( region ) ) {
+            node->dirty_index = -1;
+            nodes.push_back( node );
+        } else { // stays in the list
+            node->dirty_index = (int)kept;
+            dirty[kept++] = node;
+        }
+    }
+    dirty.resize( kept );
+}
+
+// called when a task is done with one child of join->node.
+// the last child re-attaches all children to the node, propagates their state
+// and valid-flag in the same order as the serial recursion, and prunes the node.
+// this completes the node, which is a child of join->parent.
+void Octree::finish(Join* join) {
+    while ( join ) {
+        int left;
+#ifdef _OPENMP
+        #pragma omp flush
+        #pragma omp atomic capture
+#endif
+        left = --join->remaining;
+#ifdef _OPENMP
+        #pragma omp flush
+#endif
+        if ( left > 0 )
+            return;
+        Octnode* node = join->node;
+        for(int m=0;m<8;++m) {
+            if ( join->spawned & (1u<<m) ) {
+                node->child(m)->parent = node;
+                node->child(m)->notify_parent( join->state[m] );
             }
         }
+        prune( node );
+        Join* parent = join->parent;
+        delete join;
+        join = parent;
     }
-    // now all children have their status set, prune.
-    if ( (current->childcount == 8) && ( current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE) ) ) {
-        current->delete_children();
+}
+
+DistanceCache& Octree::worker_samples(unsigned int worker) {
+    return (worker == 0) ? samples : *extra_samples[worker-1];
+}
+
+void Octree::sample(const Octnode* current, const Volume* vol, ChildSamples* family, DistanceCache& cache, double* d) {
+    if (!family) {
+        GLVertex p[8];
+        for ( int n=0;n<8;++n)
+            p[n] = current->corner(n);
+        cache.dist( vol, p, NULL, d, 8 );
+        return;
+    }
+    for ( int n=0;n<8;++n) {
+        unsigned int i = child_corner[current->idx][n];
+        if ( !( family->known & (1u<<i) ) ) { // not sampled by sample_children()
+            GLVertex p = current->corner(n);
+            cache.dist( vol, &p, NULL, &family->d[i], 1 );
+            family->known |= (1u<<i);
+        }
+        d[n] = family->d[i];
     }
 }
 
+void Octree::sample_children(const Octnode* current, const Volume* vol, unsigned int visit, ChildSamples& children, DistanceCache& cache) {
+    GLVertex p[27];
+    double d[27];
+    unsigned int index[27];
+    unsigned int count = 0;
+    for ( int m=0;m<8;++m) {
+        if ( !( visit & (1u<<m) ) )
+            continue;
+        for ( int n=0;n<8;++n) {
+            unsigned int i = child_corner[m][n];
+            if ( !( children.known & (1u<<i) ) ) {
+                p[count] = current->child(m)->corner(n);
+                index[count] = i;
+                ++count;
+                children.known |= (1u<<i);
+            }
+        }
+    }
+    cache.dist( vol, p, NULL, d, count );
+    for (unsigned int j=0;j<count;++j)
+        children.d[ index[j] ] = d[j];
+}
 
 // string repr
 std::string Octree::str() const {
@@ -201,7 +807,9 @@ std::string Octree::str() const {
     std::vector<int> nodelevel(this->max_depth);
     std::vector<int> invalidsAtLevel(this->max_depth);
     std::vector<int> surfaceAtLevel(this->max_depth);
+    std::size_t index_bytes = 0; // vertex and polygon indices held on the heap by the nodes
     BOOST_FOREACH( Octnode* n, nodelist) {
+        index_bytes += n->heap_bytes();
         ++nodelevel[n->depth];
         if ( !n->valid() ) 
             ++invalidsAtLevel[n->depth];
@@ -214,6 +822,15 @@ std::string Octree::str() const {
         o << "depth="<<m <<"  " << count << " nodes, " << invalidsAtLevel[m] << " invalid, surface=" << surfaceAtLevel[m] << " \n";
         ++m;
     }
+    o << pool.str();
+    std::size_t total_bytes = pool.bytes() + sizeof(Octnode) + index_bytes; // the root is not in the pool
+    o << " memory: " << sizeof(Octnode) << " bytes per Octnode, " << index_bytes << " bytes of node indices, ";
+    o << (double)total_bytes / nodelist.size() << " bytes per node in total\n";
+    if ( pending_leaves )
+        o << " " << pending_leaves << " leaves with deferred operations\n";
+    o << samples.str();
+    if ( threads() > 1 )
+        o << scheduler.str();
     return o.str();
 }
 
@@ -26,6 +26,9 @@
 
 #include "bbox.hpp"
 #include "gldata.hpp"
+#include "octnode_pool.hpp"
+#include "distance_cache.hpp"
+#include "task_scheduler.hpp"
 //#include "marching_cubes.hpp"
 
 namespace cutsim {
@@ -45,6 +48,28 @@ class Volume;
 ///
 /// This class stores the root Octnode and allows operations on the tree
 ///
+/// sum(), diff() and intersect() can run on several threads, see set_threads().
+/// nodes above parallel_depth are split into one task per child, and a
+/// TaskScheduler balances the subtrees over the threads.
+///
+/// with set_track_dirty(true) the operations also list the leaves they change,
+/// so that an IsoSurfaceAlgorithm can update only those, see take_dirty().
+///
+/// by default every undecided node is subdivided down to max_depth-1. With set_tolerance()
+/// a leaf is not subdivided if the distance-field at its center is within the tolerance
+/// of the value interpolated from its corners, so flat surfaces are covered by larger nodes.
+///
+/// with set_lazy() a leaf which an operation would subdivide instead keeps the operation 
+/// in a short list, and only its corner values are updated. When a later operation removes
+/// or fills the whole leaf, the list is dropped without ever subdividing. The operations are 
+/// pushed down when the list overflows, or by flush(), which an IsoSurfaceAlgorithm calls
+/// before it reads the tree. flush() pushes the lists one level at a time, so a later operation
+/// that removes or fills a child still drops the earlier ones there. The lists are kept in 
+/// pooled records, and the Volume of an operation is copied once, when it is first deferred.
+///
+/// a leaf is INSIDE or OUTSIDE when its eight corners are, so a small tool passing between 
+/// the corners of a coarse leaf is missed. With set_interval() a leaf is also subdivided 
+/// when no corner is inside the Volume but Volume::distance() says it may reach into the leaf.
 class Octree {
     public:
         /// create an octree with a root node with scale=root_scale, maximum
@@ -54,11 +79,39 @@ class Octree {
         
     // bolean operations on tree
         /// diff given Volume from tree
-        void diff(const Volume* vol) { diff( this->root, vol); }
+        void diff(const Volume* vol) { apply(vol, DIFF); }
         /// sum given Volume to tree
-        void sum(const Volume* vol) { sum( this->root, vol); }
+        void sum(const Volume* vol) { apply(vol, SUM); }
         /// intersect tree with given Volume
-        void intersect(const Volume* vol) { intersect( this->root, vol); }
+        void intersect(const Volume* vol) { apply(vol, INTERSECT); }
+        /// run sum(), diff() and intersect() on n threads, 0 for one thread per core. The default is 1.
+        void set_threads(unsigned int n);
+        /// number of threads used by sum(), diff() and intersect()
+        unsigned int threads() const { return scheduler.threads(); }
+        /// stop subdividing a leaf where the distance-field is linear within tol. 0 subdivides every undecided node, this is the default.
+        void set_tolerance(double tol) { tolerance = tol; }
+        /// the refinement tolerance, see set_tolerance()
+        double get_tolerance() const { return tolerance; }
+        /// defer at most max_pending operations on a leaf, before it is subdivided. 0 applies operations at once, this is the default.
+        void set_lazy(unsigned int max_pending);
+        /// the maximum number of deferred operations on a leaf, see set_lazy()
+        unsigned int get_lazy() const { return max_pending; }
+        /// subdivide the leaves a Volume may pass through between the corners. off by default.
+        void set_interval(bool on) { interval = on; }
+        /// true if leaves are classified with the distance bounds of the Volume, see set_interval()
+        bool get_interval() const { return interval; }
+        /// apply all deferred operations
+        void flush();
+        /// apply the deferred operations of the leaves which overlap region
+        void flush(const Bbox& region);
+        
+    // the nodes changed by an operation
+        /// keep a list of the nodes whose GLData is out of date after sum(), diff() and intersect(). The default is off.
+        void set_track_dirty(bool on);
+        /// move all nodes from the dirty list to nodes
+        void take_dirty(std::vector<Octnode*>& nodes);
+        /// move the nodes in the dirty list which overlap region to nodes
+        void take_dirty(const Bbox& region, std::vector<Octnode*>& nodes);
         
 // debug, can be removed?
         /// put all leaf-nodes in a list
@@ -92,19 +145,162 @@ class Octree {
         unsigned int max_depth;
         /// pointer to the root node
         Octnode* root;
+        /// storage for all nodes below the root
+        OctnodePool pool;
+        /// distance samples at corner vertices, shared by all nodes during one operation
+        DistanceCache samples;
+        /// nodes at this depth are operated on recursively by one task, nodes above it are split into tasks
+        unsigned int parallel_depth;
         
     protected:
-        /// recursively traverse the tree subtracting Volume
-        void diff(Octnode* current, const Volume* vol);
-        /// union Octnode with Volume
-        void sum(Octnode* current, const Volume* vol);
-        /// intersect Octnode with Volume
-        void intersect(Octnode* current, const Volume* vol);
+        /// the boolean operations
+        enum Operation { SUM, DIFF, INTERSECT };
+        /// distance samples at the 27 lattice points spanned by the eight children of a node.
+        /// siblings share these corners, so they are looked up once per family.
+        struct ChildSamples {
+            /// nothing known
+            ChildSamples();
+            /// initialize with the distances d[8] at the corners of the parent
+            ChildSamples(const double* d);
+            /// distance at lattice point n, x + 3*y + 9*z
+            double d[27];
+            /// bit n set if d[n] is known
+            unsigned int known;
+        };
+        /// marks the end of a list of deferred operations, and an operation that is not deferred
+        static const unsigned int none = ~0u;
+        /// an operation deferred on a leaf, see set_lazy(). the operations of a leaf 
+        /// are linked in the order they were applied, the records are kept in deferred.
+        struct Pending {
+            /// the operation
+            Operation op;
+            /// index of the Volume in copies
+            unsigned int copy;
+            /// index of the next operation of the same leaf in deferred, or none
+            unsigned int next;
+        };
+        /// the deferred operations of a leaf, one slot in the hash table pending
+        struct PendingList {
+            /// the leaf, NULL for an empty slot
+            const Octnode* node;
+            /// index of the first operation in deferred
+            unsigned int first;
+            /// index of the last operation in deferred
+            unsigned int last;
+            /// number of operations
+            unsigned int count;
+        };
+        /// a copy of the Volume of an operation, shared by the leaves on which the operation is deferred
+        struct Copy {
+            /// the copy, NULL until the operation is first deferred
+            const Volume* vol;
+            /// number of deferred operations using the copy, plus one while the operation runs
+            unsigned int refs;
+        };
+        struct Join;
+        class OperationTask;
+        /// apply op with vol to the tree
+        void apply(const Volume* vol, Operation op);
+        /// recursively apply op with vol below current. family holds the samples shared with siblings, NULL for the root.
+        /// op is deferred on leaves if copy is the index of a copy of vol in copies, or none, see set_lazy().
+        void apply(Octnode* current, const Volume* vol, Operation op, unsigned int copy, ChildSamples* family, DistanceCache& cache);
+        /// true if op with vol cannot change node: its state is final for op, it is outside the Bbox of vol,
+        /// or it is a leaf and vol is farther away than the field at its corners, see Volume::distance()
+        bool skip(Octnode* node, const Volume* vol, Operation op) const;
+        /// the value of the distance-field after op, where it was f and the Volume has distance d
+        static double combine(Operation op, double f, double d);
+        /// apply op to the f-values of node, d[n] is the distance of vol at corner n
+        void operate(Octnode* node, const Volume* vol, Operation op, const double* d);
+        /// called before op is applied to current, d[n] is the distance of vol at corner n. 
+        /// true if current should be subdivided when it is an undecided leaf after op. a leaf left undecided 
+        /// above max_depth-1 by the tolerance is subdivided here, before its field is changed by op.
+        /// if copy is not none, op is deferred instead of subdividing current.
+        /// the children of current are deleted if vol contains all of current, see Volume::contains().
+        /// a leaf that op leaves INSIDE or OUTSIDE is subdivided by descend() if passes() is true.
+        bool refine(Octnode* current, const Volume* vol, Operation op, unsigned int copy, const double* d, ChildSamples& children, DistanceCache& cache);
+        /// defer op on the leaf current, with copy the index in copies of a copy of vol. false if the list of current is full.
+        bool defer(Octnode* current, const Volume* vol, Operation op, unsigned int copy);
+        /// forget the deferred operations of current, which op alone makes INSIDE or OUTSIDE
+        void drop(Octnode* current);
+        /// subdivide the leaf current, and apply its deferred operations to the children. 
+        /// if lazy is true the operations may be deferred on the children, otherwise they are applied down to the leaves.
+        /// cache must not hold samples of another Volume, it is cleared for each operation.
+        void push(Octnode* current, bool lazy, DistanceCache& cache);
+        /// the slot of node in pending, or the empty slot where it would be inserted. call with pending_lock held.
+        std::size_t find_pending(const Octnode* node) const;
+        /// take the list in the given slot out of pending. call with pending_lock held.
+        void erase_pending(std::size_t slot);
+        /// a Copy slot for an operation about to run, with one reference. the Volume is cloned when it is first deferred.
+        unsigned int new_copy();
+        /// drop one reference to the Copy slot copy, deleting the Volume with the last one. call with pending_lock held.
+        void release(unsigned int copy);
+        /// a DistanceCache for the children of a leaf while its deferred operations are pushed, see push()
+        DistanceCache* take_replay_samples();
+        /// return a DistanceCache from take_replay_samples()
+        void give_replay_samples(DistanceCache* cache);
+        /// delete all nodes below current, with their entries in the dirty list and their deferred operations
+        void clear(Octnode* current);
+        /// true if vol may pass through current between its corners, see set_interval(). d[n] is the distance of vol at corner n.
+        bool passes(const Octnode* current, const Volume* vol, Operation op, const double* d) const;
+        /// subdivide current if split is true and it is required, and sample the children that op will change. false if there is nothing to do below current.
+        bool descend(Octnode* current, const Volume* vol, Operation op, bool split, ChildSamples& children, DistanceCache& cache);
+        /// delete the children of current if they are all INSIDE or all OUTSIDE, and put current in the dirty list if it is an invalid leaf
+        void prune(Octnode* current);
+        /// put node in the dirty list, unless it is there already
+        void mark_dirty(Octnode* node);
+        /// take node and all nodes below it out of the dirty list, before they are deleted
+        void forget_dirty(Octnode* node);
+        /// called by a task when it is done with a child of join->node
+        void finish(Join* join);
+        /// put the distance of vol at the corners of current into d[8]
+        void sample(const Octnode* current, const Volume* vol, ChildSamples* family, DistanceCache& cache, double* d);
+        /// sample the corners of the children of current given by the bit-mask visit, with one batch evaluation
+        void sample_children(const Octnode* current, const Volume* vol, unsigned int visit, ChildSamples& children, DistanceCache& cache);
+        /// the DistanceCache used by a worker thread
+        DistanceCache& worker_samples(unsigned int worker);
+        /// set the lattice of cache to the corners of the smallest nodes
+        void set_lattice(DistanceCache& cache) const;
+        /// index into ChildSamples::d of corner n of child m
+        static const unsigned char child_corner[8][8];
         
 
     // DATA
         /// the GLData used to draw this tree
         GLData* g;
+        /// refinement tolerance, see set_tolerance()
+        double tolerance;
+        /// the maximum number of deferred operations on a leaf, see set_lazy()
+        unsigned int max_pending;
+        /// subdivide the leaves a Volume may pass through, see set_interval()
+        bool interval;
+        /// the deferred operations of each leaf with Octnode::lazy set. an open-addressing hash table
+        /// keyed by the address of the leaf, the size is a power of two.
+        std::vector<PendingList> pending;
+        /// number of leaves in pending
+        std::size_t pending_leaves;
+        /// the records of all deferred operations, unused records are linked from free_deferred
+        std::vector<Pending> deferred;
+        /// the first unused record in deferred, or none
+        unsigned int free_deferred;
+        /// the Volume copies of deferred operations
+        std::vector<Copy> copies;
+        /// the unused slots in copies
+        std::vector<unsigned int> free_copies;
+        /// the caches not in use by push()
+        std::vector<DistanceCache*> replay_samples;
+        /// protects pending, deferred, copies and replay_samples, for operations running on several threads
+        Lock pending_lock;
+        /// runs the tasks of an operation on several threads
+        TaskScheduler scheduler;
+        /// the DistanceCache of worker threads 1, 2, ... (worker 0 uses samples)
+        std::vector<DistanceCache*> extra_samples;
+        /// true if the dirty list is kept
+        bool track_dirty;
+        /// the leaves changed by operations, and the nodes that were subdivided while they had vertices.
+        /// Octnode::dirty_index is the position of a node in this list. deleted nodes are set to NULL.
+        std::vector<Octnode*> dirty;
+        /// protects dirty, for operations running on several threads
+        Lock dirty_lock;
     private:
         Octree() {  }
         
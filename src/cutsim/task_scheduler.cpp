@@ -0,0 +1,208 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#include <sched.h>
+#endif
+
+#include <boost/foreach.hpp>
+
+#include "task_scheduler.hpp"
+
+namespace cutsim {
+
+Lock::Lock() {
+#ifdef _OPENMP
+    impl = new omp_lock_t;
+    omp_init_lock( static_cast<omp_lock_t*>(impl) );
+#else
+    impl = NULL;
+#endif
+}
+
+Lock::~Lock() {
+#ifdef _OPENMP
+    omp_destroy_lock( static_cast<omp_lock_t*>(impl) );
+    delete static_cast<omp_lock_t*>(impl);
+#endif
+}
+
+void Lock::lock() {
+#ifdef _OPENMP
+    omp_set_lock( static_cast<omp_lock_t*>(impl) );
+#endif
+}
+
+void Lock::unlock() {
+#ifdef _OPENMP
+    omp_unset_lock( static_cast<omp_lock_t*>(impl) );
+#endif
+}
+
+TaskScheduler::Worker::Worker() {
+    executed = 0;
+    stolen = 0;
+}
+
+TaskScheduler::TaskScheduler(unsigned int threads) {
+    pending = 0;
+    set_threads(threads);
+}
+
+TaskScheduler::~TaskScheduler() {
+    BOOST_FOREACH( Worker* w, workers ) {
+        delete w;
+    }
+}
+
+void TaskScheduler::set_threads(unsigned int threads) {
+#ifdef _OPENMP
+    if ( threads == 0 )
+        threads = omp_get_num_procs();
+#else
+    threads = 1;
+#endif
+    BOOST_FOREACH( Worker* w, workers ) {
+        delete w;
+    }
+    workers.clear();
+    for (unsigned int n=0; n<threads; ++n)
+        workers.push_back( new Worker() );
+}
+
+void TaskScheduler::run(Task* root) {
+    assert( pending == 0 );
+    BOOST_FOREACH( Worker* w, workers ) {
+        w->executed = 0;
+        w->stolen = 0;
+    }
+    pending = 1;
+    workers[0]->tasks.push_back( root );
+#ifdef _OPENMP
+    if ( workers.size() > 1 ) {
+        #pragma omp parallel num_threads( workers.size() )
+        {
+            work( omp_get_thread_num() );
+        }
+        return;
+    }
+#endif
+    work(0);
+}
+
+void TaskScheduler::spawn(Task* task, unsigned int worker) {
+    Worker* w = workers[worker];
+#ifdef _OPENMP
+    #pragma omp atomic
+#endif
+    pending += 1;
+    w->lock.lock();
+    w->tasks.push_back( task );
+    w->lock.unlock();
+}
+
+void TaskScheduler::work(unsigned int worker) {
+    for (;;) {
+        Task* task = pop(worker);
+        if ( !task )
+            task = steal(worker);
+        if ( task ) {
+            task->run( *this, worker );
+            delete task;
+            ++workers[worker]->executed;
+            // tasks spawned by task were counted before this, so pending
+            // only reaches zero when all work is done
+#ifdef _OPENMP
+            #pragma omp atomic
+#endif
+            pending -= 1;
+        } else {
+            int left;
+#ifdef _OPENMP
+            #pragma omp atomic read
+#endif
+            left = pending;
+            if ( left == 0 )
+                return;
+#ifdef _OPENMP
+            sched_yield(); // let the busy threads run, if there are more threads than cores
+#endif
+        }
+    }
+}
+
+Task* TaskScheduler::pop(unsigned int worker) {
+    Worker* w = workers[worker];
+    Task* task = NULL;
+    w->lock.lock();
+    if ( !w->tasks.empty() ) {
+        task = w->tasks.back();
+        w->tasks.pop_back();
+    }
+    w->lock.unlock();
+    return task;
+}
+
+Task* TaskScheduler::steal(unsigned int worker) {
+    for (unsigned int n=1; n<workers.size(); ++n) {
+        Worker* victim = workers[ (worker+n) % workers.size() ];
+        Task* task = NULL;
+        victim->lock.lock();
+        if ( !victim->tasks.empty() ) {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+        }
+        victim->lock.unlock();
+        if ( task ) {
+            ++workers[worker]->stolen;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+unsigned long TaskScheduler::tasks_run() const {
+    unsigned long n = 0;
+    BOOST_FOREACH( Worker* w, workers ) {
+        n += w->executed;
+    }
+    return n;
+}
+
+unsigned long TaskScheduler::tasks_stolen() const {
+    unsigned long n = 0;
+    BOOST_FOREACH( Worker* w, workers ) {
+        n += w->stolen;
+    }
+    return n;
+}
+
+std::string TaskScheduler::str() const {
+    std::ostringstream o;
+    o << " TaskScheduler: " << workers.size() << " threads, " << tasks_run() << " tasks, "
+      << tasks_stolen() << " stolen\n";
+    return o.str();
+}
+
+} // end namespace
+// end of file task_scheduler.cpp
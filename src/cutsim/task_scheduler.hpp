@@ -0,0 +1,129 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace cutsim {
+
+/// a mutex for data shared between threads, e.g. by TaskScheduler workers, or by GLData and its renderer.
+/// this wraps an OpenMP lock, without OpenMP lock() and unlock() do nothing.
+class Lock {
+public:
+    Lock();
+    ~Lock();
+    /// wait for, and take, the lock
+    void lock();
+    /// release the lock
+    void unlock();
+private:
+    /// the omp_lock_t. not a member, so that the layout of classes holding a Lock
+    /// does not depend on whether the includer is compiled with OpenMP.
+    void* impl;
+
+    Lock(const Lock&);
+    Lock& operator=(const Lock&);
+};
+
+/// locks a Lock for the lifetime of the Locker
+class Locker {
+public:
+    /// lock l
+    Locker(Lock* l) : l(l) { l->lock(); }
+    ~Locker() { l->unlock(); }
+private:
+    Lock* l;
+
+    Locker(const Locker&);
+    Locker& operator=(const Locker&);
+};
+
+class TaskScheduler;
+
+/// a unit of work run by a TaskScheduler
+class Task {
+public:
+    virtual ~Task() {}
+    /// do the work. worker is the index of the thread running the task,
+    /// new tasks are handed to scheduler.spawn()
+    virtual void run(TaskScheduler& scheduler, unsigned int worker) = 0;
+};
+
+/// \class TaskScheduler
+/// work-stealing scheduler on top of OpenMP threads.
+///
+/// each worker thread has its own deque of tasks. A worker pushes the tasks
+/// it spawns onto the back of its own deque, and runs tasks from the back (depth-first).
+/// an idle worker steals from the front of the other deques, where the
+/// oldest (and usually largest) tasks are.
+/// Without OpenMP all tasks run on the calling thread.
+class TaskScheduler {
+public:
+    /// create a scheduler with the given number of worker threads, 0 for one per core
+    TaskScheduler(unsigned int threads = 0);
+    virtual ~TaskScheduler();
+    /// set the number of worker threads, 0 for one per core
+    void set_threads(unsigned int threads);
+    /// number of worker threads
+    unsigned int threads() const { return (unsigned int)workers.size(); }
+    /// run root, and all tasks spawned by it, and return when all are done. tasks are deleted after they have run.
+    void run(Task* root);
+    /// queue a task for running. call this only from Task::run(), with the worker given to it.
+    void spawn(Task* task, unsigned int worker);
+    /// number of tasks run by run()
+    unsigned long tasks_run() const;
+    /// number of tasks run by another worker than the one that spawned them
+    unsigned long tasks_stolen() const;
+    /// string output
+    std::string str() const;
+private:
+    /// the tasks of one thread
+    struct Worker {
+        Worker();
+        /// tasks waiting to run
+        std::deque<Task*> tasks;
+        /// number of tasks run by this worker
+        unsigned long executed;
+        /// number of tasks stolen by this worker
+        unsigned long stolen;
+        /// protects tasks
+        Lock lock;
+    };
+    /// run tasks until there are no more
+    void work(unsigned int worker);
+    /// take a task from the back of our own deque, or NULL
+    Task* pop(unsigned int worker);
+    /// take a task from the front of another deque, or NULL
+    Task* steal(unsigned int worker);
+    /// one Worker for each thread
+    std::vector<Worker*> workers;
+    /// number of tasks spawned but not yet done
+    int pending;
+
+    TaskScheduler(const TaskScheduler&);
+    TaskScheduler& operator=(const TaskScheduler&);
+};
+
+} // end namespace
+#endif
+// end file task_scheduler.hpp
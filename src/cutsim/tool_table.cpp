@@ -0,0 +1,111 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <cctype>
+
+#include "tool_table.hpp"
+
+namespace cutsim {
+
+ToolTable::ToolTable(double tool_length) : length(tool_length) {}
+
+ToolTable::~ToolTable() {
+    clear();
+}
+
+void ToolTable::clear() {
+    for ( std::map<int, CutterVolume*>::iterator it = tools.begin(); it != tools.end(); ++it )
+        delete it->second;
+    tools.clear();
+}
+
+const CutterVolume* ToolTable::tool(int number) const {
+    std::map<int, CutterVolume*>::const_iterator it = tools.find(number);
+    return ( it != tools.end() ) ? it->second : NULL;
+}
+
+bool ToolTable::read(const std::string& path) {
+    info.clear();
+    std::ifstream file( path.c_str() );
+    if ( !file ) {
+        info.push_back( "cannot read tool table " + path );
+        return false;
+    }
+    clear();
+    static const float colors[4][3] = { {1,1,0}, {1,0,0}, {0,1,0}, {0,0,1} };
+    std::string line;
+    while ( std::getline(file, line) ) {
+        std::string::size_type semicolon = line.find(';');
+        std::string comment;
+        if ( semicolon != std::string::npos ) {
+            comment = line.substr( semicolon+1 );
+            line.erase( semicolon );
+        }
+        for ( std::string::size_type n=0; n<comment.size(); ++n )
+            comment[n] = std::tolower( comment[n] );
+        std::istringstream words(line);
+        std::string word;
+        int number = -1;
+        double diameter = 0.0;
+        while ( words >> word ) {
+            char letter = std::toupper( word[0] );
+            std::istringstream value( word.substr(1) );
+            if ( letter == 'T' )
+                value >> number;
+            else if ( letter == 'D' )
+                value >> diameter;
+        }
+        if ( number < 0 )
+            continue;
+        std::ostringstream msg;
+        if ( diameter <= 0.0 ) {
+            msg << "tool " << number << " has no diameter, it will cut with the default tool";
+            info.push_back( msg.str() );
+            continue;
+        }
+        double radius = diameter/2;
+        CutterVolume* cutter;
+        std::string shape;
+        if ( comment.find("ball") != std::string::npos ) {
+            cutter = new BallCutterVolume( radius, length );
+            shape = "ball";
+        } else if ( comment.find("bull") != std::string::npos ) {
+            cutter = new BullCutterVolume( radius, radius/2, length ); // the table has no corner radius
+            shape = "bull-nose";
+        } else if ( comment.find("drill") != std::string::npos ) {
+            cutter = new DrillCutterVolume( radius, length );
+            shape = "drill";
+        } else {
+            cutter = new CylCutterVolume( radius, length );
+            shape = "flat";
+        }
+        const float* c = colors[ tools.size() % 4 ];
+        cutter->setColor( c[0], c[1], c[2] );
+        delete tools[number]; // a number listed twice, the last one is used
+        tools[number] = cutter;
+        msg << "tool " << number << " is a " << shape << " cutter with diameter " << diameter;
+        info.push_back( msg.str() );
+    }
+    return true;
+}
+
+} // end namespace
+// end file tool_table.cpp
@@ -0,0 +1,63 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TOOL_TABLE_H
+#define TOOL_TABLE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "volume.hpp"
+
+namespace cutsim {
+
+/// \class ToolTable
+/// the cutters of an EMC2 tool table, with lines "T<number> P<pocket> D<diameter> Z<offset> ;comment".
+/// the comment selects the shape: "ball", "bull" or "drill", otherwise the tool is a flat end mill.
+class ToolTable {
+public:
+    /// create an empty table. the cutters are given the length tool_length.
+    ToolTable(double tool_length);
+    virtual ~ToolTable();
+    /// replace the tools with the ones in the tool table file at path. returns false if the file cannot be read.
+    bool read(const std::string& path);
+    /// the cutter for the given tool number, or NULL if the number is not in the table
+    const CutterVolume* tool(int number) const;
+    /// number of tools
+    unsigned int size() const { return tools.size(); }
+    /// a line of text for each tool read, and for each tool skipped, by the last read()
+    const std::vector<std::string>& messages() const { return info; }
+    /// delete all tools
+    void clear();
+private:
+    /// the tools, by tool number
+    std::map<int, CutterVolume*> tools;
+    /// length of the cutters
+    double length;
+    /// messages from read()
+    std::vector<std::string> info;
+
+    ToolTable(const ToolTable&);
+    ToolTable& operator=(const ToolTable&);
+};
+
+} // end namespace
+#endif
+// end file tool_table.hpp
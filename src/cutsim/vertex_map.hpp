@@ -0,0 +1,123 @@
+/*
+ *  Copyright 2010-2011 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of Cutsim / OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VERTEX_MAP_H
+#define VERTEX_MAP_H
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace cutsim {
+
+/// \class VertexMap
+/// hash map from the non-zero key of a shared vertex to its index in the GLData.
+///
+/// open addressing with linear probing in one flat array, so insert() and erase()
+/// do not allocate, except when the table grows. erase() moves the following
+/// entries of the probe sequence back, so the table has no tombstones.
+class VertexMap {
+public:
+    /// empty map
+    VertexMap() : count(0) {
+        table.resize(1024);
+    }
+    /// the index for key, or NOT_FOUND
+    unsigned int find(boost::uint64_t key) const {
+        std::size_t mask = table.size()-1;
+        for ( std::size_t n = hash(key) & mask; table[n].key; n = (n+1) & mask ) {
+            if ( table[n].key == key )
+                return table[n].index;
+        }
+        return NOT_FOUND;
+    }
+    /// set the index for key
+    void set(boost::uint64_t key, unsigned int index) {
+        if ( 2*(count+1) > table.size() ) // at most half full
+            grow();
+        std::size_t mask = table.size()-1;
+        std::size_t n = hash(key) & mask;
+        while ( table[n].key && table[n].key != key )
+            n = (n+1) & mask;
+        if ( !table[n].key )
+            ++count;
+        table[n].key = key;
+        table[n].index = index;
+    }
+    /// remove key
+    void erase(boost::uint64_t key) {
+        std::size_t mask = table.size()-1;
+        std::size_t n = hash(key) & mask;
+        while ( table[n].key != key ) {
+            if ( !table[n].key )
+                return; // not in the map
+            n = (n+1) & mask;
+        }
+        // move back the entries after n which would not be found with a hole at n
+        std::size_t hole = n;
+        for ( n = (n+1) & mask; table[n].key; n = (n+1) & mask ) {
+            std::size_t home = hash( table[n].key ) & mask;
+            if ( ( (n - home) & mask ) >= ( (n - hole) & mask ) ) {
+                table[hole] = table[n];
+                hole = n;
+            }
+        }
+        table[hole].key = 0;
+        --count;
+    }
+    /// number of keys
+    std::size_t size() const { return count; }
+    /// remove all keys
+    void clear() {
+        table.assign( table.size(), Slot() );
+        count = 0;
+    }
+    /// returned by find() for a key which is not in the map
+    static const unsigned int NOT_FOUND = 0xffffffffu;
+private:
+    /// a key and its index, key is zero for an empty slot
+    struct Slot {
+        Slot() : key(0), index(0) {}
+        boost::uint64_t key;
+        unsigned int index;
+    };
+    /// mix the bits of key
+    static inline std::size_t hash(boost::uint64_t key) {
+        return (std::size_t)( (key * 0x9e3779b97f4a7c15ULL) >> 29 );
+    }
+    /// double the number of slots
+    void grow() {
+        std::vector<Slot> old;
+        old.swap( table );
+        table.resize( 2*old.size() );
+        count = 0;
+        for ( std::size_t n=0; n<old.size(); ++n ) {
+            if ( old[n].key )
+                set( old[n].key, old[n].index );
+        }
+    }
+    /// the table, its size is a power of two
+    std::vector<Slot> table;
+    /// number of keys
+    std::size_t count;
+};
+
+} // end namespace
+#endif
+// end file vertex_map.hpp
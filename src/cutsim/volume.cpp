@@ -20,12 +20,28 @@
 
 #include <cassert>
 #include <cmath>
+#include <algorithm>
+#include <limits>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <boost/foreach.hpp>
 
 #include "volume.hpp"
 
 namespace cutsim {
 
+//************* Volume **************/
+
+void Volume::distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const {
+    for (unsigned int i=0; i<n; ++i)
+        d[i] = dist( GLVertex(x[i], y[i], z[i]) );
+}
+
 
 
 //************* Sphere **************/
@@ -42,6 +58,41 @@ double SphereVolume::dist(const GLVertex& p ) const {
     return radius-d; // positive inside. negative outside.
 }
 
+// the SIMD versions do the same single-precision arithmetic as GLVertex::norm(), 
+// so they return exactly the same values as dist()
+void SphereVolume::distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const {
+    unsigned int i=0;
+#if defined(__AVX__)
+    const __m256 cx = _mm256_set1_ps( center.x );
+    const __m256 cy = _mm256_set1_ps( center.y );
+    const __m256 cz = _mm256_set1_ps( center.z );
+    const __m256d r = _mm256_set1_pd( radius );
+    for ( ; i+8<=n; i+=8 ) {
+        __m256 dx = _mm256_sub_ps( cx, _mm256_loadu_ps(x+i) );
+        __m256 dy = _mm256_sub_ps( cy, _mm256_loadu_ps(y+i) );
+        __m256 dz = _mm256_sub_ps( cz, _mm256_loadu_ps(z+i) );
+        __m256 len = _mm256_sqrt_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(dx,dx), _mm256_mul_ps(dy,dy) ), _mm256_mul_ps(dz,dz) ) );
+        _mm256_storeu_pd( d+i,   _mm256_sub_pd( r, _mm256_cvtps_pd( _mm256_castps256_ps128(len) ) ) );
+        _mm256_storeu_pd( d+i+4, _mm256_sub_pd( r, _mm256_cvtps_pd( _mm256_extractf128_ps(len,1) ) ) );
+    }
+#elif defined(__SSE2__)
+    const __m128 cx = _mm_set1_ps( center.x );
+    const __m128 cy = _mm_set1_ps( center.y );
+    const __m128 cz = _mm_set1_ps( center.z );
+    const __m128d r = _mm_set1_pd( radius );
+    for ( ; i+4<=n; i+=4 ) {
+        __m128 dx = _mm_sub_ps( cx, _mm_loadu_ps(x+i) );
+        __m128 dy = _mm_sub_ps( cy, _mm_loadu_ps(y+i) );
+        __m128 dz = _mm_sub_ps( cz, _mm_loadu_ps(z+i) );
+        __m128 len = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy) ), _mm_mul_ps(dz,dz) ) );
+        _mm_storeu_pd( d+i,   _mm_sub_pd( r, _mm_cvtps_pd( len ) ) );
+        _mm_storeu_pd( d+i+2, _mm_sub_pd( r, _mm_cvtps_pd( _mm_movehl_ps(len,len) ) ) );
+    }
+#endif
+    for ( ; i<n; ++i )
+        d[i] = dist( GLVertex(x[i], y[i], z[i]) );
+}
+
 /// set the bounding box values
 void SphereVolume::calcBB() {
     bb.clear();
@@ -51,6 +102,17 @@ void SphereVolume::calcBB() {
     bb.addPoint( minpt );
 }
 
+double SphereVolume::distance(const Bbox& box) const {
+    return std::max( 0.0, box.distance(center) - radius );
+}
+
+bool SphereVolume::contains(const Bbox& box) const {
+    double dx = std::max( center.x - box.minpt.x, box.maxpt.x - center.x );
+    double dy = std::max( center.y - box.minpt.y, box.maxpt.y - center.y );
+    double dz = std::max( center.z - box.minpt.z, box.maxpt.z - center.z );
+    return dx*dx + dy*dy + dz*dz < radius*radius;
+}
+
 //************* Rectangle **************/
 
 RectVolume::RectVolume() {
@@ -58,102 +120,207 @@ RectVolume::RectVolume() {
     v1 = GLVertex(1,0,0); 
     v2 = GLVertex(0,1,0);
     v3 = GLVertex(0,0,1);
+    calcBB();
 }
 
-// FIXME??
+// the box is axis-aligned, see extent(), so the Bbox is the box.
 void RectVolume::calcBB() {
+    double min_x, max_x, min_y, max_y, min_z, max_z;
+    extent(min_x, max_x, min_y, max_y, min_z, max_z);
     bb.clear();
-    GLVertex maxp;
-    GLVertex minp;
-    double bignum = 1e6;
-    maxp = GLVertex(bignum,bignum,bignum);
-    minp = GLVertex( -bignum,-bignum,-bignum);
-    bb.addPoint( maxp  );
-    bb.addPoint( minp );
+    bb.addPoint( GLVertex(min_x, min_y, min_z) );
+    bb.addPoint( GLVertex(max_x, max_y, max_z) );
 }
 
+bool RectVolume::contains(const Bbox& box) const {
+    double min_x, max_x, min_y, max_y, min_z, max_z;
+    extent(min_x, max_x, min_y, max_y, min_z, max_z);
+    return ( min_x < box.minpt.x && box.maxpt.x < max_x ) &&
+           ( min_y < box.minpt.y && box.maxpt.y < max_y ) &&
+           ( min_z < box.minpt.z && box.maxpt.z < max_z );
+}
+
+void RectVolume::extent(double& min_x, double& max_x, double& min_y, double& max_y, double& min_z, double& max_z) const {
+    min_x = corner.x;
+    max_x = corner.x + v1.x;
+    min_y = corner.y;
+    max_y = corner.y + v2.y;
+    min_z = corner.z;
+    max_z = corner.z + v3.z;
+}
+
+// signed distance to an axis-aligned box. 
+// along each axis, the distance outside the slab between the two faces is 
+// max(min-p, p-max), which is negative inside the slab.
+// outside the box the distance is the length of the positive parts, 
+// inside it is the distance to the nearest face.
 double RectVolume::dist(const GLVertex& p) const {
-    // translate to origo
-    double max_x = corner.x + v1.x;
-    double min_x = corner.x;
-    double max_y = corner.y + v2.y;
-    double min_y = corner.y;
-    double max_z = corner.z + v3.z;
-    double min_z = corner.z;
-    double dOut = 0.0;
-
-    if ( (min_x <= p.x) && (p.x <= max_x) && (min_y <= p.y) && (p.y <= max_y) && (min_z <= p.z) && (p.z <= max_z) )   {
-        double xdist,ydist,zdist;
-        if ( (p.x-min_x) > (max_x-p.x) )
-            xdist = max_x-p.x;                    
-        else
-            xdist = p.x-min_x;
+    double min_x, max_x, min_y, max_y, min_z, max_z;
+    extent(min_x, max_x, min_y, max_y, min_z, max_z);
+    double dx = std::max( min_x - p.x, p.x - max_x );
+    double dy = std::max( min_y - p.y, p.y - max_y );
+    double dz = std::max( min_z - p.z, p.z - max_z );
+    double ox = std::max( dx, 0.0 );
+    double oy = std::max( dy, 0.0 );
+    double oz = std::max( dz, 0.0 );
+    double outside = sqrt( ox*ox + oy*oy + oz*oz );
+    double inside = std::min( std::max( dx, std::max( dy, dz ) ), 0.0 );
+    return -( outside + inside ); // positive inside
+}
 
-        if ( (p.y-min_y) > (max_y-p.y) )
-            ydist = max_y-p.y;                    
-        else
-            ydist = p.y-min_y;
-        
-        if ( (p.z-min_z) > (max_z-p.z) )
-            zdist = max_z-p.z;                    
-        else
-            zdist = p.z-min_z;
-
-        if ( xdist <= ydist && xdist <= zdist )
-            dOut = -xdist;
-        else if ( ydist < xdist && ydist < zdist )
-            dOut = -ydist;
-        else if ( zdist < xdist && zdist< xdist )
-            dOut = -zdist;
-        else {
-            assert(0);
-            return -1;
-        }
-    }else if ( (min_y <= p.y) && (p.y <= max_y) && (min_z <= p.z) && (p.z <= max_z) )   {
-        if (p.x < min_x) {
-            dOut = min_x - p.x;
-        } else if ( p.x > max_x ) {
-            dOut = p.x-max_x;
-        }
-    }else if ( (min_x <= p.x) && (p.x <= max_x) && (min_z <= p.z) && (p.z <= max_z) )   {
-        if (p.y < min_y) {
-            dOut = min_y - p.y;
-        } else if ( p.y > max_y ) {
-            dOut = p.y-max_y;
+void RectVolume::distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const {
+    unsigned int i=0;
+#if defined(__AVX__) || defined(__SSE2__)
+    double min_x, max_x, min_y, max_y, min_z, max_z;
+    extent(min_x, max_x, min_y, max_y, min_z, max_z);
+#endif
+#if defined(__AVX__)
+    const __m256d lox = _mm256_set1_pd(min_x), hix = _mm256_set1_pd(max_x);
+    const __m256d loy = _mm256_set1_pd(min_y), hiy = _mm256_set1_pd(max_y);
+    const __m256d loz = _mm256_set1_pd(min_z), hiz = _mm256_set1_pd(max_z);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    for ( ; i+4<=n; i+=4 ) {
+        __m256d px = _mm256_cvtps_pd( _mm_loadu_ps(x+i) );
+        __m256d py = _mm256_cvtps_pd( _mm_loadu_ps(y+i) );
+        __m256d pz = _mm256_cvtps_pd( _mm_loadu_ps(z+i) );
+        __m256d dx = _mm256_max_pd( _mm256_sub_pd(lox, px), _mm256_sub_pd(px, hix) );
+        __m256d dy = _mm256_max_pd( _mm256_sub_pd(loy, py), _mm256_sub_pd(py, hiy) );
+        __m256d dz = _mm256_max_pd( _mm256_sub_pd(loz, pz), _mm256_sub_pd(pz, hiz) );
+        __m256d ox = _mm256_max_pd( dx, zero );
+        __m256d oy = _mm256_max_pd( dy, zero );
+        __m256d oz = _mm256_max_pd( dz, zero );
+        __m256d outside = _mm256_sqrt_pd( _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd(ox,ox), _mm256_mul_pd(oy,oy) ), _mm256_mul_pd(oz,oz) ) );
+        __m256d inside = _mm256_min_pd( _mm256_max_pd( dx, _mm256_max_pd(dy, dz) ), zero );
+        _mm256_storeu_pd( d+i, _mm256_xor_pd( _mm256_add_pd(outside, inside), sign ) );
+    }
+#elif defined(__SSE2__)
+    const __m128d lox = _mm_set1_pd(min_x), hix = _mm_set1_pd(max_x);
+    const __m128d loy = _mm_set1_pd(min_y), hiy = _mm_set1_pd(max_y);
+    const __m128d loz = _mm_set1_pd(min_z), hiz = _mm_set1_pd(max_z);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d sign = _mm_set1_pd(-0.0);
+    for ( ; i+2<=n; i+=2 ) {
+        __m128d px = _mm_set_pd( x[i+1], x[i] );
+        __m128d py = _mm_set_pd( y[i+1], y[i] );
+        __m128d pz = _mm_set_pd( z[i+1], z[i] );
+        __m128d dx = _mm_max_pd( _mm_sub_pd(lox, px), _mm_sub_pd(px, hix) );
+        __m128d dy = _mm_max_pd( _mm_sub_pd(loy, py), _mm_sub_pd(py, hiy) );
+        __m128d dz = _mm_max_pd( _mm_sub_pd(loz, pz), _mm_sub_pd(pz, hiz) );
+        __m128d ox = _mm_max_pd( dx, zero );
+        __m128d oy = _mm_max_pd( dy, zero );
+        __m128d oz = _mm_max_pd( dz, zero );
+        __m128d outside = _mm_sqrt_pd( _mm_add_pd( _mm_add_pd( _mm_mul_pd(ox,ox), _mm_mul_pd(oy,oy) ), _mm_mul_pd(oz,oz) ) );
+        __m128d inside = _mm_min_pd( _mm_max_pd( dx, _mm_max_pd(dy, dz) ), zero );
+        _mm_storeu_pd( d+i, _mm_xor_pd( _mm_add_pd(outside, inside), sign ) );
+    }
+#endif
+    for ( ; i<n; ++i )
+        d[i] = dist( GLVertex(x[i], y[i], z[i]) );
+}
+
+//************* Union **************/
+
+UnionVolume::UnionVolume() {
+}
+
+UnionVolume::UnionVolume(const UnionVolume& other) : Volume(other) {
+    BOOST_FOREACH( const Volume* vol, other.volumes ) {
+        volumes.push_back( vol->clone() );
+    }
+}
+
+UnionVolume::~UnionVolume() {
+    clear();
+}
+
+void UnionVolume::add(const Volume* vol) {
+    if ( volumes.empty() ) {
+        bb = vol->bb;
+        color = vol->color;
+    } else {
+        bb.addPoint( vol->bb.minpt );
+        bb.addPoint( vol->bb.maxpt );
+    }
+    volumes.push_back( vol->clone() );
+}
+
+void UnionVolume::clear() {
+    BOOST_FOREACH( Volume* vol, volumes ) {
+        delete vol;
+    }
+    volumes.clear();
+    bb.clear();
+}
+
+double UnionVolume::dist(const GLVertex& p) const {
+    double d = -std::numeric_limits<double>::max();
+    BOOST_FOREACH( const Volume* vol, volumes ) {
+        double outside = vol->bb.distance(p);
+        if ( outside == 0.0 || -outside > d ) // otherwise vol->dist(p) cannot be larger than d
+            d = std::max( d, vol->dist(p) );
+    }
+    return d;
+}
+
+// the points are done in chunks. a Volume is evaluated for a chunk only if its Bbox
+// overlaps the Bbox of the chunk, or if it is closer than the smallest maximum found so far.
+void UnionVolume::distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const {
+    const unsigned int chunk = 32;
+    double t[chunk];
+    for (unsigned int i=0; i<n; i+=chunk) {
+        unsigned int m = std::min( chunk, n-i );
+        Bbox points;
+        for (unsigned int j=0; j<m; ++j) {
+            points.addPoint( GLVertex( x[i+j], y[i+j], z[i+j] ) );
+            d[i+j] = -std::numeric_limits<double>::max();
         }
-    }else if ( (min_x <= p.x) && (p.x <= max_x) && (min_y <= p.y) && (p.y <= max_y) )   {
-        if (p.z < min_z) {
-            dOut = min_z - p.z;
-        }else if ( p.z > max_z ) {
-            dOut = p.z-max_z;
+        double lowest = -std::numeric_limits<double>::max();
+        BOOST_FOREACH( const Volume* vol, volumes ) {
+            double outside = vol->distance(points);
+            if ( outside > 0.0 && -outside <= lowest )
+                continue;
+            vol->distances( x+i, y+i, z+i, t, m );
+            lowest = std::numeric_limits<double>::max();
+            for (unsigned int j=0; j<m; ++j) {
+                d[i+j] = std::max( d[i+j], t[j] );
+                lowest = std::min( lowest, d[i+j] );
+            }
         }
-    }else if ( (p.x > max_x) && (p.y > max_y))
-        dOut = sqrt((p.x - max_x)*(p.x - max_x)+(p.y - max_y)*(p.y - max_y));
-    else if ( (p.x > max_x) && (p.z < min_z))
-        dOut = sqrt((p.x - max_x)*(p.x - max_x)+(min_z - p.z)*(min_z - p.z));
-    else if ( (p.x < min_x) && (p.y > max_y))
-        dOut = sqrt((min_x - p.x)*(min_x - p.x)+(p.y - max_y)*(p.y - max_y));
-    else if ( (p.y > max_y) && (p.z > max_z))
-        dOut = sqrt((p.y - max_y)*(p.y - max_y)+(p.z - max_z)*(p.z - max_z));
-    else if ( (p.x > max_x) && (p.z > max_z))
-        dOut = sqrt((p.x - max_x)*(p.x - max_x)+(p.z - max_z)*(p.z - max_z));
-    else if ( (p.x > max_x) && (p.y < min_y))
-        dOut = sqrt((p.x - max_x)*(p.x - max_x)+(min_y - p.y)*(min_y - p.y));
-    else if ( (p.x < min_x) && (p.y < min_y))
-        dOut = sqrt((min_x - p.x)*(min_x - p.x)+(p.y - max_y)*(p.y - max_y));
-    else if ( (p.y < min_y) && (p.z > max_z))
-        dOut = sqrt((min_y - p.y)*(min_y - p.y)+(p.z - max_z)*(p.z - max_z));
-    else if ( (p.x < min_x) && (p.z < min_z) )
-        dOut = sqrt((p.x - max_x)*(p.x - max_x)+(min_z - p.z)*(min_z - p.z));
-    else if ( (p.y > max_y) && (p.z < min_z))
-        dOut = sqrt((p.y - max_y)*(p.y - max_y)+(min_y - p.y)*(min_y - p.y));
-    else if ( (p.x < min_x) && (p.z > max_z))
-        dOut = sqrt((min_x - p.x)*(min_x - p.x)+(p.z - max_z)*(p.z - max_z));
-    else if ( (p.y < min_y) && (p.z < min_z))
-        dOut = sqrt((min_y - p.y)*(min_y - p.y)+(min_z - p.z)*(min_z - p.z));
-        
-    return -dOut;
+    }
+}
+
+bool UnionVolume::overlaps(const Bbox& box) const {
+    if ( volumes.empty() || !bb.overlaps(box) )
+        return false;
+    BOOST_FOREACH( const Volume* vol, volumes ) {
+        if ( vol->overlaps(box) )
+            return true;
+    }
+    return false;
+}
+
+double UnionVolume::distance(const Bbox& box) const {
+    double d = std::numeric_limits<double>::max();
+    if ( volumes.empty() )
+        return d;
+    double outside = bb.distance(box);
+    if ( outside > 0.0 )
+        return outside;
+    BOOST_FOREACH( const Volume* vol, volumes ) {
+        d = std::min( d, vol->distance(box) );
+    }
+    return d;
 }
+
+bool UnionVolume::contains(const Bbox& box) const {
+    BOOST_FOREACH( const Volume* vol, volumes ) {
+        if ( vol->contains(box) )
+            return true;
+    }
+    return false;
+}
+
 /*
 bool SphereVolume::isInside(GLVertex& p) const {
     std::cout << " isInside !!! \n";
@@ -435,235 +602,440 @@ bool EtubeOCTVolume::isInside(GLVertex& p) const
 }*/
 
 
-//************* CylCutterMove **************/
-/*
+//************* Cutters **************/
+
+CutterVolume::CutterVolume(double r, double cr, double l, double tip) {
+    radius = r;
+    corner_radius = cr;
+    tip_height = tip;
+    length = std::max( l, 2*cr + tip );
+    core_radius = radius - corner_radius;
+    core_bottom = corner_radius;
+    core_top = length - corner_radius;
+    double len2 = core_radius*core_radius + tip_height*tip_height;
+    if ( tip_height > 0.0 ) {
+        cone_nr = tip_height/sqrt(len2);
+        cone_nh = -core_radius/sqrt(len2);
+    } else { // flat bottom
+        cone_nr = 0.0;
+        cone_nh = -1.0;
+    }
+    cone_inv_len2 = (len2 > 0.0) ? 1.0/len2 : 0.0;
+    pos = GLVertex(0,0,0);
+    calcBB();
+}
 
-CylMoveOCTVolume::CylMoveOCTVolume(const CylCutter& cin, const Point& p1in, const Point& p2in)
-{
-    p1 = p1in;
-    p2 = p2in;
-    c = cin;
-    
-    Point cutter_zvec = Point(0,0,c.getLength());
-    // start of move, extreme point(s)
-    bb.addPoint( p1 + c.getRadius()*Point(1,0,0) );
-    bb.addPoint( p1 + c.getRadius()*Point(-1,0,0) );
-    bb.addPoint( p1 + c.getRadius()*Point(0,1,0) );
-    bb.addPoint( p1 + c.getRadius()*Point(0,-1,0) );
-    // start of move (top)
-    bb.addPoint( p1 + c.getRadius()*Point(1,0,0)  + cutter_zvec );
-    bb.addPoint( p1 + c.getRadius()*Point(-1,0,0) + cutter_zvec );
-    bb.addPoint( p1 + c.getRadius()*Point(0,1,0)  + cutter_zvec );
-    bb.addPoint( p1 + c.getRadius()*Point(0,-1,0) + cutter_zvec );
-    // end of move (bottom)
-    bb.addPoint( p2 + c.getRadius()*Point(1,0,0) );
-    bb.addPoint( p2 + c.getRadius()*Point(-1,0,0) );
-    bb.addPoint( p2 + c.getRadius()*Point(0,1,0) );
-    bb.addPoint( p2 + c.getRadius()*Point(0,-1,0) );
-    // end of move (top)
-    bb.addPoint( p2 + c.getRadius()*Point(1,0,0)  + cutter_zvec );
-    bb.addPoint( p2 + c.getRadius()*Point(-1,0,0) + cutter_zvec );
-    bb.addPoint( p2 + c.getRadius()*Point(0,1,0)  + cutter_zvec );
-    bb.addPoint( p2 + c.getRadius()*Point(0,-1,0) + cutter_zvec );
-    
-    
-    // cylinder at start of move
-    c1.p1 = p1;
-    c1.p2 = p1+Point(0,0,c.getLength());
-    c1.radius=c.getRadius();
-    // std::cout << " startcyl at " << c1.p1 << " to " << c1.p2 << "radius="<< c1.radius << "\n";
-    
-    // cylinder at end of move
-    c2.p1 = p2;
-    c2.p2 = p2+Point(0,0,c.getLength());
-    c2.radius=c.getRadius();
-    // std::cout << " endcyl at " << c2.p1 << " to " << c2.p2 <<" radius=" << c2.radius << "\n";
-    
-    // for XY-plane moves, a box:
-    Point v = p2-p1; // vector along move
-    Point v2 = p2-p1; 
-    box.v2 = p2-p1;
-    
-    v.z = 0;
-    v.normalize();
-    
-    box.corner = p1 + c.getRadius()*v.xyPerp();
-    box.v1 = -2*c.getRadius()*v.xyPerp();
-    box.v2 = v2;
-    box.v3 = Point(0,0,c.getLength());
-    // std::cout << " box at corner=" << box.corner << "\n";
-    // std::cout << "            v1=" << box.v1 << "\n";
-    // std::cout << "            v2=" << box.v2 << "\n";
-    // std::cout << "            v3=" << box.v3 << "\n";
-    
-    // the elliptic tube
-    etube = EtubeOCTVolume();
-    // set the parameters
-    etube.p1 = p1;
-    etube.p2 = p2;
-    etube.a = c.getRadius()*v.xyPerp();
-    //etube.b = Point(0,0,0); //fixme
-    // angle of move
-    double dz = p2.z-p1.z;
-    double length = (p2-p1).norm();
-        
-    double sin = dz/length;
-    //double cos = sqrt( 1.0-sin*sin);
-    double baxis = fabs(c.getRadius()*sin);
-    // std::cout << " Etube baxis length="<< baxis << "\n";
-    // direction is cross product 
-    Point bdir = (p2-p1).cross(etube.a);
-    bdir.normalize();
-    etube.b= baxis*bdir;
-    // std::cout << " Etube a="<< etube.a << " b=" << etube.b << "\n";
-    
+// The core is a convex polygon in the (rho,h) half-plane, bounded by the cone (or the flat bottom),
+// the side and the top. The unsigned distance is the distance to the closest of these edges, 
+// and the sign is the sign of the largest distance to the lines through the edges.
+// Only min/max/sqrt and copysign are used, so that this maps directly to the SIMD code in distances().
+double CutterVolume::core_dist(double rho, double h) const {
+    double hb = h - core_bottom;
+    double t = std::min( std::max( (rho*core_radius + hb*tip_height)*cone_inv_len2, 0.0 ), 1.0 );
+    double cr = rho - t*core_radius;
+    double ch = hb - t*tip_height;
+    double sr = rho - core_radius;
+    double sh = h - std::min( std::max( h, core_bottom + tip_height ), core_top );
+    double tr = std::max( sr, 0.0 );
+    double th = h - core_top;
+    double d2 = std::min( cr*cr + ch*ch, std::min( sr*sr + sh*sh, tr*tr + th*th ) );
+    double s = std::max( std::max( sr, th ), rho*cone_nr + hb*cone_nh );
+    return copysign( sqrt(d2), s );
 }
 
-bool CylMoveOCTVolume::isInside(Point& p) const 
-{
-    // CL follows line
-    // line = p1 + t*(p2-p1)
-    // top of cutter follows same line only c.length() higher
-    if (c1.isInside(p)) 
-        return true;
-    
-    if (c2.isInside(p))
-        return true;
-    
-    // for XY-plane moves, a box:
-    if (box.isInside(p))
-        return true;
-    
-    // the Elliptic tube
-    if (etube.isInside(p))
-        return true;
-        
-    // the default is to return false
-    return false;
+double CutterVolume::dist(const GLVertex& p) const {
+    double dx = p.x - pos.x;
+    double dy = p.y - pos.y;
+    return corner_radius - core_dist( sqrt( dx*dx + dy*dy ), p.z - pos.z );
+}
 
+// the SIMD versions do the same arithmetic as dist(), the position in single precision 
+// and the rest in double precision, with the operands of min/max in the order which gives the same result as std::min/std::max
+void CutterVolume::distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const {
+    unsigned int i=0;
+#if defined(__AVX__)
+    const __m128 px = _mm_set1_ps(pos.x), py = _mm_set1_ps(pos.y), pz = _mm_set1_ps(pos.z);
+    const __m256d rc = _mm256_set1_pd(core_radius), bottom = _mm256_set1_pd(core_bottom), top = _mm256_set1_pd(core_top);
+    const __m256d tip = _mm256_set1_pd(tip_height), side_bottom = _mm256_set1_pd(core_bottom + tip_height);
+    const __m256d nr = _mm256_set1_pd(cone_nr), nh = _mm256_set1_pd(cone_nh), inv = _mm256_set1_pd(cone_inv_len2);
+    const __m256d corner = _mm256_set1_pd(corner_radius);
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0), sign = _mm256_set1_pd(-0.0);
+    for ( ; i+4<=n; i+=4 ) {
+        __m256d dx = _mm256_cvtps_pd( _mm_sub_ps( _mm_loadu_ps(x+i), px ) );
+        __m256d dy = _mm256_cvtps_pd( _mm_sub_ps( _mm_loadu_ps(y+i), py ) );
+        __m256d h  = _mm256_cvtps_pd( _mm_sub_ps( _mm_loadu_ps(z+i), pz ) );
+        __m256d rho = _mm256_sqrt_pd( _mm256_add_pd( _mm256_mul_pd(dx,dx), _mm256_mul_pd(dy,dy) ) );
+        __m256d hb = _mm256_sub_pd( h, bottom );
+        __m256d t = _mm256_mul_pd( _mm256_add_pd( _mm256_mul_pd(rho,rc), _mm256_mul_pd(hb,tip) ), inv );
+        t = _mm256_min_pd( one, _mm256_max_pd( zero, t ) );
+        __m256d cr = _mm256_sub_pd( rho, _mm256_mul_pd(t,rc) );
+        __m256d ch = _mm256_sub_pd( hb, _mm256_mul_pd(t,tip) );
+        __m256d sr = _mm256_sub_pd( rho, rc );
+        __m256d sh = _mm256_sub_pd( h, _mm256_min_pd( top, _mm256_max_pd( side_bottom, h ) ) );
+        __m256d tr = _mm256_max_pd( zero, sr );
+        __m256d th = _mm256_sub_pd( h, top );
+        __m256d d_cone = _mm256_add_pd( _mm256_mul_pd(cr,cr), _mm256_mul_pd(ch,ch) );
+        __m256d d_side = _mm256_add_pd( _mm256_mul_pd(sr,sr), _mm256_mul_pd(sh,sh) );
+        __m256d d_top  = _mm256_add_pd( _mm256_mul_pd(tr,tr), _mm256_mul_pd(th,th) );
+        __m256d dist = _mm256_sqrt_pd( _mm256_min_pd( _mm256_min_pd(d_top, d_side), d_cone ) );
+        __m256d s = _mm256_max_pd( _mm256_add_pd( _mm256_mul_pd(rho,nr), _mm256_mul_pd(hb,nh) ), _mm256_max_pd(th, sr) );
+        dist = _mm256_or_pd( dist, _mm256_and_pd( s, sign ) );
+        _mm256_storeu_pd( d+i, _mm256_sub_pd( corner, dist ) );
+    }
+#elif defined(__SSE2__)
+    const __m128 px = _mm_set1_ps(pos.x), py = _mm_set1_ps(pos.y), pz = _mm_set1_ps(pos.z);
+    const __m128d rc = _mm_set1_pd(core_radius), bottom = _mm_set1_pd(core_bottom), top = _mm_set1_pd(core_top);
+    const __m128d tip = _mm_set1_pd(tip_height), side_bottom = _mm_set1_pd(core_bottom + tip_height);
+    const __m128d nr = _mm_set1_pd(cone_nr), nh = _mm_set1_pd(cone_nh), inv = _mm_set1_pd(cone_inv_len2);
+    const __m128d corner = _mm_set1_pd(corner_radius);
+    const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0), sign = _mm_set1_pd(-0.0);
+    for ( ; i+2<=n; i+=2 ) {
+        __m128d dx = _mm_cvtps_pd( _mm_sub_ps( _mm_set_ps( 0, 0, x[i+1], x[i] ), px ) );
+        __m128d dy = _mm_cvtps_pd( _mm_sub_ps( _mm_set_ps( 0, 0, y[i+1], y[i] ), py ) );
+        __m128d h  = _mm_cvtps_pd( _mm_sub_ps( _mm_set_ps( 0, 0, z[i+1], z[i] ), pz ) );
+        __m128d rho = _mm_sqrt_pd( _mm_add_pd( _mm_mul_pd(dx,dx), _mm_mul_pd(dy,dy) ) );
+        __m128d hb = _mm_sub_pd( h, bottom );
+        __m128d t = _mm_mul_pd( _mm_add_pd( _mm_mul_pd(rho,rc), _mm_mul_pd(hb,tip) ), inv );
+        t = _mm_min_pd( one, _mm_max_pd( zero, t ) );
+        __m128d cr = _mm_sub_pd( rho, _mm_mul_pd(t,rc) );
+        __m128d ch = _mm_sub_pd( hb, _mm_mul_pd(t,tip) );
+        __m128d sr = _mm_sub_pd( rho, rc );
+        __m128d sh = _mm_sub_pd( h, _mm_min_pd( top, _mm_max_pd( side_bottom, h ) ) );
+        __m128d tr = _mm_max_pd( zero, sr );
+        __m128d th = _mm_sub_pd( h, top );
+        __m128d d_cone = _mm_add_pd( _mm_mul_pd(cr,cr), _mm_mul_pd(ch,ch) );
+        __m128d d_side = _mm_add_pd( _mm_mul_pd(sr,sr), _mm_mul_pd(sh,sh) );
+        __m128d d_top  = _mm_add_pd( _mm_mul_pd(tr,tr), _mm_mul_pd(th,th) );
+        __m128d dist = _mm_sqrt_pd( _mm_min_pd( _mm_min_pd(d_top, d_side), d_cone ) );
+        __m128d s = _mm_max_pd( _mm_add_pd( _mm_mul_pd(rho,nr), _mm_mul_pd(hb,nh) ), _mm_max_pd(th, sr) );
+        dist = _mm_or_pd( dist, _mm_and_pd( s, sign ) );
+        _mm_storeu_pd( d+i, _mm_sub_pd( corner, dist ) );
+    }
+#endif
+    for ( ; i<n; ++i )
+        d[i] = dist( GLVertex(x[i], y[i], z[i]) );
 }
-*/
 
-//************* CylCutterVolume **************/
+void CutterVolume::addExtent(const GLVertex& p, Bbox& box) const {
+    box.addPoint( GLVertex( p.x - radius, p.y - radius, p.z ) );
+    box.addPoint( GLVertex( p.x + radius, p.y + radius, p.z + length ) );
+}
 
-/*
-CylCutterVolume::CylCutterVolume() {
-    radius = 1.0;
-    length = 1.0;
-    pos = Point(0,0,0);
-    calcBB();
+void CutterVolume::calcBB() {
+    bb.clear();
+    addExtent( pos, bb );
 }
 
-void CylCutterVolume::setPos(Point& p) {
-    pos = p;
-    calcBB();
+/// distance in the xy-plane from the segment ab to the rectangle of box
+static double xy_distance(const Bbox& box, const GLVertex& a, const GLVertex& b) {
+    // clip the segment to the rectangle, it crosses the rectangle if something is left
+    double lo = 0.0, hi = 1.0;
+    double a_k[2] = { a.x, a.y };
+    double d_k[2] = { b.x - a.x, b.y - a.y };
+    double min_k[2] = { box.minpt.x, box.minpt.y };
+    double max_k[2] = { box.maxpt.x, box.maxpt.y };
+    for (int k=0; k<2 && lo<=hi; ++k) {
+        if ( d_k[k] == 0.0 ) {
+            if ( a_k[k] < min_k[k] || a_k[k] > max_k[k] )
+                hi = -1.0;
+        } else {
+            double t0 = (min_k[k] - a_k[k]) / d_k[k];
+            double t1 = (max_k[k] - a_k[k]) / d_k[k];
+            lo = std::max( lo, std::min(t0, t1) );
+            hi = std::min( hi, std::max(t0, t1) );
+        }
+    }
+    if ( lo <= hi )
+        return 0.0;
+    // otherwise the closest points are an end-point of the segment, or a corner of the rectangle
+    double d2 = std::numeric_limits<double>::max();
+    const GLVertex* ends[2] = { &a, &b };
+    for (int e=0; e<2; ++e) {
+        double ex = std::max( 0.0, std::max( min_k[0] - ends[e]->x, ends[e]->x - max_k[0] ) );
+        double ey = std::max( 0.0, std::max( min_k[1] - ends[e]->y, ends[e]->y - max_k[1] ) );
+        d2 = std::min( d2, ex*ex + ey*ey );
+    }
+    double len2 = d_k[0]*d_k[0] + d_k[1]*d_k[1];
+    for (int c=0; c<4; ++c) {
+        double qx = ( (c&1) ? max_k[0] : min_k[0] ) - a.x;
+        double qy = ( (c&2) ? max_k[1] : min_k[1] ) - a.y;
+        double t = (len2 > 0.0) ? std::max( 0.0, std::min( 1.0, (qx*d_k[0] + qy*d_k[1]) / len2 ) ) : 0.0;
+        double ex = qx - t*d_k[0];
+        double ey = qy - t*d_k[1];
+        d2 = std::min( d2, ex*ex + ey*ey );
+    }
+    return sqrt(d2);
 }
 
-void CylCutterVolume::calcBB() {
-    bb.clear();
-    bb.addPoint( pos + Point(radius,radius,0) ); //FIXME
-    bb.addPoint( pos + Point(-radius,-radius,length) ); // FIXME
+// the core is inside the cylinder of core_radius from core_bottom to core_top. with the tip 
+// between a and b the cylinder sweeps a prism, the xy-points within core_radius of the segment, 
+// from the lowest core_bottom to the highest core_top. the cutter is this prism grown by corner_radius.
+double CutterVolume::distance(const Bbox& box, const GLVertex& a, const GLVertex& b) const {
+    double dxy = std::max( 0.0, xy_distance( box, a, b ) - core_radius );
+    double bottom = std::min( a.z, b.z ) + core_bottom;
+    double top = std::max( a.z, b.z ) + core_top;
+    double dz = std::max( 0.0, std::max( bottom - box.maxpt.z, box.minpt.z - top ) );
+    return std::max( 0.0, sqrt( dxy*dxy + dz*dz ) - corner_radius );
 }
 
-bool CylCutterVolume::isInside(Point& p) const {
-    Point t = p-pos;
-    if (t.z < 0 )
-        return false;
-    else {
-        double det = std::max( fabs(t.z-length/2)-length/2 , t.x*t.x+t.y*t.y-radius*radius );
-        return (det < 0.0); 
+// the points within radius of the axis, from the top of the conical tip to the top of the core, are inside the cutter.
+// swept from a to b this cylinder is convex, so box is inside if its eight corners are. corner p is inside 
+// if the height and the distance from the axis are both within range for some tip position a + t*(b-a).
+bool CutterVolume::contains(const Bbox& box, const GLVertex& a, const GLVertex& b) const {
+    double bottom = core_bottom + tip_height;
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double dz = b.z - a.z;
+    double len2 = dx*dx + dy*dy;
+    for (int n=0; n<8; ++n) {
+        double qx = ( (n&1) ? box.maxpt.x : box.minpt.x ) - a.x;
+        double qy = ( (n&2) ? box.maxpt.y : box.minpt.y ) - a.y;
+        double h = ( (n&4) ? box.maxpt.z : box.minpt.z ) - a.z;
+        double lo = 0.0, hi = 1.0;
+        if ( dz == 0.0 ) {
+            if ( h <= bottom || h >= core_top )
+                return false;
+        } else {
+            double t0 = (h - core_top) / dz;
+            double t1 = (h - bottom) / dz;
+            lo = std::max( lo, std::min(t0, t1) );
+            hi = std::min( hi, std::max(t0, t1) );
+        }
+        // |q - t*d|^2 < radius^2 in the xy-plane
+        double c = qx*qx + qy*qy - radius*radius;
+        if ( len2 == 0.0 ) {
+            if ( c >= 0.0 )
+                return false;
+        } else {
+            double mid = (qx*dx + qy*dy) / len2;
+            double disc = mid*mid - c/len2;
+            if ( disc <= 0.0 )
+                return false;
+            lo = std::max( lo, mid - sqrt(disc) );
+            hi = std::min( hi, mid + sqrt(disc) );
+        }
+        if ( lo >= hi )
+            return false;
     }
+    return true;
 }
 
-double CylCutterVolume::dist(Point& p) const {
-    Point t = p-pos;
-    if (t.z >= 0 )
-        return std::max( fabs(t.z-length/2)-length/2 , t.x*t.x+t.y*t.y-radius*radius );
-    else {
-        // if we are under the cutter, then return distance to flat cutter bottom
-        if ( t.x*t.x+t.y*t.y < radius*radius )
-            return -t.z; 
-        else { // outside the cutter, return a distance to the outer "ring" of the cutter
-            Point nxy = t;
-            nxy.xyNormalize();
-            nxy = radius * nxy;
-            return (t.x-nxy.x)*(t.x-nxy.x) + (t.y-nxy.y)*(t.y-nxy.y) + t.z*t.z;
+//************* Cutter moves **************/
+
+/// the minimum of f over [lo,hi], when f has only one local minimum there.
+/// golden-section search, until the bracket is shorter than tol.
+template <class F>
+static double golden_min(const F& f, double lo, double hi, double tol) {
+    const double g = 0.6180339887498949;
+    double f_ends = std::min( f(lo), f(hi) );
+    double x1 = hi - g*(hi-lo);
+    double x2 = lo + g*(hi-lo);
+    double f1 = f(x1);
+    double f2 = f(x2);
+    while ( hi-lo > tol ) {
+        if ( f1 < f2 ) {
+            hi = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = hi - g*(hi-lo);
+            f1 = f(x1);
+        } else {
+            lo = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = lo + g*(hi-lo);
+            f2 = f(x2);
         }
     }
+    return std::min( f_ends, std::min(f1, f2) );
 }
-*/
 
+/// the golden-section search stops when the cutter positions are this close
+static const double move_tolerance = 1e-6;
+
+/// CutterVolume::core_dist() of the point q (relative to the start of the move) 
+/// to the cutter at t*d along the move
+struct LinearCoreDist {
+    const CutterVolume* cutter;
+    double qx, qy, qz;
+    double dx, dy, dz;
+    double operator()(double t) const {
+        double x = qx - t*dx;
+        double y = qy - t*dy;
+        return cutter->core_dist( sqrt( x*x + y*y ), qz - t*dz );
+    }
+};
 
-//************* BallCutterVolume **************/
+LinearMoveVolume::LinearMoveVolume(const CutterVolume& c, const GLVertex& s, const GLVertex& e) 
+    : cutter(c), start(s), end(e) {
+    color = cutter.color;
+    calcBB();
+}
 
+void LinearMoveVolume::calcBB() {
+    bb.clear();
+    cutter.addExtent( start, bb );
+    cutter.addExtent( end, bb );
+}
 
-/*
-BallCutterVolume::BallCutterVolume() {
-    radius = 1.0;
-    length = 1.0;
-    pos = Point(0,0,0);
+double LinearMoveVolume::dist(const GLVertex& p) const {
+    LinearCoreDist f;
+    f.cutter = &cutter;
+    f.qx = p.x - start.x;
+    f.qy = p.y - start.y;
+    f.qz = p.z - start.z;
+    f.dx = end.x - start.x;
+    f.dy = end.y - start.y;
+    f.dz = end.z - start.z;
+    double dh2 = f.dx*f.dx + f.dy*f.dy;
+    double t;
+    if ( f.dz == 0.0 ) { // horizontal: the closest cutter is the one closest in the xy-plane
+        t = (dh2 > 0.0) ? ( f.qx*f.dx + f.qy*f.dy ) / dh2 : 0.0;
+    } else if ( dh2 == 0.0 && cutter.tip_height == 0.0 ) { // vertical: the closest cutter has its middle at the height of p
+        t = ( f.qz - 0.5*cutter.length ) / f.dz;
+    } else {
+        double move_length = sqrt( dh2 + f.dz*f.dz );
+        return cutter.corner_radius - golden_min( f, 0.0, 1.0, move_tolerance/move_length );
+    }
+    return cutter.corner_radius - f( std::max( 0.0, std::min( 1.0, t ) ) );
 }
 
-void BallCutterVolume::setPos(Point& p) {
-    pos = p;
+/// CutterVolume::core_dist() of p to the cutter at angle theta along a HelicalMoveVolume
+struct HelicalCoreDist {
+    const HelicalMoveVolume* move;
+    GLVertex p;
+    double operator()(double theta) const {
+        GLVertex tip = move->point(theta);
+        double x = p.x - tip.x;
+        double y = p.y - tip.y;
+        return move->cutter.core_dist( sqrt( x*x + y*y ), p.z - tip.z );
+    }
+};
+
+HelicalMoveVolume::HelicalMoveVolume(const CutterVolume& c, const GLVertex& s, const GLVertex& cen,
+                                     const GLVertex& ax, double a, double r) 
+    : cutter(c), start(s), axis(ax), angle(a), rise(r) {
+    assert( fabs( axis.norm() - 1.0 ) < 1e-6 );
+    // move center along the axis, to the height of start
+    GLVertex radial = start - cen;
+    double h = radial.x*axis.x + radial.y*axis.y + radial.z*axis.z;
+    center = cen + axis*h;
+    color = cutter.color;
+    unsigned int n = std::max( 1, (int)ceil( fabs(angle) / (M_PI/6) ) );
+    for (unsigned int i=0; i<=n; ++i)
+        pieces.push_back( angle*i/n );
     calcBB();
 }
 
-void BallCutterVolume::calcBB() {
-    bb.clear();
-    double safety = 1;
-    bb.addPoint( pos + Point(safety*radius,safety*radius,safety*length) );
-    bb.addPoint( pos + Point(-safety*radius,-safety*radius,-safety*length) );
+GLVertex HelicalMoveVolume::point(double theta) const {
+    GLVertex u = start - center; // the radius at theta=0
+    GLVertex w = axis.cross( u ); // the radius at theta=pi/2
+    double c = cos(theta);
+    double s = sin(theta);
+    double h = (angle != 0.0) ? rise*theta/angle : 0.0;
+    return GLVertex( center.x + c*u.x + s*w.x + h*axis.x,
+                     center.y + c*u.y + s*w.y + h*axis.y,
+                     center.z + c*u.z + s*w.z + h*axis.z );
 }
 
-double BallCutterVolume::dist(Point& p) const {
-    Point t = p - pos - Point(0,0,radius);
-    if (t.z < 0 )
-        return  square(t.x) + square(t.y) + square(t.z) -  square( radius ) ;
-    else {
-        return std::max( fabs(t.z)-length ,  square(t.x) + square(t.y)  - square(radius) ) ;
+// the coordinates of the radius vector are u[k]*cos(theta) + w[k]*sin(theta), 
+// with extremes at atan2(w[k], u[k]) + m*pi. the movement along the axis is linear.
+Bbox HelicalMoveVolume::extent(double theta0, double theta1) const {
+    double lo = std::min( theta0, theta1 );
+    double hi = std::max( theta0, theta1 );
+    Bbox box;
+    cutter.addExtent( point(lo), box );
+    cutter.addExtent( point(hi), box );
+    GLVertex u = start - center;
+    GLVertex w = axis.cross( u );
+    double uk[3] = { u.x, u.y, u.z };
+    double wk[3] = { w.x, w.y, w.z };
+    for (int k=0; k<3; ++k) {
+        if ( uk[k] == 0.0 && wk[k] == 0.0 )
+            continue;
+        double extreme = atan2( wk[k], uk[k] );
+        for ( double theta = extreme + M_PI*ceil( (lo-extreme)/M_PI ); theta < hi; theta += M_PI )
+            cutter.addExtent( point(theta), box );
     }
+    return box;
 }
-*/
-
 
-//************* BullCutterVolume **************/
-// TOROID 
-
-/*
-BullCutterVolume::BullCutterVolume() {
-    r1 = 1.0;
-    r2 = r1/3.0;
-    radius = r1+r2;
-    length = 1.0;
-    pos = Point(0,0,0);
+void HelicalMoveVolume::calcBB() {
+    bb = extent( 0.0, angle );
+    piece_bb.clear();
+    for (unsigned int i=0; i+1<pieces.size(); ++i)
+        piece_bb.push_back( extent( pieces[i], pieces[i+1] ) );
 }
 
-void BullCutterVolume::setPos(Point& p) {
-    pos = p;
-    calcBB();
+double HelicalMoveVolume::distance(const Bbox& box) const {
+    double d = std::numeric_limits<double>::max();
+    BOOST_FOREACH( const Bbox& piece, piece_bb ) {
+        d = std::min( d, piece.distance(box) );
+    }
+    return d;
 }
 
-void BullCutterVolume::calcBB() {
-    bb.clear();
-    double safety = 1;
-    bb.addPoint( pos + Point(safety*radius,safety*radius,safety*length) );
-    bb.addPoint( pos + Point(-safety*radius,-safety*radius,-safety*length) );
-}
-
-double BullCutterVolume::dist(Point& p) const {
-    Point t = p - pos - Point(0,0,r2); // shift up by tube radius
-    if (t.z >= 0.0 ) // cylindrical part, above toroid
-        return std::max( fabs(t.z)-length , square(t.x) + square(t.y) - square(r1+r2) );
-    else if ( square(t.x)+square(t.y) <= square(r1) ) // cylindrical part, inside toroid
-                     //was fabs(t.z)-r2
-        return std::max( square(t.z)-square(r2) , square(t.x) + square(t.y) - square( r1 ) );
-    else // toroid
-        return square( square(t.x) + square(t.y) + square(t.z) + square( r1 ) - square( r2 ) ) - 
-               4*square(r1)*(square(t.x)+square(t.y));
+double HelicalMoveVolume::core_dist(const GLVertex& p, double theta0, double theta1) const {
+    HelicalCoreDist f;
+    f.move = this;
+    f.p = p;
+    double arc = fabs(theta1-theta0) * (start-center).norm() + fabs( rise*(theta1-theta0)/angle );
+    if ( arc == 0.0 )
+        return f(theta0);
+    return golden_min( f, std::min(theta0, theta1), std::max(theta0, theta1), 
+                       move_tolerance * fabs(theta1-theta0) / arc );
 }
-*/
 
+double HelicalMoveVolume::dist(const GLVertex& p) const {
+    bool z_axis = ( axis.x == 0.0 && axis.y == 0.0 );
+    if ( z_axis && rise == 0.0 ) {
+        // an arc in the xy-plane. the core of the cutter sweeps the points within
+        // its radius from the arc, extruded in z.
+        GLVertex u = start - center;
+        GLVertex w = axis.cross( u );
+        double qx = p.x - center.x;
+        double qy = p.y - center.y;
+        double r2 = u.x*u.x + u.y*u.y;
+        double phi = atan2( qx*w.x + qy*w.y, qx*u.x + qy*u.y ); // angle from start, in the direction of rotation
+        if ( angle < 0.0 )
+            phi = -phi;
+        if ( phi < 0.0 )
+            phi += 2*M_PI;
+        double rho;
+        if ( phi <= fabs(angle) || fabs(angle) >= 2*M_PI ) {
+            rho = fabs( sqrt(qx*qx + qy*qy) - sqrt(r2) );
+        } else { // closest to one of the end-points
+            GLVertex e = point(angle);
+            double sx = p.x - start.x;
+            double sy = p.y - start.y;
+            double ex = p.x - e.x;
+            double ey = p.y - e.y;
+            rho = sqrt( std::min( sx*sx + sy*sy, ex*ex + ey*ey ) );
+        }
+        return cutter.corner_radius - cutter.core_dist( rho, p.z - start.z );
+    }
+    // start with the piece with the closest Bbox. another piece can only contain 
+    // the closest cutter if its Bbox is closer than the closest cutter so far.
+    unsigned int first = 0;
+    double first_outside = std::numeric_limits<double>::max();
+    for (unsigned int i=0; i<piece_bb.size(); ++i) {
+        double outside = piece_bb[i].distance(p);
+        if ( outside < first_outside ) {
+            first = i;
+            first_outside = outside;
+        }
+    }
+    double closest = core_dist( p, pieces[first], pieces[first+1] );
+    for (unsigned int i=0; i<piece_bb.size(); ++i) {
+        if ( i == first )
+            continue;
+        double outside = piece_bb[i].distance(p);
+        if ( outside > 0.0 && cutter.corner_radius + outside >= closest )
+            continue;
+        closest = std::min( closest, core_dist( p, pieces[i], pieces[i+1] ) );
+    }
+    return cutter.corner_radius - closest;
+}
 
 //************* PlaneVolume **************/
 
@@ -22,7 +22,9 @@
 
 #include <iostream>
 #include <list>
+#include <vector>
 #include <cassert>
+#include <cmath>
 
 #include "bbox.hpp"
 #include "glvertex.hpp"
@@ -55,10 +57,25 @@ class Volume {
     public:
         /// default constructor
         Volume(){};
+        virtual ~Volume() {}
+        /// return a new copy of this Volume, owned by the caller
+        virtual Volume* clone() const = 0;
         /// return signed distance from volume surface to Point p
         /// Points p inside the volume should return positive values.
         /// Points p outside the volume should return negative values.
         virtual double dist(const GLVertex& p) const = 0;
+        /// compute dist() for the n points (x[i], y[i], z[i]) given in SoA layout, and put the result in d[i].
+        /// The default implementation calls dist() for each point, sub-classes override this with vectorized code.
+        virtual void distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const;
+        /// a lower bound of the distance from box to the volume, zero if box may overlap the volume.
+        /// in box dist() is at most minus this. The default is the distance to the Bbox, sub-classes
+        /// return a tighter bound from their shape.
+        virtual double distance(const Bbox& box) const { return bb.distance(box); }
+        /// true if the volume may overlap box. Octree operations skip the nodes for which this is false.
+        virtual bool overlaps(const Bbox& box) const { return bb.overlaps(box); }
+        /// true only if all of box is strictly inside the volume, so that dist() is positive in box.
+        /// Octree operations do not descend below the nodes for which this is true. The default is false.
+        virtual bool contains(const Bbox& box) const { return false; }
 
         /// bounding-box. This holds the maximum(minimum) points along the X,Y, and Z-coordinates
         /// of the volume (i.e. the volume where dist(p) returns negative values)
@@ -78,6 +95,7 @@ class SphereVolume: public Volume {
     public:
         /// default constructor
         SphereVolume();
+        Volume* clone() const { return new SphereVolume(*this); }
         /// set radius of sphere
         void setRadius(double r) {
             radius=r;
@@ -91,6 +109,12 @@ class SphereVolume: public Volume {
         /// update the Bbox
         void calcBB();
         double dist(const GLVertex& p) const;
+        /// SSE/AVX version of dist()
+        void distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const;
+        /// distance from the center to box, minus the radius
+        double distance(const Bbox& box) const;
+        /// true if the corner of box farthest from the center is inside
+        bool contains(const Bbox& box) const;
         
         /// center Point of sphere
         GLVertex center;
@@ -106,6 +130,7 @@ class RectVolume : public Volume {
     public:
         /// default constructor
         RectVolume();
+        Volume* clone() const { return new RectVolume(*this); }
         /// one corner of the box
         GLVertex corner;
         /// first vector from corner, to span the box
@@ -114,9 +139,54 @@ class RectVolume : public Volume {
         GLVertex v2;
         /// third vector
         GLVertex v3;
-        /// update the bounding-box
+        /// update the bounding-box, call this after changing corner or v1, v2, v3
         void calcBB();
         double dist(const GLVertex& p) const;
+        /// SSE/AVX version of dist()
+        void distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const;
+        /// true if box is inside the box
+        bool contains(const Bbox& box) const;
+    private:
+        /// the axis-aligned extent of the box
+        void extent(double& min_x, double& max_x, double& min_y, double& max_y, double& min_z, double& max_z) const;
+};
+
+/// union of several Volumes, for example the tool at many positions along a move.
+/// one operation with a UnionVolume changes the Octree like one operation with each 
+/// of its Volumes, but traverses the tree once. Nodes are skipped unless they overlap
+/// the Bbox of one of the Volumes.
+///
+/// The Volumes must be signed distance fields, so that in a box dist() is at most
+/// minus Volume::distance() of the box. dist() and distances() use this to skip the
+/// Volumes which cannot be the maximum.
+class UnionVolume : public Volume {
+    public:
+        /// an empty union
+        UnionVolume();
+        /// copy, with copies of the Volumes
+        UnionVolume(const UnionVolume& other);
+        virtual ~UnionVolume();
+        Volume* clone() const { return new UnionVolume(*this); }
+        /// add a copy of vol to the union. the color is the color of the first Volume.
+        void add(const Volume* vol);
+        /// remove all Volumes
+        void clear();
+        /// number of Volumes
+        unsigned int size() const { return volumes.size(); }
+        /// the maximum dist() of the Volumes
+        double dist(const GLVertex& p) const;
+        /// distances() of the Volumes which are close to the points, and the maximum of them
+        void distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const;
+        /// true if box overlaps one of the Volumes
+        bool overlaps(const Bbox& box) const;
+        /// the smallest distance() of the Volumes
+        double distance(const Bbox& box) const;
+        /// true if one of the Volumes contains box
+        bool contains(const Bbox& box) const;
+    private:
+        /// the Volumes, owned by this
+        std::vector<Volume*> volumes;
+        UnionVolume& operator=(const UnionVolume&);
 };
 
 /*
@@ -280,69 +350,91 @@ class EtubeOCTVolume: public OCTVolume {
         double dist(GLVertex& p) const {return -1;}
 };*/
 
-/// cylindrical cutter volume
-/*
-class CylCutterVolume: public OCTVolume {
+/// a cutter with its axis along +z and its tip at pos.
+/// The core of the cutter is a cylinder of radius (radius-corner_radius), with a conical
+/// tip of height tip_height, and the cutter is the core grown by corner_radius in all directions.
+/// This covers flat, ball, bull-nose and drill cutters, and dist() is an exact signed distance.
+/// The length is at least 2*corner_radius+tip_height.
+class CutterVolume: public Volume {
     public:
-        CylCutterVolume();
+        /// create a cutter with the tip at (0,0,0)
+        CutterVolume(double radius, double corner_radius, double length, double tip_height = 0.0);
+        Volume* clone() const { return new CutterVolume(*this); }
+        /// position the tip of the cutter at p
+        void setPos(const GLVertex& p) {
+            pos = p;
+            calcBB();
+        }
+        /// update the Bbox
+        void calcBB();
+        double dist(const GLVertex& p) const;
+        void distances(const GLfloat* x, const GLfloat* y, const GLfloat* z, double* d, unsigned int n) const;
+        /// signed distance (negative inside) from the core to the point at
+        /// distance rho from the axis and height h above the tip.
+        /// dist() is corner_radius minus this.
+        double core_dist(double rho, double h) const;
+        /// add the extent of the cutter, with its tip at p, to box
+        void addExtent(const GLVertex& p, Bbox& box) const;
+        /// distance from box to the cylinder around the core, minus the corner radius
+        double distance(const Bbox& box) const { return distance(box, pos, pos); }
+        /// true if box is inside the cylinder of the cutter above the corner radius and the tip
+        bool contains(const Bbox& box) const { return contains(box, pos, pos); }
+        /// distance() of box to the cutter with its tip anywhere between a and b
+        double distance(const Bbox& box, const GLVertex& a, const GLVertex& b) const;
+        /// contains() of box, in the cutter with its tip anywhere between a and b
+        bool contains(const Bbox& box, const GLVertex& a, const GLVertex& b) const;
+        
+        /// position of the tip
+        GLVertex pos;
         /// cutter radius
         double radius;
+        /// radius of the rounded edge
+        double corner_radius;
         /// cutter length
         double length;
-        /// start CL-Point for this move
-        void setPos(Point& p);
-        /// cutter position
-        Point pos;
-        bool isInside(Point& p) const;
-        /// update the Bbox
-        void calcBB();
-        double dist(Point& p) const;
+        /// height of the conical tip
+        double tip_height;
+    private:
+        /// the outline of the core, in the (rho,h) half-plane
+        double core_radius, core_bottom, core_top;
+        /// unit outward normal of the cone
+        double cone_nr, cone_nh;
+        /// 1/(squared length of the cone side)
+        double cone_inv_len2;
+};
+
+/// cylindrical (flat end-mill) cutter volume
+class CylCutterVolume: public CutterVolume {
+    public:
+        /// create a cylindrical cutter
+        CylCutterVolume(double radius, double length) : CutterVolume(radius, 0.0, length) {}
+        Volume* clone() const { return new CylCutterVolume(*this); }
 };
-*/
 
-/*
 /// ball-nose cutter volume
-class BallCutterVolume: public OCTVolume {
+class BallCutterVolume: public CutterVolume {
     public:
-        BallCutterVolume();
-        /// cutter radius
-        double radius;
-        /// cutter length
-        double length;
-        /// position cutter at p
-        void setPos(Point& p);
-        /// cutter position
-        Point pos;
-        bool isInside(Point& p) const {return false;};
-        /// update bounding box
-        void calcBB();
-        double dist(Point& p) const;
+        /// create a ball-nose cutter
+        BallCutterVolume(double radius, double length) : CutterVolume(radius, radius, length) {}
+        Volume* clone() const { return new BallCutterVolume(*this); }
 };
-*/
 
-/// bull-nose cutter volume
-/*
-class BullCutterVolume: public OCTVolume {
+/// bull-nose (toroidal) cutter volume
+class BullCutterVolume: public CutterVolume {
     public:
-        BullCutterVolume();
-        /// cutter radius
-        double radius;
-        /// radius of cylinder-part
-        double r1;
-        /// radius of torus
-        double r2;
-        /// cutter length
-        double length;
-        /// position cutter
-        void setPos(Point& p);
-        /// position of cutter
-        Point pos;
-        bool isInside(Point& p) const {return false;};
-        /// update bounding box
-        void calcBB();
-        double dist(Point& p) const;
+        /// create a bull-nose cutter with the given radius of the torus tube
+        BullCutterVolume(double radius, double corner_radius, double length) : CutterVolume(radius, corner_radius, length) {}
+        Volume* clone() const { return new BullCutterVolume(*this); }
+};
+
+/// drill volume, a cylinder with a conical point
+class DrillCutterVolume: public CutterVolume {
+    public:
+        /// create a drill with the given point angle, in degrees
+        DrillCutterVolume(double radius, double length, double point_angle = 118.0) 
+            : CutterVolume(radius, 0.0, length, radius/tan(point_angle*M_PI/360.0) ) {}
+        Volume* clone() const { return new DrillCutterVolume(*this); }
 };
-*/
 
 /*
 /// plane-volume, useful for cutting stock to shape
@@ -364,34 +456,74 @@ class PlaneVolume: public OCTVolume {
 };*/
 
 
-/// cutter-swept volume of a CylCutter
-/*
-class CylMoveOCTVolume: public OCTVolume {
+/// the volume swept by a CutterVolume moving along a line from start to end
+/// (a STRAIGHT_FEED or STRAIGHT_TRAVERSE). The Bbox is the exact extent of the swept volume.
+/// dist() is exact for horizontal and vertical moves, for other moves the closest 
+/// cutter position is found by a golden-section search along the move.
+class LinearMoveVolume: public Volume {
     public:
-        /// default constructor
-        CylMoveOCTVolume() {};
-        /// create a CylMoveOCTVolume with the specified cutter and startpoint p1 and endpoint p2
-        CylMoveOCTVolume(const CylCutter& c, const Point& p1, const Point& p2);
-        /// start CL-Point for this move
-        Point p1;
-        /// end CL-point for this move
-        Point p2;
-        /// the CylCutter for this move
-        CylCutter c;
-        /// a cylindrical volume representing the cutter at p1
-        CylinderOCTVolume c1;
-        /// a cylindrical volume representing the cutter at p2
-        CylinderOCTVolume c2;
-        /// an elliptic tube of the swept-volube
-        EtubeOCTVolume etube;
-        /// the box-part of the swept-volume
-        BoxOCTVolume box;
-        bool isInside(Point& p) const;
-        double dist(Point& p) const {return -1;}
-};*/
-
-
+        /// the move of cutter, from start to end. the position of cutter is not used.
+        LinearMoveVolume(const CutterVolume& cutter, const GLVertex& start, const GLVertex& end);
+        Volume* clone() const { return new LinearMoveVolume(*this); }
+        /// update the Bbox
+        void calcBB();
+        double dist(const GLVertex& p) const;
+        /// CutterVolume::distance() along the move
+        double distance(const Bbox& box) const { return cutter.distance(box, start, end); }
+        /// CutterVolume::contains() along the move
+        bool contains(const Bbox& box) const { return cutter.contains(box, start, end); }
+        
+        /// the cutter
+        CutterVolume cutter;
+        /// tip position at the start of the move
+        GLVertex start;
+        /// tip position at the end of the move
+        GLVertex end;
+};
 
+/// the volume swept by a CutterVolume moving along a helix (an ARC_FEED).
+/// The tip rotates by angle around axis, which goes through center, starting at start,
+/// and moves rise in the direction of axis. A positive angle is counter-clockwise looking down the axis.
+/// axis is (1,0,0), (0,1,0) or (0,0,1). The Bbox is the exact extent of the swept volume.
+/// dist() is exact for an arc around the z-axis without rise, for other moves the 
+/// helix is split into pieces of at most 30 degrees, and the closest cutter position 
+/// on each piece is found by a golden-section search.
+class HelicalMoveVolume: public Volume {
+    public:
+        /// the move of cutter. the position of cutter is not used.
+        HelicalMoveVolume(const CutterVolume& cutter, const GLVertex& start, const GLVertex& center,
+                          const GLVertex& axis, double angle, double rise);
+        Volume* clone() const { return new HelicalMoveVolume(*this); }
+        /// update the Bbox
+        void calcBB();
+        double dist(const GLVertex& p) const;
+        /// the smallest distance of box to the Bbox of the pieces
+        double distance(const Bbox& box) const;
+        /// tip position after rotating by theta from the start
+        GLVertex point(double theta) const;
+        
+        /// the cutter
+        CutterVolume cutter;
+        /// tip position at the start of the move
+        GLVertex start;
+        /// the center of the helix, at the height of start along axis
+        GLVertex center;
+        /// the axis of rotation
+        GLVertex axis;
+        /// the rotation angle, in radians
+        double angle;
+        /// the movement along axis
+        double rise;
+    private:
+        /// the extent of the helix between theta0 and theta1, with the cutter
+        Bbox extent(double theta0, double theta1) const;
+        /// minimum CutterVolume::core_dist() of p to the cutter between theta0 and theta1
+        double core_dist(const GLVertex& p, double theta0, double theta1) const;
+        /// the angles at which the pieces start, and the end angle
+        std::vector<double> pieces;
+        /// Bbox of each piece
+        std::vector<Bbox> piece_bb;
+};
 
 } // end namespace
 #endif
@@ -65,7 +65,7 @@ double canonLine::tok2d(uint n) {
 \param offset skip this many chars at the beginning of the token
 \returns token n, converted to integer
 */
-inline int canonLine::tok2i(uint n,uint offset) {
+int canonLine::tok2i(uint n,uint offset) {
   if (canonTokens.size() < n+1 ) 
     return INT_MIN;
   char * end;
@@ -148,7 +148,6 @@ canonLine * canonLine::canonLineFactory (std::string l , machineStatus s) {
     ** check for comments first because it is not impossible
     ** for one to contain the text "STRAIGHT" or "ARC_FEED"
     */
-    std::cout << l; // print the line
     if ( (cmnt!=std::string::npos) || (msg!=std::string::npos) ) {
         return new canonMotionless(l,s); // comment or message, no motion
     } else if (lin!=std::string::npos) { 
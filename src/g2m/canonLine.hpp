@@ -43,6 +43,7 @@ You cannot create objects of this class - instead, create an object of a class
 */
 class canonLine {
   public:
+    virtual ~canonLine() {}
     /// return the canon-line as a string
     const std::string getLine() {return myLine;};
     /// return Pose at start of this move
@@ -65,6 +66,12 @@ class canonLine {
     virtual double length() {assert(0); return -1;}
     /// return interpolated point at position t along the motion
     virtual Point point(double t) {assert(0); return Point();}
+    /// return the center of an arc, at the height of the start point
+    virtual Point getCenter() {assert(0); return Point();}
+    /// return the unit axis of an arc, normal to its plane
+    virtual Point getAxis() {assert(0); return Point();}
+    /// return the angle of an arc in radians, positive is counter-clockwise about getAxis()
+    virtual double getAngle() {assert(0); return 0;}
     
     // produce a canonLine based on string l, and previous machineStatus s
     static canonLine* canonLineFactory (std::string l, machineStatus s);
@@ -0,0 +1,141 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Mark Pictor                                     *
+ *   mpictor@gmail.com                                                     *
+ *   modifications Copyright (C) 2011 by Anders Wallin                     *
+ *   anders.e.e.wallin@gmail.com                                           *      
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "canonReader.hpp"
+#include "machineStatus.hpp"
+
+namespace g2m {
+
+/// quote s for the shell
+static std::string shellQuote( const std::string& s ) {
+    std::string q = "'";
+    for ( std::string::size_type n=0; n<s.size(); ++n ) {
+        if ( s[n] == '\'' )
+            q += "'\\''";
+        else
+            q += s[n];
+    }
+    return q + "'";
+}
+
+bool canonReader::hasSuffix( const std::string& s, const std::string& suffix ) {
+    return s.size() >= suffix.size() && s.compare( s.size()-suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+/// the same commands as g2m::startInterp() gives rs274 on stdin: read the tool file, then interpret.
+std::string canonReader::interpreterCommand( const std::string& file, const std::string& interp, const std::string& tooltable ) {
+    return "printf '3\\n%s\\n1\\n' " + shellQuote(tooltable) + " | " + shellQuote(interp) + " " + shellQuote(file);
+}
+
+canonReader::~canonReader() {
+    for ( unsigned int n=0; n<lineVector.size(); ++n )
+        delete lineVector[n];
+}
+
+bool canonReader::readFile( const std::string& file, const std::string& interp, const std::string& tooltable ) {
+    if ( hasSuffix( file, ".ngc" ) )
+        return interpretFile( file, interp, tooltable );
+    if ( hasSuffix( file, ".canon" ) )
+        return readCanonFile( file );
+    error = "File name must end with .ngc or .canon!";
+    return false;
+}
+
+bool canonReader::readCanonFile( const std::string& file ) {
+    std::ifstream in( file.c_str() );
+    if ( !in ) {
+        error = "cannot read " + file;
+        return false;
+    }
+    readCanon( in );
+    return true;
+}
+
+bool canonReader::interpretFile( const std::string& file, const std::string& interp, const std::string& tooltable ) {
+    std::ifstream gcode( file.c_str() );
+    if ( !gcode ) {
+        error = "cannot read " + file;
+        return false;
+    }
+    if ( !std::ifstream( tooltable.c_str() ) ) {
+        error = "cannot find tooltable " + tooltable;
+        return false;
+    }
+    std::string gline;
+    gcode_lines = 0;
+    while ( std::getline( gcode, gline ) )
+        gcode_lines++;
+    FILE* toCanon = popen( interpreterCommand( file, interp, tooltable ).c_str(), "r" );
+    if ( !toCanon ) {
+        error = "cannot run the interpreter " + interp;
+        return false;
+    }
+    std::string out;
+    char buf[4096];
+    size_t n;
+    while ( (n = fread( buf, 1, sizeof(buf), toCanon )) > 0 )
+        out.append( buf, n );
+    int status = pclose( toCanon );
+    std::istringstream lines( out );
+    bool foundEOF = readCanon( lines );
+    if ( status != 0 ) {
+        error = "the interpreter " + interp + " exited with an error";
+        return false;
+    }
+    if ( !foundEOF )
+        std::cout << "Warning: file data not terminated correctly. If the file is terminated correctly, this indicates a problem interpreting the file.\n";
+    return true;
+}
+
+bool canonReader::readCanon( std::istream& in ) {
+    bool foundEOF = false;
+    std::string sLine;
+    while ( std::getline( in, sLine ) ) {
+        if ( sLine.length() > 1 ) //helps to prevent segfault in canonLine::cmdMatch()
+            foundEOF = processCanonLine( sLine );
+    }
+    return foundEOF;
+}
+
+/// as g2m::processCanonLine(), each line starts from the machineStatus of the previous line
+bool canonReader::processCanonLine( const std::string& l ) {
+    canonLine* cl;
+    if ( lineVector.size()==0 ) {
+        // no status exists, so make one up.
+        cl = canonLine::canonLineFactory( l, machineStatus( Pose( Point(0,0,0), Point(0,0,1) ) ) );
+    } else {
+        // use the last element status
+        cl = canonLine::canonLineFactory( l, *(lineVector.back())->getStatus() );
+    }
+    lineVector.push_back(cl);
+    
+    // return true when we reach end-of-program
+    if ( !cl->isMotion() )
+        return cl->isNCend();
+    return false;
+}
+
+} // end namespace
@@ -0,0 +1,80 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Mark Pictor                                     *
+ *   mpictor@gmail.com                                                     *
+ *   modifications Copyright (C) 2011 by Anders Wallin                     *
+ *   anders.e.e.wallin@gmail.com                                           *      
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef CANONREADER_HH
+#define CANONREADER_HH
+
+#include <string>
+#include <vector>
+#include <istream>
+
+#include "canonLine.hpp"
+
+namespace g2m {
+
+/**
+\class canonReader
+\brief Creates a canonLine object for each canonical command in a .canon file, 
+* or produced by the interpreter ("rs274") from a .ngc file. 
+Unlike g2m this does not use Qt, so it can be used without a GUI.
+*/
+class canonReader {
+    public:
+        canonReader() : gcode_lines(0) {}
+        /// deletes the canonLines
+        virtual ~canonReader();
+        /// read a .canon file, or interpret a .ngc file with rs274 and the tooltable. 
+        /// returns false, and sets getError(), if the file cannot be read.
+        bool readFile( const std::string& file, const std::string& interp, const std::string& tooltable );
+        /// read canon-lines from a .canon file
+        bool readCanonFile( const std::string& file );
+        /// run the interpreter interp on the .ngc g-code file, and read the canon-lines it writes
+        bool interpretFile( const std::string& file, const std::string& interp, const std::string& tooltable );
+        /// read canon-lines from in, until the end of the stream. returns true if the end of the program was read.
+        bool readCanon( std::istream& in );
+        /// process one canon-line. returns true at the end of the program.
+        bool processCanonLine( const std::string& l );
+        /// return vector of canonLines
+        const std::vector<canonLine*>& getCanonLines() const { return lineVector; }
+        /// number of lines in the .ngc g-code file, 0 for a .canon file
+        int gcodeLines() const { return gcode_lines; }
+        /// why the last read failed
+        const std::string& getError() const { return error; }
+        /// true if the file name ends with suffix, e.g. ".ngc"
+        static bool hasSuffix( const std::string& file, const std::string& suffix );
+        /// the shell command which runs interp on the .ngc file with the tooltable, 
+        /// and writes the canon-lines to its stdout
+        static std::string interpreterCommand( const std::string& file, const std::string& interp, const std::string& tooltable );
+    protected:
+        /// the canonLines read
+        std::vector<canonLine*> lineVector;
+        /// number of lines in the .ngc g-code file
+        int gcode_lines;
+        /// the error message
+        std::string error;
+    private:
+        canonReader(const canonReader&);
+        canonReader& operator=(const canonReader&);
+};
+
+} // end namespace
+#endif //CANONREADER_HH
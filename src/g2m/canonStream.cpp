@@ -0,0 +1,195 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Mark Pictor                                     *
+ *   mpictor@gmail.com                                                     *
+ *   modifications Copyright (C) 2011 by Anders Wallin                     *
+ *   anders.e.e.wallin@gmail.com                                           *      
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <fstream>
+#include <iostream>
+
+#include "canonStream.hpp"
+#include "canonReader.hpp"
+
+namespace g2m {
+
+canonStream::canonStream( unsigned int max_queued ) 
+  : in(NULL), is_pipe(false), max_queued( max_queued>0 ? max_queued : 1 ), gcode_lines(0), parsed(0),
+    status( Pose( Point(0,0,0), Point(0,0,1) ) ), done(false), stopping(false), running(false) {
+    pthread_mutex_init( &mutex, NULL );
+    pthread_cond_init( &not_empty, NULL );
+    pthread_cond_init( &not_full, NULL );
+}
+
+canonStream::~canonStream() {
+    close();
+    pthread_cond_destroy( &not_full );
+    pthread_cond_destroy( &not_empty );
+    pthread_mutex_destroy( &mutex );
+}
+
+bool canonStream::open( const std::string& file, const std::string& interp, const std::string& tooltable ) {
+    close();
+    gcode_lines = 0;
+    parsed = 0;
+    status = machineStatus( Pose( Point(0,0,0), Point(0,0,1) ) );
+    done = false;
+    stopping = false;
+    error.clear();
+    if ( canonReader::hasSuffix( file, ".ngc" ) ) {
+        std::ifstream gcode( file.c_str() );
+        if ( !gcode ) {
+            error = "cannot read " + file;
+            return false;
+        }
+        if ( !std::ifstream( tooltable.c_str() ) ) {
+            error = "cannot find tooltable " + tooltable;
+            return false;
+        }
+        std::string gline;
+        while ( std::getline( gcode, gline ) )
+            gcode_lines++;
+        in = popen( canonReader::interpreterCommand( file, interp, tooltable ).c_str(), "r" );
+        is_pipe = true;
+        if ( !in ) {
+            error = "cannot run the interpreter " + interp;
+            return false;
+        }
+    } else if ( canonReader::hasSuffix( file, ".canon" ) ) {
+        in = fopen( file.c_str(), "r" );
+        is_pipe = false;
+        if ( !in ) {
+            error = "cannot read " + file;
+            return false;
+        }
+    } else {
+        error = "File name must end with .ngc or .canon!";
+        return false;
+    }
+    if ( pthread_create( &worker, NULL, &canonStream::run, this ) != 0 ) {
+        error = "cannot start the parser thread";
+        if ( is_pipe )
+            pclose( in );
+        else
+            fclose( in );
+        in = NULL;
+        return false;
+    }
+    running = true;
+    return true;
+}
+
+void* canonStream::run( void* stream ) {
+    static_cast<canonStream*>( stream )->parse();
+    return NULL;
+}
+
+void canonStream::parse() {
+    bool foundEOF = false;
+    std::string sLine;
+    char buf[4096];
+    bool stopped = false;
+    while ( !stopped && fgets( buf, sizeof(buf), in ) ) {
+        sLine += buf;
+        if ( sLine[ sLine.size()-1 ] != '\n' && !feof(in) )
+            continue; // the rest of a long line
+        if ( sLine[ sLine.size()-1 ] == '\n' )
+            sLine.erase( sLine.size()-1 );
+        if ( sLine.length() > 1 ) { //helps to prevent segfault in canonLine::cmdMatch()
+            // as canonReader::processCanonLine(), each line starts from the machineStatus of the previous line
+            canonLine* cl = canonLine::canonLineFactory( sLine, status );
+            status = *cl->getStatus();
+            foundEOF = !cl->isMotion() && cl->isNCend();
+            stopped = !push( cl );
+        }
+        sLine.clear();
+    }
+    // closing the pipe before the interpreter is done stops it with SIGPIPE
+    int exit_status = is_pipe ? pclose( in ) : fclose( in );
+    in = NULL;
+    pthread_mutex_lock( &mutex );
+    if ( !stopped && is_pipe && exit_status != 0 )
+        error = "the interpreter exited with an error";
+    else if ( !stopped && !foundEOF )
+        std::cout << "Warning: file data not terminated correctly. If the file is terminated correctly, this indicates a problem interpreting the file.\n";
+    done = true;
+    pthread_cond_broadcast( &not_empty );
+    pthread_mutex_unlock( &mutex );
+}
+
+bool canonStream::push( canonLine* cl ) {
+    pthread_mutex_lock( &mutex );
+    while ( queue.size() >= max_queued && !stopping )
+        pthread_cond_wait( &not_full, &mutex );
+    bool ok = !stopping;
+    if ( ok ) {
+        queue.push_back( cl );
+        parsed++;
+        pthread_cond_signal( &not_empty );
+    } else {
+        delete cl;
+    }
+    pthread_mutex_unlock( &mutex );
+    return ok;
+}
+
+canonLine* canonStream::next() {
+    pthread_mutex_lock( &mutex );
+    while ( queue.empty() && running && !done )
+        pthread_cond_wait( &not_empty, &mutex );
+    canonLine* cl = NULL;
+    if ( !queue.empty() ) {
+        cl = queue.front();
+        queue.pop_front();
+        // wake the parser only when the queue is half empty, so that it parses a batch of lines each time
+        if ( queue.size() == max_queued/2 )
+            pthread_cond_signal( &not_full );
+    }
+    pthread_mutex_unlock( &mutex );
+    return cl;
+}
+
+void canonStream::close() {
+    if ( !running )
+        return;
+    pthread_mutex_lock( &mutex );
+    stopping = true;
+    pthread_cond_broadcast( &not_full );
+    pthread_mutex_unlock( &mutex );
+    pthread_join( worker, NULL );
+    running = false;
+    for ( unsigned int n=0; n<queue.size(); ++n )
+        delete queue[n];
+    queue.clear();
+}
+
+unsigned int canonStream::linesParsed() {
+    pthread_mutex_lock( &mutex );
+    unsigned int n = parsed;
+    pthread_mutex_unlock( &mutex );
+    return n;
+}
+
+std::string canonStream::getError() {
+    pthread_mutex_lock( &mutex );
+    std::string e = error;
+    pthread_mutex_unlock( &mutex );
+    return e;
+}
+
+} // end namespace
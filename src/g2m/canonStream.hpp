@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Mark Pictor                                     *
+ *   mpictor@gmail.com                                                     *
+ *   modifications Copyright (C) 2011 by Anders Wallin                     *
+ *   anders.e.e.wallin@gmail.com                                           *      
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef CANONSTREAM_HH
+#define CANONSTREAM_HH
+
+#include <cstdio>
+#include <string>
+#include <deque>
+
+#include <pthread.h>
+
+#include "canonLine.hpp"
+#include "machineStatus.hpp"
+
+namespace g2m {
+
+/**
+\class canonStream
+\brief Parses the canon-lines of a .canon file, or of rs274 interpreting a .ngc file, 
+* on a worker thread, and hands them out one at a time through a bounded queue.
+
+Unlike canonReader, which reads the whole program before returning, the first
+move is available as soon as rs274 has written it, so a simulation can start 
+cutting while the rest of the program is interpreted. The parser stays at most
+max_queued lines ahead of the reader, and the reader owns, and deletes, the lines 
+it has taken, so only a window of a long program is in memory.
+*/
+class canonStream {
+    public:
+        /// a stream which parses at most max_queued lines ahead of next()
+        canonStream( unsigned int max_queued = 1024 );
+        /// stops the parser, and deletes the lines not taken by next()
+        virtual ~canonStream();
+        /// start parsing a .canon file, or the output of interp for a .ngc file with the tooltable.
+        /// returns false, and sets getError(), if the file cannot be read or the interpreter not started.
+        bool open( const std::string& file, const std::string& interp, const std::string& tooltable );
+        /// the next canonLine, waits until the parser has produced it. NULL at the end of the stream.
+        /// the caller owns the line, and deletes it when done with it.
+        canonLine* next();
+        /// stop the parser, and delete the lines not taken by next()
+        void close();
+        /// number of lines in the .ngc g-code file, 0 for a .canon file
+        int gcodeLines() const { return gcode_lines; }
+        /// number of canon-lines parsed so far
+        unsigned int linesParsed();
+        /// why reading failed. set by open(), or by the parser before next() returns NULL.
+        std::string getError();
+    protected:
+        /// the worker thread
+        static void* run( void* stream );
+        /// read and parse lines from in until the end of the file, or close()
+        void parse();
+        /// wait for room in the queue and add cl to it. false if close() was called.
+        bool push( canonLine* cl );
+        /// the file, or the pipe from the interpreter
+        FILE* in;
+        /// true if in is a pipe, closed with pclose()
+        bool is_pipe;
+        /// the parsed lines not yet taken by next()
+        std::deque<canonLine*> queue;
+        /// the maximum length of the queue
+        unsigned int max_queued;
+        /// number of lines in the .ngc g-code file
+        int gcode_lines;
+        /// number of canon-lines parsed
+        unsigned int parsed;
+        /// the status after the last parsed line, each line starts from it
+        machineStatus status;
+        /// the parser has reached the end of the file
+        bool done;
+        /// close() was called
+        bool stopping;
+        /// the worker thread was started
+        bool running;
+        /// the error message
+        std::string error;
+        /// the worker thread
+        pthread_t worker;
+        /// protects all the members written by the worker thread
+        pthread_mutex_t mutex;
+        /// signalled when a line is added to the queue, or the parser is done
+        pthread_cond_t not_empty;
+        /// signalled when the queue is half empty, or close() is called
+        pthread_cond_t not_full;
+    private:
+        canonStream(const canonStream&);
+        canonStream& operator=(const canonStream&);
+};
+
+} // end namespace
+#endif //CANONSTREAM_HH
@@ -88,8 +88,8 @@ void g2m::interpret_file() {
     
     
     double e = timer.getElapsedS();
-    emit debugMessage( tr("g2m: Total time to process that file: ") +  timer.humanreadable(e)  ) ;
-    //std::cout << "Total time to process that file: " << timer.humanreadable(e).toStdString() << std::endl;
+    emit debugMessage( tr("g2m: Total time to process that file: ") +  QString::fromStdString( timer.humanreadable(e) )  ) ;
+    //std::cout << "Total time to process that file: " << timer.humanreadable(e) << std::endl;
 
 }
 
@@ -26,6 +26,8 @@ class GPlayer : public QObject {
     public:
         GPlayer()  {  
             first = true;
+            current_tool = 0;
+            current_line = 0;
         }
     public slots:
         /// start or resume executing the program
@@ -78,49 +80,34 @@ class GPlayer : public QObject {
                 emit signalProgress( (int)(100*n/(lines.size()-1)) ); // report progress to ui
             }
             double e = timer.getElapsedS();
-            emit debugMessage( tr("Gplayer: play() took ") + timer.humanreadable(e)  ) ;
+            emit debugMessage( tr("Gplayer: play() took ") + QString::fromStdString( timer.humanreadable(e) )  ) ;
         }*/
         /// signal the next move
         void slotRequestMove() {
-            // UI request that we signal the next signalToolPosition()
-            canonLine* cl = lines[current_line];
-            if (first) {// first ever call here
-                //current_line = 0;
-                current_tool = cl->getStatus()->getTool();
-                first = false;
-            }   
-            if (cl->isMotion() ) {
-                //Point start = cl->getStart().loc;
-                //Point end = cl->getEnd().loc;
-                // divide motion into sampled points. signal motion along path.
-                double ds = 0.5;
-                int n_samples = std::max( (int)( cl->length()/ds ) , 2 ); // want at least two points: start-end
-                //emit debugMessage( tr("GPlayer: length= %1 so will sample %2 moves for this move").arg(cl->length()).arg( n_samples ) );
-                double move_length = cl->length();
-                //for (int m=0; m<n_samples;m++) {
-                    // FIXME: handle first and last moves differently?
-                Point pos = cl->point( (double)(m)/(double)(n_samples-1)*move_length );
-                if (m == (n_samples-1) )
-                    move_done = true;
-                //emit debugMessage( tr("GPlayer: move: (%1, %2, %3)").arg(pos.x).arg(pos.y).arg(pos.z) );
-                emit signalToolPosition( pos.x, pos.y, pos.z );
-                m++; // advance along the move
-            } else {
-                // not motion, check for toolchange
-                if ( current_tool != cl->getStatus()->getTool() ) {
-                    emit debugMessage( tr("GPlayer: toolchange to %1").arg( cl->getStatus()->getTool() ) );
-                    emit signalToolChange( cl->getStatus()->getTool() );
+            // UI request that we signal the next signalToolMove()
+            while ( current_line < lines.size() ) {
+                canonLine* cl = lines[current_line];
+                current_line++;
+                if (first) {// first ever call here
                     current_tool = cl->getStatus()->getTool();
+                    first = false;
+                }
+                emit signalProgress( (int)(100*current_line/lines.size()) ); // report progress to ui
+                if (cl->isMotion() ) {
+                    // the whole move is cut at once, as a swept volume
+                    emit signalToolMove( cl );
+                    Point end = cl->getEnd().loc;
+                    emit signalToolPosition( end.x, end.y, end.z );
+                    return;
+                } else {
+                    // not motion, check for toolchange
+                    if ( current_tool != cl->getStatus()->getTool() ) {
+                        emit debugMessage( tr("GPlayer: toolchange to %1").arg( cl->getStatus()->getTool() ) );
+                        emit signalToolChange( cl->getStatus()->getTool() );
+                        current_tool = cl->getStatus()->getTool();
+                    }
                 }
-                slotRequestMove(); // call self!
-            }
-            
-            if (move_done) {
-                current_line++;
-                move_done=false;
-                m=0;
             }
-            emit signalProgress( (int)(100*current_line/(lines.size()-1)) ); // report progress to ui
         }
         /// pause program
         void pause() {
@@ -136,6 +123,8 @@ class GPlayer : public QObject {
             lines.push_back(l);
         }
     signals:
+        /// signal the next motion, from its start to its end
+        void signalToolMove( canonLine* cl );
         /// signal a new tool position
         void signalToolPosition( double x, double y, double z ); // three-axis for now..
         /// signal a tool change to new tool \param t
@@ -151,10 +140,6 @@ class GPlayer : public QObject {
         int current_tool;
         /// the current canonLine being processed
         unsigned int current_line;
-        /// loop variable
-        int m;
-        /// flag indicating when current move done
-        bool move_done;
         /// vector of canonLines to process
         std::vector<canonLine*> lines;
 };
@@ -181,6 +181,20 @@ Point helicalMotion::point(double s) {
     return Point( p[0], p[1], p[2] ); // no a,b,c for now..
 }
 
+Point helicalMotion::getCenter() {
+    double p[3];
+    p[X] = cx;
+    p[Y] = cy;
+    p[Z] = o[Z];
+    return Point( p[0], p[1], p[2] );
+}
+
+Point helicalMotion::getAxis() {
+    double p[3] = {0,0,0};
+    p[Z] = 1.0;
+    return Point( p[0], p[1], p[2] );
+}
+
 // rotate by cos/sin. from emc2 gcodemodule.cc
 void helicalMotion::rotate(double &x, double &y, double c, double s) {
     double tx = x * c - y * s;
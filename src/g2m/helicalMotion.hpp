@@ -49,6 +49,12 @@ class helicalMotion: protected canonMotion {
     Point point(double s);
     /// return the length of this helix move
     double length();     
+    /// return the center of the arc, at the height of the start point
+    Point getCenter();
+    /// return the unit axis of the arc
+    Point getAxis();
+    /// return the angle of the arc, in radians
+    double getAngle() {return dtheta;}
   private:    
     void rotate(double &x, double &y, double c, double s);
     
@@ -21,7 +21,7 @@
 **************************************************************************/
 
 #include <cstdio>
-#include <QString>
+#include <sstream>
 
 #include "nanotimer.hpp"
 
@@ -57,26 +57,22 @@ double nanotimer::getElapsedS(){
   return delta.tv_sec + delta.tv_nsec/1000000000.0;
 }
 
-QString nanotimer::humanreadable(double s) {
-  QString out;
+std::string nanotimer::humanreadable(double s) {
+  std::ostringstream out;
   if (s > 60) {
     int m;
     m = s/60;
     s = s-(double)(m*60);
-    out = QString::number(m)  + QString("m, ");
+    out << m << "m, ";
   }
   if (s > .5) {
-    out += QString::number(s); 
-    out += QString(" s");
+    out << s << " s";
   } else if (s> 0.0005) {
-    out = QString::number(s*1000); 
-    out += QString(" ms");
+    out << s*1000 << " ms";
   } else {
-    out = QString::number(s*1000000); 
-    out += QString(" us");
+    out << s*1000000 << " us";
   }
-  return out;
+  return out.str();
 }
 
-
 } // end namespace
@@ -39,8 +39,8 @@ class nanotimer {
     long getElapsed();
     /// return seconds since start()
     double getElapsedS();
-    /// return a QString with seconds, milliseconds, microseconds
-    static QString humanreadable(double s);
+    /// return a string with seconds, milliseconds, microseconds
+    static std::string humanreadable(double s);
 };
 
 }